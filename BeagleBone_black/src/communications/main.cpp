@@ -248,11 +248,35 @@ void Main::run()
   ReceiverThread* receiverThread = new ReceiverThread(log_, base_communicator_);
   receiverThread->start();
 
+  // Last seen versions of the sensors channels that are sent to the base station
+  uint32_t imu_version = 0;
+#ifdef PROXI
+  uint32_t proxi_front_version = 0;
+  uint32_t proxi_back_version = 0;
+#endif
   while (sys_.running_) {
     stm_ = data_.getStateMachineData();
     nav_ = data_.getNavigationData();
     mtr_ = data_.getMotorData();
-    sen_ = data_.getSensorsData();
+    sen_.module_status = data_.getSensorsStatus();
+    // only copy the sensors channels that have been republished since the last iteration
+    uint32_t version = data_.getVersion(data::Channel::kSensorsImu);
+    if (version != imu_version) {
+      imu_version = version;
+      sen_.imu = data_.getSensorsImuData();
+    }
+#ifdef PROXI
+    version = data_.getVersion(data::Channel::kSensorsProxiFront);
+    if (version != proxi_front_version) {
+      proxi_front_version = version;
+      sen_.proxi_front = data_.getSensorsProxiFrontData();
+    }
+    version = data_.getVersion(data::Channel::kSensorsProxiBack);
+    if (version != proxi_back_version) {
+      proxi_back_version = version;
+      sen_.proxi_back = data_.getSensorsProxiBackData();
+    }
+#endif
     bat_ = data_.getBatteriesData();
     emb_ = data_.getEmergencyBrakesData();
 
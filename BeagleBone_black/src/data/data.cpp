@@ -17,13 +17,32 @@
 
 #include "data.hpp"
 
+#include "data/recorder.hpp"
+#include "utils/timer.hpp"
+
 namespace hyped {
 
 // imports
 using utils::concurrent::ScopedLock;
+using utils::Timer;
 
 namespace data {
 
+namespace {
+
+// Stores the new value of a channel and appends it to the channel's history. The history is
+// pushed to while holding the SeqLock, which serialises the writers.
+template <typename T, int N>
+void publish(SeqLock<T>* latest, History<T, N>* history, const T& value)
+{
+  latest->modify([history, &value](T* v) {  // NOLINT [whitespace/braces]
+    *v = value;
+    history->push(Timer::getTimeMicros(), value);
+  });
+}
+
+}  // namespace
+
 const char* states[num_states] = {
   "Idle",
   "Calibrating",
@@ -37,118 +56,339 @@ const char* states[num_states] = {
   "Finished",
 };
 
+Data::Data() : recorder_(nullptr) {}
+
 Data& Data::getInstance()
 {
   static Data d;
   return d;
 }
 
+void Data::setRecorder(Recorder* recorder)
+{
+  recorder_.store(recorder, std::memory_order_release);
+}
+
+template <typename T>
+void Data::record(Channel channel, const T& value)
+{
+  Recorder* recorder = recorder_.load(std::memory_order_acquire);
+  if (recorder) recorder->record(static_cast<uint16_t>(channel), &value, sizeof(T));
+}
+
 StateMachine Data::getStateMachineData()
 {
-  ScopedLock L(&lock_state_machine_);
-  return state_machine_;
+  return state_machine_.read();
 }
 
 void Data::setStateMachineData(const StateMachine& sm_data)
 {
-  ScopedLock L(&lock_state_machine_);
-  state_machine_ = sm_data;
+  publish(&state_machine_, &state_machine_history_, sm_data);
+  record(Channel::kStateMachine, sm_data);
+  notifyUpdate(Channel::kStateMachine);
 }
 
 Navigation Data::getNavigationData()
 {
-  ScopedLock L(&lock_navigation_);
-  return navigation_;
+  return navigation_.read();
 }
 
 void Data::setNavigationData(const Navigation& nav_data)
 {
-  ScopedLock L(&lock_navigation_);
-  navigation_ = nav_data;
+  publish(&navigation_, &navigation_history_, nav_data);
+  record(Channel::kNavigation, nav_data);
+  notifyUpdate(Channel::kNavigation);
 }
 
 Sensors Data::getSensorsData()
 {
-  ScopedLock L(&lock_sensors_);
-  return sensors_;
+  Sensors sensors;
+  sensors.module_status          = sensors_status_.read().module_status;
+  sensors.imu                    = sensors_imu_.read();
+#ifdef PROXI
+  sensors.proxi_front            = sensors_proxi_front_.read();
+  sensors.proxi_back             = sensors_proxi_back_.read();
+#endif
+  sensors.keyence_stripe_counter = sensors_keyence_.read();
+  sensors.optical_enc_distance   = sensors_optical_enc_.read();
+  return sensors;
 }
 
 void Data::setSensorsData(const Sensors& sensors_data)
 {
-  ScopedLock L(&lock_sensors_);
-  sensors_ = sensors_data;
+  setSensorsImuData(sensors_data.imu);
+#ifdef PROXI
+  setSensorsProxiFrontData(sensors_data.proxi_front);
+  setSensorsProxiBackData(sensors_data.proxi_back);
+#endif
+  setSensorsKeyenceData(sensors_data.keyence_stripe_counter);
+  setSensorsOpticalEncoderData(sensors_data.optical_enc_distance);
+  // status goes last so that whoever sees the new status also sees the data
+  Module status = sensors_data;
+  sensors_status_.write(status);
+  record(Channel::kSensors, status);
+  notifyUpdate(Channel::kSensors);
+}
+
+ModuleStatus Data::getSensorsStatus()
+{
+  return sensors_status_.read().module_status;
+}
+
+DataPoint<array<Imu, Sensors::kNumImus>> Data::getSensorsImuData()
+{
+  return sensors_imu_.read();
 }
 
 void Data::setSensorsImuData(const DataPoint<array<Imu, Sensors::kNumImus>>& imu)
 {
-  ScopedLock L(&lock_sensors_);
-  sensors_.imu = imu;
+  publish(&sensors_imu_, &sensors_imu_history_, imu);
+  record(Channel::kSensorsImu, imu);
+  notifyUpdate(Channel::kSensorsImu);
+  notifyUpdate(Channel::kSensors);
+}
+
+#ifdef PROXI
+DataPoint<array<Proximity, Sensors::kNumProximities>> Data::getSensorsProxiFrontData()
+{
+  return sensors_proxi_front_.read();
 }
 
-array<StripeCounter, Sensors::kNumKeyence> Data::getKeyenceStripeCounterData()
+void Data::setSensorsProxiFrontData(
+    const DataPoint<array<Proximity, Sensors::kNumProximities>>& proxi)
 {
-  ScopedLock L(&lock_sensors_);
-  return sensors_.keyence_stripe_counter;
+  publish(&sensors_proxi_front_, &sensors_proxi_front_history_, proxi);
+  record(Channel::kSensorsProxiFront, proxi);
+  notifyUpdate(Channel::kSensorsProxiFront);
+  notifyUpdate(Channel::kSensors);
+}
+
+DataPoint<array<Proximity, Sensors::kNumProximities>> Data::getSensorsProxiBackData()
+{
+  return sensors_proxi_back_.read();
+}
+
+void Data::setSensorsProxiBackData(
+    const DataPoint<array<Proximity, Sensors::kNumProximities>>& proxi)
+{
+  publish(&sensors_proxi_back_, &sensors_proxi_back_history_, proxi);
+  record(Channel::kSensorsProxiBack, proxi);
+  notifyUpdate(Channel::kSensorsProxiBack);
+  notifyUpdate(Channel::kSensors);
+}
+#endif
+
+array<StripeCounter, Sensors::kNumKeyence> Data::getSensorsKeyenceData()
+{
+  return sensors_keyence_.read();
+}
+
+void Data::setSensorsKeyenceData(const array<StripeCounter, Sensors::kNumKeyence>& keyence)
+{
+  publish(&sensors_keyence_, &sensors_keyence_history_, keyence);
+  record(Channel::kSensorsKeyence, keyence);
+  notifyUpdate(Channel::kSensorsKeyence);
+  notifyUpdate(Channel::kSensors);
+}
+
+array<float, Sensors::kNumOptEnc> Data::getSensorsOpticalEncoderData()
+{
+  return sensors_optical_enc_.read();
+}
+
+void Data::setSensorsOpticalEncoderData(
+    const array<float, Sensors::kNumOptEnc>& optical_enc_distance)
+{
+  publish(&sensors_optical_enc_, &sensors_optical_enc_history_, optical_enc_distance);
+  record(Channel::kSensorsOpticalEncoder, optical_enc_distance);
+  notifyUpdate(Channel::kSensorsOpticalEncoder);
+  notifyUpdate(Channel::kSensors);
 }
 
 void Data::setCalibrationData(const SensorCalibration sensor_calibration_data)
 {
-  ScopedLock L(&lock_calibration_data_);
-  calibration_data_ = sensor_calibration_data;
+  calibration_data_.write(sensor_calibration_data);
+  record(Channel::kCalibration, sensor_calibration_data);
+  notifyUpdate(Channel::kCalibration);
 }
 
 SensorCalibration Data::getCalibrationData()
 {
-  ScopedLock L(&lock_calibration_data_);
-  return calibration_data_;
+  return calibration_data_.read();
 }
 
 Batteries Data::getBatteriesData()
 {
-  ScopedLock L(&lock_batteries_);
-  return batteries_;
+  return batteries_.read();
 }
 
 void Data::setBatteryData(const Batteries& batteries_data)
 {
-  ScopedLock L(&lock_batteries_);
-  batteries_ = batteries_data;
+  publish(&batteries_, &batteries_history_, batteries_data);
+  record(Channel::kBatteries, batteries_data);
+  notifyUpdate(Channel::kBatteries);
 }
 
 EmergencyBrakes Data::getEmergencyBrakesData()
 {
-  ScopedLock L(&lock_emergency_brakes_);
-  return emergency_brakes_;
+  return emergency_brakes_.read();
 }
 
 void Data::setEmergencyBrakesData(const EmergencyBrakes& emergency_brakes_data)
 {
-  ScopedLock L(&lock_emergency_brakes_);
-  emergency_brakes_ = emergency_brakes_data;
+  publish(&emergency_brakes_, &emergency_brakes_history_, emergency_brakes_data);
+  record(Channel::kEmergencyBrakes, emergency_brakes_data);
+  notifyUpdate(Channel::kEmergencyBrakes);
 }
 
 Motors Data::getMotorData()
 {
-  ScopedLock L(&lock_motors_);
-  return motors_;
+  return motors_.read();
 }
 
 void Data::setMotorData(const Motors& motor_data)
 {
-  ScopedLock L(&lock_motors_);
-  motors_ = motor_data;
+  publish(&motors_, &motors_history_, motor_data);
+  record(Channel::kMotors, motor_data);
+  notifyUpdate(Channel::kMotors);
 }
 
 Communications Data::getCommunicationsData()
 {
-  ScopedLock L(&lock_communications_);
-  return communications_;
+  return communications_.read();
 }
 
 void Data::setCommunicationsData(const Communications& communications_data)
 {
-  ScopedLock L(&lock_communications_);
-  communications_ = communications_data;
+  publish(&communications_, &communications_history_, communications_data);
+  record(Channel::kCommunications, communications_data);
+  notifyUpdate(Channel::kCommunications);
+}
+
+uint32_t Data::getVersion(Channel channel)
+{
+  switch (channel) {
+    case Channel::kStateMachine:          return state_machine_.getVersion();
+    case Channel::kNavigation:            return navigation_.getVersion();
+    case Channel::kSensors:
+      // sum of the parts changes iff any of them does
+      return sensors_status_.getVersion()
+          + getVersion(Channel::kSensorsImu)
+#ifdef PROXI
+          + getVersion(Channel::kSensorsProxiFront)
+          + getVersion(Channel::kSensorsProxiBack)
+#endif
+          + getVersion(Channel::kSensorsKeyence)
+          + getVersion(Channel::kSensorsOpticalEncoder);
+    case Channel::kSensorsImu:            return sensors_imu_.getVersion();
+#ifdef PROXI
+    case Channel::kSensorsProxiFront:     return sensors_proxi_front_.getVersion();
+    case Channel::kSensorsProxiBack:      return sensors_proxi_back_.getVersion();
+#endif
+    case Channel::kSensorsKeyence:        return sensors_keyence_.getVersion();
+    case Channel::kSensorsOpticalEncoder: return sensors_optical_enc_.getVersion();
+    case Channel::kMotors:                return motors_.getVersion();
+    case Channel::kBatteries:             return batteries_.getVersion();
+    case Channel::kCommunications:        return communications_.getVersion();
+    case Channel::kCalibration:           return calibration_data_.getVersion();
+    case Channel::kEmergencyBrakes:       return emergency_brakes_.getVersion();
+    default:                              return 0;
+  }
+}
+
+bool Data::waitForUpdate(Channel channel, uint32_t last_version, uint32_t timeout_ms)
+{
+  if (getVersion(channel) != last_version) return true;
+
+  UpdateNotifier& notifier = notifiers_[static_cast<int>(channel)];
+  uint64_t deadline = Timer::getTimeMicros() + 1000ull * timeout_ms;
+  ScopedLock L(&notifier.lock);
+  // announce ourselves before the final version check, pairs with the fence in notifyUpdate()
+  notifier.num_waiting.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool updated;
+  while (!(updated = getVersion(channel) != last_version)) {
+    uint64_t now = Timer::getTimeMicros();
+    if (now >= deadline) break;
+    notifier.cond_var.wait(&notifier.lock, (deadline - now + 999) / 1000);
+  }
+  notifier.num_waiting.fetch_sub(1);
+  return updated;
+}
+
+void Data::notifyUpdate(Channel channel)
+{
+  UpdateNotifier& notifier = notifiers_[static_cast<int>(channel)];
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (notifier.num_waiting.load(std::memory_order_relaxed) == 0) return;
+
+  // waiters check the version while holding the lock, taking it here means nobody is between
+  // that check and the wait, so the notification cannot be lost
+  { ScopedLock L(&notifier.lock); }
+  notifier.cond_var.notifyAll();
+}
+
+const Data::ChannelHistory<StateMachine>& Data::getStateMachineHistory() const
+{
+  return state_machine_history_;
+}
+
+const Data::ChannelHistory<Navigation>& Data::getNavigationHistory() const
+{
+  return navigation_history_;
+}
+
+const Data::ChannelHistory<DataPoint<array<Imu, Sensors::kNumImus>>>&
+    Data::getSensorsImuHistory() const
+{
+  return sensors_imu_history_;
+}
+
+#ifdef PROXI
+const Data::ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>&
+    Data::getSensorsProxiFrontHistory() const
+{
+  return sensors_proxi_front_history_;
+}
+
+const Data::ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>&
+    Data::getSensorsProxiBackHistory() const
+{
+  return sensors_proxi_back_history_;
+}
+
+#endif
+
+const Data::ChannelHistory<array<StripeCounter, Sensors::kNumKeyence>>&
+    Data::getSensorsKeyenceHistory() const
+{
+  return sensors_keyence_history_;
+}
+
+const Data::ChannelHistory<array<float, Sensors::kNumOptEnc>>&
+    Data::getSensorsOpticalEncoderHistory() const
+{
+  return sensors_optical_enc_history_;
+}
+
+const Data::ChannelHistory<Motors>& Data::getMotorHistory() const
+{
+  return motors_history_;
+}
+
+const Data::ChannelHistory<Batteries>& Data::getBatteriesHistory() const
+{
+  return batteries_history_;
+}
+
+const Data::ChannelHistory<Communications>& Data::getCommunicationsHistory() const
+{
+  return communications_history_;
+}
+
+const Data::ChannelHistory<EmergencyBrakes>& Data::getEmergencyBrakesHistory() const
+{
+  return emergency_brakes_history_;
 }
 
 }}  // namespace data::hyped
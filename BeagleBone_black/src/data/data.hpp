@@ -20,18 +20,24 @@
 #define BEAGLEBONE_BLACK_DATA_DATA_HPP_
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 
 #include "data/data_point.hpp"
+#include "data/history.hpp"
 #include "utils/math/vector.hpp"
+#include "utils/concurrent/condition_variable.hpp"
 #include "utils/concurrent/lock.hpp"
+#include "utils/concurrent/seqlock.hpp"
 
 using std::array;
 
 namespace hyped {
 
 // imports
+using utils::concurrent::ConditionVariable;
 using utils::concurrent::Lock;
+using utils::concurrent::SeqLock;
 using utils::math::Vector;
 
 namespace data {
@@ -182,12 +188,43 @@ struct Communications : public Module {
 // -------------------------------------------------------------------------------------------------
 // Common Data structure/class
 // -------------------------------------------------------------------------------------------------
+/**
+ * @brief      Independently published parts of `Data`. Each channel has its own version counter
+ *             that is incremented with every set*() call. The values are stored in flight
+ *             recordings, keep them stable.
+ */
+enum class Channel {
+  kStateMachine           = 0,
+  kNavigation             = 1,
+  kSensors                = 2,   // Changes whenever any kSensors* channel or the status does
+  kSensorsImu             = 3,
+#ifdef PROXI
+  kSensorsProxiFront      = 4,
+  kSensorsProxiBack       = 5,
+#endif
+  kSensorsKeyence         = 6,
+  kSensorsOpticalEncoder  = 7,
+  kMotors                 = 8,
+  kBatteries              = 9,
+  kCommunications         = 10,
+  kCalibration            = 11,
+  kEmergencyBrakes        = 12,
+  kNumChannels            = 13
+};
+
+class Recorder;
+
 /**
  * @brief      A singleton class managing the data exchange between sub-team
  * threads.
  */
 class Data {
  public:
+  // Number of most recent samples kept for every channel
+  static constexpr int kHistorySize = 1024;
+  template <typename T>
+  using ChannelHistory = History<T, kHistorySize>;
+
   /**
    * @brief      Always returns a reference to the only instance of `Data`.
    */
@@ -214,22 +251,74 @@ class Data {
   void setNavigationData(const Navigation& nav_data);
 
   /**
-   * @brief      Retrieves data from all sensors
+   * @brief      Retrieves data from all sensors. The sensor channels are read one after another,
+   *             prefer the per-channel getters below when only some of them are needed.
    */
   Sensors getSensorsData();
 
   /**
-   * @brief      Should be called to update sensor data.
+   * @brief      Should be called to update sensor data. Publishes every sensor channel, prefer
+   *             the per-channel setters below when only some of them have changed.
    */
   void setSensorsData(const Sensors& sensors_data);
+
+  /**
+   * @brief      Retrieves the status of the sensors module only.
+   */
+  ModuleStatus getSensorsStatus();
+
+  /**
+   * @brief      Retrieves only the IMU readings.
+   */
+  DataPoint<array<Imu, Sensors::kNumImus>> getSensorsImuData();
+
   /**
    * @brief      Should be called to update sensor imu data.
    */
   void setSensorsImuData(const DataPoint<array<Imu, Sensors::kNumImus>>& imu);
+
+#ifdef PROXI
+  /**
+   * @brief      Retrieves only the front proximity readings.
+   */
+  DataPoint<array<Proximity, Sensors::kNumProximities>> getSensorsProxiFrontData();
+
+  /**
+   * @brief      Should be called to update front proximity data.
+   */
+  void setSensorsProxiFrontData(const DataPoint<array<Proximity, Sensors::kNumProximities>>& proxi);
+
+  /**
+   * @brief      Retrieves only the back proximity readings.
+   */
+  DataPoint<array<Proximity, Sensors::kNumProximities>> getSensorsProxiBackData();
+
+  /**
+   * @brief      Should be called to update back proximity data.
+   */
+  void setSensorsProxiBackData(const DataPoint<array<Proximity, Sensors::kNumProximities>>& proxi);
+#endif
+
+  /**
+   * @brief      Retrieves only the keyence stripe counters.
+   */
+  array<StripeCounter, Sensors::kNumKeyence> getSensorsKeyenceData();
+
+  /**
+   * @brief      Should be called to update keyence stripe counter data.
+   */
+  void setSensorsKeyenceData(const array<StripeCounter, Sensors::kNumKeyence>& keyence);
+
   /**
-   * @brief       Retrieves only StripeCount part from Sensors data
+   * @brief      Retrieves only the optical encoder distances.
    */
-  array<StripeCounter, Sensors::kNumKeyence> getKeyenceStripeCounterData();
+  array<float, Sensors::kNumOptEnc> getSensorsOpticalEncoderData();
+
+  /**
+   * @brief      Should be called to update optical encoder data.
+   */
+  void setSensorsOpticalEncoderData(const array<float, Sensors::kNumOptEnc>& optical_enc_distance);
+
   /**
    * @brief      Should be called to update sensor calibration data
    */
@@ -279,27 +368,108 @@ class Data {
    */
   void setCommunicationsData(const Communications& communications_data);
 
+  /**
+   * @brief      Number of times the channel has been published so far. Read it before calling
+   *             the getter to know which version the retrieved data is at least as new as.
+   */
+  uint32_t getVersion(Channel channel);
+
+  /**
+   * @brief      Blocks the calling thread until the channel is published with a version other
+   *             than `last_version`, or `timeout_ms` milliseconds elapse. Use instead of polling
+   *             the getters in a yield() loop.
+   *
+   * @return     True iff the channel has been updated, false on timeout.
+   */
+  bool waitForUpdate(Channel channel, uint32_t last_version, uint32_t timeout_ms);
+
+  /**
+   * @brief      Histories of the last kHistorySize values published to each channel, timestamped
+   *             with the time of publishing (utils::Timer::getTimeMicros()). Safe to query from
+   *             any thread without locking, e.g. to get all IMU samples since a given time.
+   */
+  const ChannelHistory<StateMachine>& getStateMachineHistory() const;
+  const ChannelHistory<Navigation>& getNavigationHistory() const;
+  const ChannelHistory<DataPoint<array<Imu, Sensors::kNumImus>>>& getSensorsImuHistory() const;
+#ifdef PROXI
+  const ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>&
+      getSensorsProxiFrontHistory() const;
+  const ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>&
+      getSensorsProxiBackHistory() const;
+#endif
+  const ChannelHistory<array<StripeCounter, Sensors::kNumKeyence>>&
+      getSensorsKeyenceHistory() const;
+  const ChannelHistory<array<float, Sensors::kNumOptEnc>>& getSensorsOpticalEncoderHistory() const;
+  const ChannelHistory<Motors>& getMotorHistory() const;
+  const ChannelHistory<Batteries>& getBatteriesHistory() const;
+  const ChannelHistory<Communications>& getCommunicationsHistory() const;
+  const ChannelHistory<EmergencyBrakes>& getEmergencyBrakesHistory() const;
+
+  /**
+   * @brief      Makes every set*() call also append the published value to a flight recording.
+   *             Pass nullptr to stop recording; the recorder must outlive its use here.
+   */
+  void setRecorder(Recorder* recorder);
+
  private:
-  StateMachine state_machine_;
-  Navigation navigation_;
-  Sensors sensors_;
-  Motors motors_;
-  Batteries batteries_;
-  Communications communications_;
-  SensorCalibration calibration_data_;
-  EmergencyBrakes emergency_brakes_;
-
-
-  // locks for data substructures
-  Lock lock_state_machine_;
-  Lock lock_navigation_;
-  Lock lock_sensors_;
-  Lock lock_motors_;
-
-  Lock lock_communications_;
-  Lock lock_batteries_;
-  Lock lock_emergency_brakes_;
-  Lock lock_calibration_data_;
+  Data();
+
+  /**
+   * @brief      Hands a published value to the recorder, if there is one.
+   */
+  template <typename T>
+  void record(Channel channel, const T& value);
+
+  /**
+   * @brief      Wakes up threads blocked in waitForUpdate() on this channel. Cheap (no locking)
+   *             when nobody is waiting.
+   */
+  void notifyUpdate(Channel channel);
+
+  struct UpdateNotifier {
+    UpdateNotifier() : num_waiting(0) {}
+    Lock lock;
+    ConditionVariable cond_var;
+    std::atomic<int> num_waiting;
+  };
+
+  array<UpdateNotifier, static_cast<int>(Channel::kNumChannels)> notifiers_;
+  std::atomic<Recorder*> recorder_;
+
+  // each substructure is published through its own sequence lock, readers never block writers
+  SeqLock<StateMachine> state_machine_;
+  SeqLock<Navigation> navigation_;
+  // Sensors are split so that publishing a new IMU sample does not copy the other sensors
+  SeqLock<Module> sensors_status_;
+  SeqLock<DataPoint<array<Imu, Sensors::kNumImus>>> sensors_imu_;
+#ifdef PROXI
+  SeqLock<DataPoint<array<Proximity, Sensors::kNumProximities>>> sensors_proxi_front_;
+  SeqLock<DataPoint<array<Proximity, Sensors::kNumProximities>>> sensors_proxi_back_;
+#endif
+  SeqLock<array<StripeCounter, Sensors::kNumKeyence>> sensors_keyence_;
+  SeqLock<array<float, Sensors::kNumOptEnc>> sensors_optical_enc_;
+  SeqLock<Motors> motors_;
+  SeqLock<Batteries> batteries_;
+  SeqLock<Communications> communications_;
+  SeqLock<SensorCalibration> calibration_data_;
+  SeqLock<EmergencyBrakes> emergency_brakes_;
+
+  // appended to by the setters while holding the corresponding SeqLock, i.e. a single writer
+  ChannelHistory<StateMachine> state_machine_history_;
+  ChannelHistory<Navigation> navigation_history_;
+  ChannelHistory<DataPoint<array<Imu, Sensors::kNumImus>>> sensors_imu_history_;
+#ifdef PROXI
+  ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>
+      sensors_proxi_front_history_;
+  ChannelHistory<DataPoint<array<Proximity, Sensors::kNumProximities>>>
+      sensors_proxi_back_history_;
+#endif
+  ChannelHistory<array<StripeCounter, Sensors::kNumKeyence>> sensors_keyence_history_;
+  ChannelHistory<array<float, Sensors::kNumOptEnc>> sensors_optical_enc_history_;
+  ChannelHistory<Motors> motors_history_;
+  ChannelHistory<Batteries> batteries_history_;
+  ChannelHistory<Communications> communications_history_;
+  ChannelHistory<EmergencyBrakes> emergency_brakes_history_;
 };
 
 }}  // namespace data::hyped
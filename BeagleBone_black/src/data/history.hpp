@@ -0,0 +1,167 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 24/07/2018
+ * Description:
+ * Fixed-capacity history of the last N published values of a data channel. All storage is
+ * part of the object, nothing is allocated. One thread pushes, any number of threads can query
+ * concurrently without locking; every slot carries its own sequence number so that readers can
+ * detect slots that were overwritten while being copied.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_DATA_HISTORY_HPP_
+#define BEAGLEBONE_BLACK_DATA_HISTORY_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include <algorithm>
+#include <cstring>
+
+#include "data/data_point.hpp"
+#include "utils/utils.hpp"
+
+namespace hyped {
+namespace data {
+
+template <typename T, int N>
+class History {
+  static_assert(N > 0, "History needs at least one slot");
+  static_assert(std::is_trivially_copyable<T>::value,
+                "History can only store trivially copyable types");
+
+ public:
+  History() : count_(0)
+  {
+    for (Slot& slot : slots_) slot.sequence.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief      Appends a sample, overwriting the oldest one once the history is full. Must only
+   *             ever be called from one thread at a time.
+   *
+   * @param[in]  timestamp  Time of the sample in microseconds, non-decreasing between pushes
+   */
+  void push(uint32_t timestamp, const T& value)
+  {
+    uint64_t index = count_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[index % N];
+    // odd sequence marks the slot as being written, readers discard it
+    slot.sequence.store(2*index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.sample.timestamp = timestamp;
+    slot.sample.value     = value;
+    slot.sequence.store(2*index + 2, std::memory_order_release);
+    count_.store(index + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief      Copies the samples with timestamp strictly greater than `since`, oldest first.
+   *             If there are more than `max` of them, the `max` most recent ones are returned.
+   *             Samples overwritten by the writer while being read are not returned.
+   *
+   * @param[out] out    Array with space for at least `max` samples
+   * @return     Number of samples written to `out`
+   */
+  std::size_t getSince(uint32_t since, DataPoint<T>* out, std::size_t max) const
+  {
+    uint64_t newest = count_.load(std::memory_order_acquire);
+    uint64_t oldest = newest > N ? newest - N : 0;
+    std::size_t num = 0;
+    // walk from the newest sample backwards, stop at the first one that is too old
+    for (uint64_t index = newest; index > oldest && num < max; index--) {
+      if (!read(index - 1, &out[num]) || out[num].timestamp <= since) break;
+      num++;
+    }
+    std::reverse(out, out + num);
+    return num;
+  }
+
+  /**
+   * @brief      Streaming read: copies the samples from number `*next` onwards, oldest first, and
+   *             advances `*next` past the last one returned. Start with `*next = 0` to receive
+   *             every sample still in the history. Samples overwritten before they could be read
+   *             are skipped, compare `*next` with the number of samples received to count them.
+   *
+   * @param[out] out    Array with space for at least `max` samples
+   * @return     Number of samples written to `out`
+   */
+  std::size_t getFrom(uint64_t* next, DataPoint<T>* out, std::size_t max) const
+  {
+    uint64_t newest = count_.load(std::memory_order_acquire);
+    uint64_t index  = std::max(*next, newest > N ? newest - N : 0);
+    std::size_t num = 0;
+    for (; index < newest && num < max; index++) {
+      if (read(index, &out[num])) num++;
+    }
+    *next = index;
+    return num;
+  }
+
+  /**
+   * @brief      Copies the most recent sample.
+   *
+   * @return     False iff nothing has been pushed yet.
+   */
+  bool getLatest(DataPoint<T>* out) const
+  {
+    for (;;) {
+      uint64_t newest = count_.load(std::memory_order_acquire);
+      if (newest == 0) return false;
+      if (read(newest - 1, out)) return true;
+      // the writer lapped the whole ring while we were reading, try again
+    }
+  }
+
+  /**
+   * @brief      Total number of samples pushed so far (including the overwritten ones).
+   */
+  uint64_t getCount() const
+  {
+    return count_.load(std::memory_order_acquire);
+  }
+
+  static constexpr int kCapacity = N;
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> sequence;   // 2*index + 2 once sample number `index` is complete
+    DataPoint<T> sample;
+  };
+
+  // Copies sample number `index` if it is still in the ring
+  bool read(uint64_t index, DataPoint<T>* out) const
+  {
+    const Slot& slot = slots_[index % N];
+    uint64_t expected = 2*index + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != expected) return false;
+    std::memcpy(out, &slot.sample, sizeof(DataPoint<T>));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == expected;
+  }
+
+  std::atomic<uint64_t> count_;
+  std::array<Slot, N> slots_;
+
+  NO_COPY_ASSIGN(History);
+};
+
+template <typename T, int N>
+constexpr int History<T, N>::kCapacity;
+
+}}  // namespace hyped::data
+
+#endif  // BEAGLEBONE_BLACK_DATA_HISTORY_HPP_
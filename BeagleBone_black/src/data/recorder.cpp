@@ -0,0 +1,223 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 25/07/2018
+ * Description:
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "data/recorder.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace hyped {
+namespace data {
+
+using recorder::FileHeader;
+using recorder::RecordHeader;
+
+Recorder::Recorder(Logger& log, const char* file_path, uint64_t capacity,
+                   uint32_t flush_period_ms)
+    : Thread(log),
+      base_(nullptr),
+      capacity_(capacity),
+      flush_period_ms_(flush_period_ms),
+      fd_(-1),
+      tail_(sizeof(FileHeader)),
+      num_dropped_(0),
+      flushed_(0),
+      previous_flush_end_(0),
+      running_(true)
+{
+  fd_ = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    log_.ERR("RECORDER", "could not open %s: %s", file_path, strerror(errno));
+    return;
+  }
+  // allocate the whole file upfront so that recording never has to grow it
+  if (ftruncate(fd_, capacity_) != 0) {
+    log_.ERR("RECORDER", "could not resize %s: %s", file_path, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  void* base = mmap(0, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    log_.ERR("RECORDER", "could not map %s: %s", file_path, strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  base_ = static_cast<uint8_t*>(base);
+
+  FileHeader header;
+  std::memcpy(header.magic, recorder::kMagic, sizeof(header.magic));
+  header.version  = recorder::kVersion;
+#ifdef PROXI
+  header.proxi    = 1;
+#else
+  header.proxi    = 0;
+#endif
+  header.capacity = capacity_;
+  std::memcpy(base_, &header, sizeof(header));
+  log_.INFO("RECORDER", "recording to %s, %u kB reserved", file_path,
+      static_cast<uint32_t>(capacity_ / 1024));
+}
+
+Recorder::~Recorder()
+{
+  if (!base_) return;
+  flush();
+  munmap(base_, capacity_);
+  close(fd_);
+}
+
+void Recorder::record(uint16_t channel, const void* value, uint32_t size)
+{
+  if (!base_) return;
+
+  uint64_t length = recorder::recordSize(size);
+  uint64_t offset = tail_.fetch_add(length, std::memory_order_relaxed);
+  if (offset + length > capacity_) {
+    // the zero-filled remainder of the file marks the end of the recording
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  RecordHeader* header = reinterpret_cast<RecordHeader*>(base_ + offset);
+  header->size      = size;
+  header->channel   = channel;
+  header->reserved  = 0;
+  header->timestamp = now.tv_sec * 1000000000ull + now.tv_nsec;
+  header->reserved2 = 0;
+  std::memcpy(header + 1, value, size);
+  // a decoder only trusts records whose commit marker made it to the file after the payload
+  std::atomic_thread_fence(std::memory_order_release);
+  header->commit    = recorder::kCommitted;
+}
+
+void Recorder::run()
+{
+  if (!base_) return;
+  while (running_.load(std::memory_order_acquire)) {
+    sleep(flush_period_ms_);
+    flush();
+  }
+  flush();
+}
+
+void Recorder::stop()
+{
+  running_.store(false, std::memory_order_release);
+}
+
+void Recorder::flush()
+{
+  if (!base_) return;
+  ScopedLock L(&flush_lock_);
+
+  static const uint64_t kPageSize = sysconf(_SC_PAGESIZE);
+  uint64_t end   = getNumBytesUsed();
+  uint64_t begin = flushed_ / kPageSize * kPageSize;
+  if (end > begin && msync(base_ + begin, end - begin, MS_SYNC) != 0) {
+    log_.ERR("RECORDER", "msync failed: %s", strerror(errno));
+  }
+  // records reserved before the previous flush may have been completed only after it, so
+  // every flush also covers the range of the previous one
+  flushed_            = previous_flush_end_;
+  previous_flush_end_ = end;
+}
+
+uint64_t Recorder::getNumBytesUsed() const
+{
+  return std::min(tail_.load(std::memory_order_relaxed), capacity_);
+}
+
+RecordingReader::RecordingReader(const char* file_path)
+    : base_(nullptr),
+      size_(0),
+      offset_(sizeof(FileHeader)),
+      num_incomplete_(0),
+      error_(nullptr)
+{
+  int fd = open(file_path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    error_ = "cannot open file";
+    if (fd >= 0) close(fd);
+    return;
+  }
+  size_ = st.st_size;
+  if (size_ < sizeof(FileHeader)) {
+    error_ = "not a recording";
+    close(fd);
+    return;
+  }
+  void* base = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);    // the mapping stays valid
+  if (base == MAP_FAILED) {
+    error_ = "cannot map file";
+    return;
+  }
+
+  FileHeader header;
+  std::memcpy(&header, base, sizeof(header));
+#ifdef PROXI
+  const uint32_t kProxi = 1;
+#else
+  const uint32_t kProxi = 0;
+#endif
+  if (std::memcmp(header.magic, recorder::kMagic, sizeof(header.magic)) != 0
+      || header.version != recorder::kVersion) {
+    error_ = "not a recording of this version";
+  } else if (header.proxi != kProxi) {
+    error_ = "recording made with a different PROXI setting";
+  } else {
+    base_ = static_cast<const uint8_t*>(base);
+    return;
+  }
+  munmap(base, size_);
+}
+
+RecordingReader::~RecordingReader()
+{
+  if (base_) munmap(const_cast<uint8_t*>(base_), size_);
+}
+
+bool RecordingReader::next(RecordHeader* header, const void** payload)
+{
+  if (!base_) return false;
+  while (offset_ + sizeof(RecordHeader) <= size_) {
+    std::memcpy(header, base_ + offset_, sizeof(RecordHeader));
+    if (header->size == 0) return false;          // end of recording
+    uint64_t next = offset_ + recorder::recordSize(header->size);
+    if (next > size_) return false;               // cut off
+    *payload = base_ + offset_ + sizeof(RecordHeader);
+    offset_  = next;
+    if (header->commit == recorder::kCommitted) return true;
+    num_incomplete_++;
+  }
+  return false;
+}
+
+}}  // namespace hyped::data
@@ -0,0 +1,185 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 25/07/2018
+ * Description:
+ * Flight recorder. Every value published to data::Data is appended as a fixed-layout binary
+ * record to a preallocated, memory-mapped file. Writers copy the value straight into the mapping
+ * and never touch the disk themselves; the recorder's own thread periodically msync()s the part
+ * written since the last flush.
+ *
+ * File layout: FileHeader, followed by records. Every record is a RecordHeader followed by the raw
+ * bytes of the published struct, padded to a multiple of 8 bytes. A record whose `size` is 0 marks
+ * the end of the data. Use recorder_to_csv to decode a recording.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_DATA_RECORDER_HPP_
+#define BEAGLEBONE_BLACK_DATA_RECORDER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/concurrent/lock.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+#include "utils/utils.hpp"
+
+namespace hyped {
+
+using utils::concurrent::Lock;
+using utils::concurrent::ScopedLock;
+using utils::concurrent::Thread;
+using utils::Logger;
+
+namespace data {
+
+namespace recorder {
+constexpr char     kMagic[8]      = {'H', 'Y', 'P', 'E', 'D', 'R', 'E', 'C'};
+constexpr uint32_t kVersion       = 1;
+constexpr uint32_t kCommitted     = 0xC0FFEE01;   // RecordHeader::commit of a complete record
+constexpr uint32_t kAlignment     = 8;
+
+struct FileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t proxi;           // 1 iff recorded by a PROXI build (changes SensorCalibration layout)
+  uint64_t capacity;        // size of the whole file in bytes
+};
+
+struct RecordHeader {
+  uint32_t size;            // number of payload bytes, 0 means end of data
+  uint16_t channel;         // data::Channel the value was published to
+  uint16_t reserved;
+  uint64_t timestamp;       // CLOCK_MONOTONIC, ns
+  uint32_t commit;          // kCommitted once the payload has been written completely
+  uint32_t reserved2;
+};
+
+/**
+ * @brief Size of a record with `size` bytes of payload, including the header and padding
+ */
+constexpr uint64_t recordSize(uint32_t size)
+{
+  return sizeof(RecordHeader) + (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+}  // namespace recorder
+
+class Recorder : public Thread {
+ public:
+  /**
+   * @brief Creates (or truncates) the file at `file_path`, makes it `capacity` bytes large and
+   *        maps it into memory. Check isOpen() for success.
+   */
+  Recorder(Logger& log, const char* file_path, uint64_t capacity,
+           uint32_t flush_period_ms = 100);
+  ~Recorder();
+
+  bool isOpen() const { return base_ != nullptr; }
+
+  /**
+   * @brief Appends one record. Wait-free, safe to call from any number of threads. Once the file
+   *        is full further records are dropped (and counted).
+   *
+   * @param channel  id of the data::Channel
+   * @param value    raw bytes of the published struct, copied directly into the mapped file
+   */
+  void record(uint16_t channel, const void* value, uint32_t size);
+
+  /**
+   * @brief Flushes the data periodically until stop() is called
+   */
+  void run() override;
+
+  /**
+   * @brief Makes run() return after a final flush
+   */
+  void stop();
+
+  /**
+   * @brief Writes everything recorded so far to the disk, blocking
+   */
+  void flush();
+
+  uint64_t getNumBytesUsed() const;
+  uint64_t getNumDropped() const { return num_dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  uint8_t* base_;
+  uint64_t capacity_;
+  uint32_t flush_period_ms_;
+  int fd_;
+
+  std::atomic<uint64_t> tail_;            // offset of the next record to be reserved
+  std::atomic<uint64_t> num_dropped_;
+  Lock flush_lock_;
+  uint64_t flushed_;                      // everything before this offset is on the disk
+  uint64_t previous_flush_end_;
+  std::atomic<bool> running_;
+
+  NO_COPY_ASSIGN(Recorder);
+};
+
+/**
+ * @brief Sequential reader of a recording made by Recorder, e.g. for offline replay and decoding
+ */
+class RecordingReader {
+ public:
+  /**
+   * @brief Maps the recording into memory. Check isOpen() for success; getError() says what is
+   *        wrong otherwise. Recordings made with a different PROXI setting are rejected as the
+   *        layout of the sensor structures differs.
+   */
+  explicit RecordingReader(const char* file_path);
+  ~RecordingReader();
+
+  bool isOpen() const { return base_ != nullptr; }
+  const char* getError() const { return error_; }
+
+  /**
+   * @brief Advances to the next complete record, skipping those the writer never finished.
+   *
+   * @param[out] header   header of the record
+   * @param[out] payload  raw value of the record, only aligned to 8 bytes
+   * @return     false at the end of the recording
+   */
+  bool next(recorder::RecordHeader* header, const void** payload);
+
+  /**
+   * @brief Copies the payload of a record into `value` if the sizes match.
+   */
+  template <typename T>
+  static bool decode(const recorder::RecordHeader& header, const void* payload, T* value)
+  {
+    if (header.size != sizeof(T)) return false;
+    std::memcpy(value, payload, sizeof(T));
+    return true;
+  }
+
+  uint64_t getOffset() const { return offset_; }
+  uint32_t getNumIncomplete() const { return num_incomplete_; }
+
+ private:
+  const uint8_t* base_;
+  uint64_t size_;
+  uint64_t offset_;
+  uint32_t num_incomplete_;
+  const char* error_;
+
+  NO_COPY_ASSIGN(RecordingReader);
+};
+
+}}  // namespace hyped::data
+
+#endif  // BEAGLEBONE_BLACK_DATA_RECORDER_HPP_
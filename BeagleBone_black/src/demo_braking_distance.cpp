@@ -0,0 +1,91 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Validates the braking distance table against the polynomial fit it samples and compares the
+ * cost of a call. Exits with 1 if the table is off by more than kTolerance (relative) anywhere,
+ * including next to the switch between the slow and the fast fit at 50 m/s, where the fit jumps.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "navigation/braking_distance.hpp"
+
+using hyped::data::NavigationType;
+using hyped::navigation::BrakingDistanceTable;
+using hyped::navigation::brakingDistanceFit;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr NavigationType kTolerance  = 7.5e-4;   // of the braking distance, largest near 0 m/s
+constexpr NavigationType kSwitch     = BrakingDistanceTable::kSwitchVelocity;
+constexpr int            kNumSamples = 1000000;
+
+// Prevents the compiler from optimising the calls away
+volatile NavigationType sink;
+
+}  // namespace
+
+int main()
+{
+  const BrakingDistanceTable& table = BrakingDistanceTable::getInstance();
+
+  std::mt19937 random(1);
+  std::uniform_real_distribution<NavigationType> uniform(0, BrakingDistanceTable::kMaxVelocity);
+  std::vector<NavigationType> velocities(kNumSamples);
+  for (NavigationType& v : velocities) v = uniform(random);
+
+  // Validation
+  NavigationType max_error = 0, max_error_v = 0, max_switch_error = 0;
+  for (NavigationType v : velocities) {
+    NavigationType fit   = brakingDistanceFit(v);
+    NavigationType error = std::abs(table.lookup(v) - fit) / fit;
+    if (std::abs(v - kSwitch) < BrakingDistanceTable::kStep) {
+      max_switch_error = std::max(max_switch_error, error);
+    } else if (error > max_error) {
+      max_error   = error;
+      max_error_v = v;
+    }
+  }
+  printf("largest table error %.3f%% at %.3f m/s (%.3f%% next to the %.0f m/s switch)\n",
+      100 * max_error, max_error_v, 100 * max_switch_error, kSwitch);
+
+  // Cost per call
+  Clock::time_point start = Clock::now();
+  for (NavigationType v : velocities) sink = brakingDistanceFit(v);
+  double fit_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  start = Clock::now();
+  for (NavigationType v : velocities) sink = table.lookup(v);
+  double table_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  printf("polynomial %.1f ns per call, table %.1f ns per call\n",
+      fit_ns / kNumSamples, table_ns / kNumSamples);
+
+  if (std::max(max_error, max_switch_error) > kTolerance) {
+    printf("FAIL: table error above %.3f%%\n", 100 * kTolerance);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 23/07/2018
+ * Description:
+ * Contention benchmark of data::Data. Five threads mimic the access pattern of the pod modules
+ * (sensors publisher, navigation, state machine, motors, communications) and the latency of every
+ * getter/setter call is recorded. Reports p50/p99/max latency per operation.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+
+#include "data/data.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::Data;
+using hyped::data::Motors;
+using hyped::data::Navigation;
+using hyped::data::Sensors;
+using hyped::data::StateMachine;
+using hyped::utils::concurrent::Thread;
+using hyped::utils::Logger;
+
+namespace {
+
+constexpr int kIterations = 200000;   // per thread
+typedef std::chrono::steady_clock Clock;
+
+Logger log(false, -1);
+
+/**
+ * @brief Preallocated latency samples (in ns) of a single operation type.
+ */
+struct Samples {
+  explicit Samples(const char* name) : name(name) { ns.reserve(kIterations); }
+  const char* name;
+  std::vector<uint32_t> ns;
+};
+
+// Times a single call of `f` and stores the latency in `s`
+template <typename F>
+inline void measure(Samples* s, F f)
+{
+  Clock::time_point start = Clock::now();
+  f();
+  Clock::time_point stop  = Clock::now();
+  s->ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+}
+
+void report(Samples* s)
+{
+  if (s->ns.empty()) return;
+  std::sort(s->ns.begin(), s->ns.end());
+  std::size_t n = s->ns.size();
+  printf("%-28s p50=%6u ns  p99=%6u ns  p99.9=%8u ns  max=%9u ns\n", s->name,
+      s->ns[n/2], s->ns[n*99/100], s->ns[n*999/1000], s->ns.back());
+}
+
+class ModuleThread : public Thread {
+ public:
+  explicit ModuleThread(uint8_t id) : Thread(id, log), data_(Data::getInstance()) {}
+
+ protected:
+  Data& data_;
+};
+
+// Sensors: publishes new sensor readings as fast as possible
+class SensorsThread : public ModuleThread {
+ public:
+  SensorsThread() : ModuleThread(0), set_("sensors: setSensorsImuData") {}
+  void run() override
+  {
+    Sensors sensors;
+    for (int i = 0; i < kIterations; i++) {
+      sensors.imu.timestamp = i;
+      sensors.imu.value[0].acc[0] = i;
+      measure(&set_, [&]() { data_.setSensorsImuData(sensors.imu); });
+    }
+  }
+  Samples set_;
+};
+
+// Navigation: consumes sensors, publishes navigation
+class NavigationThread : public ModuleThread {
+ public:
+  NavigationThread()
+      : ModuleThread(1),
+        get_("nav: getSensorsImuData"),
+        set_("nav: setNavigationData")
+  {}
+  void run() override
+  {
+    Navigation nav;
+    for (int i = 0; i < kIterations; i++) {
+      Sensors sensors;
+      measure(&get_, [&]() { sensors.imu = data_.getSensorsImuData(); });
+      nav.distance = sensors.imu.value[0].acc[0];
+      measure(&set_, [&]() { data_.setNavigationData(nav); });
+    }
+  }
+  Samples get_, set_;
+};
+
+// State machine: polls everything it needs to make transitions
+class StateMachineThread : public ModuleThread {
+ public:
+  StateMachineThread()
+      : ModuleThread(2),
+        get_nav_("stm: getNavigationData"),
+        get_sm_("stm: getStateMachineData"),
+        set_sm_("stm: setStateMachineData")
+  {}
+  void run() override
+  {
+    for (int i = 0; i < kIterations; i++) {
+      Navigation nav;
+      StateMachine sm;
+      measure(&get_nav_, [&]() { nav = data_.getNavigationData(); });
+      measure(&get_sm_,  [&]() { sm = data_.getStateMachineData(); });
+      sm.critical_failure = nav.distance < 0;
+      measure(&set_sm_,  [&]() { data_.setStateMachineData(sm); });
+    }
+  }
+  Samples get_nav_, get_sm_, set_sm_;
+};
+
+// Motors: follows navigation, publishes motor data
+class MotorsThread : public ModuleThread {
+ public:
+  MotorsThread()
+      : ModuleThread(3),
+        get_("mtr: getNavigationData"),
+        set_("mtr: setMotorData")
+  {}
+  void run() override
+  {
+    Motors motors;
+    for (int i = 0; i < kIterations; i++) {
+      Navigation nav;
+      measure(&get_, [&]() { nav = data_.getNavigationData(); });
+      motors.velocity_1 = nav.distance;
+      measure(&set_, [&]() { data_.setMotorData(motors); });
+    }
+  }
+  Samples get_, set_;
+};
+
+// Communications: reads the full sensors struct for telemetry
+class CommunicationsThread : public ModuleThread {
+ public:
+  CommunicationsThread() : ModuleThread(4), get_("cmn: getSensorsImuData") {}
+  void run() override
+  {
+    for (int i = 0; i < kIterations; i++) {
+      Sensors sensors;
+      measure(&get_, [&]() { sensors.imu = data_.getSensorsImuData(); });
+    }
+  }
+  Samples get_;
+};
+
+}  // namespace
+
+int main()
+{
+  SensorsThread        sensors;
+  NavigationThread     navigation;
+  StateMachineThread   state_machine;
+  MotorsThread         motors;
+  CommunicationsThread communications;
+  Thread* threads[] = {&sensors, &navigation, &state_machine, &motors, &communications};
+
+  Clock::time_point start = Clock::now();
+  for (Thread* t : threads) t->start();
+  for (Thread* t : threads) t->join();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("5 module threads, %d iterations each, %.3f s total\n", kIterations, seconds);
+  report(&sensors.set_);
+  report(&navigation.get_);
+  report(&navigation.set_);
+  report(&state_machine.get_nav_);
+  report(&state_machine.get_sm_);
+  report(&state_machine.set_sm_);
+  report(&motors.get_);
+  report(&motors.set_);
+  report(&communications.get_);
+  return 0;
+}
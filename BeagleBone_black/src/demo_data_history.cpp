@@ -0,0 +1,115 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 24/07/2018
+ * Description:
+ * Exercises the channel histories of data::Data. A writer thread publishes IMU samples as fast as
+ * it can while a reader repeatedly asks for "all IMU samples since the last one I have seen" and
+ * checks that the samples come in order and are never torn.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "data/data.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+#include "utils/timer.hpp"
+
+using hyped::data::Data;
+using hyped::data::DataPoint;
+using hyped::data::Imu;
+using hyped::data::Sensors;
+using hyped::utils::concurrent::Thread;
+using hyped::utils::Logger;
+using hyped::utils::Timer;
+
+typedef DataPoint<std::array<Imu, Sensors::kNumImus>> ImuSample;
+
+constexpr int kNumSamples = 500000;
+
+Logger logger(true, 0);
+
+class Writer : public Thread {
+ public:
+  Writer() : Thread(0, logger) {}
+  void run() override
+  {
+    Data& data = Data::getInstance();
+    ImuSample imu;
+    for (int i = 1; i <= kNumSamples; i++) {
+      imu.timestamp = i;
+      // every field carries the sample number so that torn reads are easy to spot
+      for (Imu& single : imu.value) {
+        single.operational = true;
+        single.acc = hyped::data::NavigationVector(static_cast<float>(i));
+        single.gyr = single.acc;
+      }
+      data.setSensorsImuData(imu);
+      // give the reader a chance on a single core, it should then keep up with the writer
+      if (i % (Data::kHistorySize / 4) == 0) yield();
+    }
+  }
+};
+
+int main()
+{
+  Data& data = Data::getInstance();
+  const Data::ChannelHistory<ImuSample>& history = data.getSensorsImuHistory();
+  static DataPoint<ImuSample> samples[Data::kHistorySize];
+
+  Writer writer;
+  writer.start();
+
+  uint32_t queries = 0, received = 0, torn = 0, out_of_order = 0;
+  uint64_t next = 0;
+  uint32_t last_sample = 0;
+  Timer timer;
+  while (last_sample < kNumSamples) {
+    std::size_t num;
+    {
+      hyped::utils::ScopedTimer t(&timer);
+      num = history.getFrom(&next, samples, Data::kHistorySize);
+    }
+    queries++;
+    for (std::size_t i = 0; i < num; i++) {
+      const ImuSample& imu = samples[i].value;
+      for (const Imu& single : imu.value) {
+        if (single.acc[0] != imu.timestamp || single.gyr[2] != imu.timestamp) torn++;
+      }
+      if (imu.timestamp <= last_sample) out_of_order++;
+      last_sample = imu.timestamp;
+      received++;
+    }
+    if (num == 0) Thread::yield();
+  }
+  writer.join();
+
+  logger.INFO("DEMO", "%d samples published, %u received (%u overwritten before being read)",
+      kNumSamples, received, kNumSamples - received);
+  logger.INFO("DEMO", "%u queries, %.0f ns per query on average", queries,
+      timer.getMicros() * 1000.0 / queries);
+  logger.INFO("DEMO", "torn samples: %u, out of order samples: %u", torn, out_of_order);
+
+  // time range query: everything published during the last millisecond of the run
+  DataPoint<ImuSample> latest;
+  history.getLatest(&latest);
+  uint32_t since = latest.timestamp > 1000 ? latest.timestamp - 1000 : 0;
+  std::size_t num = history.getSince(since, samples, Data::kHistorySize);
+  logger.INFO("DEMO", "%u samples published in the last ms (%u to %u us)",
+      static_cast<uint32_t>(num), samples[0].timestamp, samples[num - 1].timestamp);
+
+  return (torn || out_of_order) ? 1 : 0;
+}
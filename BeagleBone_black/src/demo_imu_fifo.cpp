@@ -0,0 +1,141 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Simulates an MPU9250 sampling into its FIFO on an oscillator that is off by up to 2%, drained
+ * by a loop that wakes up every ImuManager::kFifoBatchFrames periods with some jitter, and stamps
+ * the frames with FifoClock. Exits with 1 if a frame is lost, a timestamp does not increase or one
+ * is off by a period or more, or if the drains take more than about 2 SPI transactions per batch
+ * of frames. Also prints how many samples reading the data registers once per loop iteration
+ * would drop and duplicate, and the SPI transactions per sample of both.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <cstdint>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+
+#include "sensors/fifo_clock.hpp"
+#include "sensors/imu_manager.hpp"
+#include "sensors/mpu9250.hpp"
+
+using hyped::sensors::FifoClock;
+using hyped::sensors::ImuManager;
+using hyped::sensors::MPU9250;
+
+namespace {
+
+constexpr double kDuration   = 60;      // s
+constexpr double kPollJitter = 500;     // us, mean of the exponential delay of a wake-up
+// SPI transactions per sample, times the frames per drain: a count and a burst read, and a
+// margin for the oscillator drift
+constexpr double kMaxTransactionsPerBatch = 2.2;
+
+struct Result {
+  int num_samples;
+  int num_lost;
+  int num_backwards;
+  double max_error;         // us
+  int num_polls;            // FIFO count reads
+  int num_bursts;           // FIFO reads
+  // reading the data registers once per loop iteration instead
+  int num_dropped;
+  int num_duplicated;
+};
+
+/**
+ * @param period    Output data rate of the sensor, us
+ * @param drift     Relative error of the sensor's oscillator
+ */
+Result simulate(uint32_t period, double drift, int seed)
+{
+  std::mt19937 random(seed);
+  std::exponential_distribution<double> jitter(1 / kPollJitter);
+  const double true_period = period * (1 + drift);
+  // the sensor starts sampling at a random phase of the host clock
+  const double start = std::uniform_real_distribution<double>(1e6, 1e6 + period)(random);
+
+  Result r = {0, 0, 0, 0, 0, 0, 0, 0};
+  FifoClock clock(period);
+  int64_t next_frame = 0;       // index of the oldest frame still in the FIFO
+  int64_t last_register = -1;   // sample last seen in the data registers
+  uint32_t last_timestamp = 0;
+  double now = start;
+  const double poll_period = ImuManager::kFifoBatchFrames * period;
+  for (double wake = start; wake < start + kDuration*1e6; wake += poll_period) {
+    // a late wake-up does not delay the next one
+    now = std::max(now, wake + jitter(random));
+    int64_t newest = static_cast<int64_t>(std::floor((now - start) / true_period));
+    r.num_polls++;
+
+    // registers hold the newest sample only
+    if (newest == last_register) r.num_duplicated++;
+    else if (last_register >= 0) r.num_dropped += newest - last_register - 1;
+    last_register = newest;
+
+    int num_frames = static_cast<int>(newest + 1 - next_frame);
+    if (num_frames > MPU9250::kMaxFifoFrames) r.num_lost += num_frames - MPU9250::kMaxFifoFrames;
+    num_frames = std::min(num_frames, MPU9250::kMaxFifoFrames);
+    if (num_frames <= 0) continue;
+    uint32_t timestamps[MPU9250::kMaxFifoFrames];
+    clock.stamp(static_cast<uint32_t>(now), num_frames, timestamps);
+    for (int i = 0; i < num_frames; i++) {
+      double truth = start + (next_frame + i) * true_period;
+      r.max_error = std::max(r.max_error, std::abs(timestamps[i] - truth));
+      if (r.num_samples > 0 && static_cast<int32_t>(timestamps[i] - last_timestamp) <= 0)
+        r.num_backwards++;
+      last_timestamp = timestamps[i];
+      r.num_samples++;
+    }
+    next_frame += num_frames;
+    r.num_bursts++;
+  }
+  return r;
+}
+
+}  // namespace
+
+int main()
+{
+  bool ok = true;
+  printf("ODR 1 kHz / (1 + divider), drained every %d periods plus jitter, %.0f s each\n",
+      ImuManager::kFifoBatchFrames, kDuration);
+  for (uint8_t divider : {0, 1, 3}) {
+    uint32_t period = 1000 * (1 + divider);
+    for (double drift : {-0.02, 0.0, 0.02}) {
+      Result r = simulate(period, drift, 1);
+      // a register read per poll, of which the duplicates are wasted
+      double fifo_per_sample     = static_cast<double>(r.num_polls + r.num_bursts) / r.num_samples;
+      double register_per_sample = static_cast<double>(r.num_polls)
+                                   / (r.num_polls - r.num_duplicated);
+      printf("%4u Hz, drift %+.0f%%: FIFO %d samples, %d lost, max error %4.0f us, %.2f SPI "
+             "transactions per sample | registers drop %d, duplicate %d, %.2f per sample\n",
+          1000000 / period, drift * 100, r.num_samples, r.num_lost, r.max_error, fifo_per_sample,
+          r.num_dropped, r.num_duplicated, register_per_sample);
+      ok &= r.num_lost == 0 && r.num_backwards == 0 && r.max_error < period;
+      ok &= fifo_per_sample <= kMaxTransactionsPerBatch / ImuManager::kFifoBatchFrames;
+    }
+  }
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
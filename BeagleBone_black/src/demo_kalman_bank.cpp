@@ -0,0 +1,191 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 27/07/2018
+ * Description:
+ * Microbenchmark of the IMU pre-filtering in Navigation: one Kalman<NavigationVector> per IMU
+ * (as navigation used to do it) against KalmanBank over all 4x3 channels, with and without the
+ * fixed-gain path. First checks the banks' states, and the full bank's covariances, against a
+ * KalmanFilter<3> in double per IMU. Exits with 1 if the largest error is above the tolerances.
+ *
+ *   ./demo_kalman_bank [samples]
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <array>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "data/data.hpp"
+#include "utils/math/kalman.hpp"
+#include "utils/math/kalman_bank.hpp"
+#include "utils/math/kalman_filter.hpp"
+
+using hyped::data::NavigationVector;
+using hyped::data::Sensors;
+using hyped::utils::math::Kalman;
+using hyped::utils::math::KalmanBank;
+using hyped::utils::math::KalmanFilter;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef KalmanBank<3*Sensors::kNumImus> ImuBank;
+typedef KalmanFilter<3> ReferenceFilter;
+
+constexpr int kNumChannels = 3*Sensors::kNumImus;
+constexpr int kNumReadings = 4096;    // readings are reused cyclically, fits in L1/L2
+const float kNoise = 0.3;             // std dev of the accelerometer noise, m/s^2
+const float kProcessNoise = 0.1;
+const double kStateTolerance      = 1e-4;   // m/s^2
+const double kCovarianceTolerance = 1e-5;
+
+// Prevents the compiler from optimising the filtering away
+volatile float sink;
+
+NavigationVector imuReading(const float* reading, int imu)
+{
+  return NavigationVector({reading[3*imu], reading[3*imu + 1], reading[3*imu + 2]});
+}
+
+double nsPerSample(Clock::time_point start, int samples)
+{
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / samples;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  int samples = argc > 1 ? atoi(argv[1]) : 2000000;
+  if (samples < 1) samples = 1;
+
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0, kNoise);
+  std::vector<float> readings(kNumReadings * kNumChannels);
+  for (std::size_t i = 0; i < readings.size(); i++)
+    readings[i] = (i % 3 == 2 ? 9.8 : 0) + noise(random);
+
+  // Per-IMU filters, as in Navigation::imuUpdate() before the bank
+  std::array<Kalman<NavigationVector>, Sensors::kNumImus> loop_filters;
+  ImuBank full_bank(false), bank;
+  // The same filter per IMU with the identity as transition and observation, in double
+  std::array<ReferenceFilter, Sensors::kNumImus> reference;
+  const ReferenceFilter::StateMatrix kIdentity = ReferenceFilter::StateMatrix::Identity();
+  const ReferenceFilter::StateMatrix kQ        = kIdentity * kProcessNoise;
+  const ReferenceFilter::StateMatrix kR        = kIdentity * kNoise;
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    NavigationVector first = imuReading(readings.data(), i);
+    loop_filters[i].configure(first, NavigationVector(kNoise), NavigationVector(kProcessNoise));
+    reference[i].configure(ReferenceFilter::StateVector(first[0], first[1], first[2]),
+                           ReferenceFilter::StateMatrix::Zero());
+    for (int axis = 0; axis < 3; axis++) {
+      full_bank.configure(3*i + axis, first[axis], kNoise, kProcessNoise);
+      bank.configure(3*i + axis, first[axis], kNoise, kProcessNoise);
+    }
+  }
+
+  // Outputs must agree; also find how soon the gain converges. The cached bank stops updating
+  // its covariances once converged, so only its state is checked.
+  float max_difference        = 0;
+  double max_state_error      = 0;
+  double max_covariance_error = 0;
+  int converged_after         = -1;
+  for (int s = 0; s < kNumReadings; s++) {
+    const float* reading = readings.data() + s * kNumChannels;
+    float full[kNumChannels], cached[kNumChannels];
+    std::copy(reading, reading + kNumChannels, full);
+    std::copy(reading, reading + kNumChannels, cached);
+    full_bank.filter(full);
+    bank.filter(cached);
+    if (converged_after < 0 && bank.isConverged()) converged_after = s + 1;
+    for (int i = 0; i < Sensors::kNumImus; i++) {
+      NavigationVector filtered = loop_filters[i].filter(imuReading(reading, i));
+      reference[i].predict(kIdentity, kQ);
+      reference[i].update(ReferenceFilter::StateVector(reading[3*i], reading[3*i + 1],
+                                                       reading[3*i + 2]), kIdentity, kR);
+      const ReferenceFilter::StateVector& x = reference[i].getState();
+      const ReferenceFilter::StateMatrix& P = reference[i].getCovariance();
+      for (int axis = 0; axis < 3; axis++) {
+        int channel = 3*i + axis;
+        max_difference  = std::max(max_difference, std::abs(filtered[axis] - full[channel]));
+        max_difference  = std::max(max_difference, std::abs(filtered[axis] - cached[channel]));
+        max_state_error = std::max(max_state_error, std::abs(full[channel] - x[axis]));
+        max_state_error = std::max(max_state_error, std::abs(cached[channel] - x[axis]));
+        max_covariance_error = std::max(max_covariance_error,
+            std::abs(full_bank.getCovariance(channel) - P(axis, axis)));
+      }
+    }
+  }
+  printf("gain converged after %d samples, largest output difference %g m/s^2\n",
+      converged_after, max_difference);
+  printf("against KalmanFilter<3>: largest state error %.1e m/s^2, covariance error %.1e\n",
+      max_state_error, max_covariance_error);
+  bool ok = max_state_error <= kStateTolerance && max_covariance_error <= kCovarianceTolerance;
+
+  // Timing: one sample = all 4 IMUs x 3 axes
+  Clock::time_point start = Clock::now();
+  for (int s = 0; s < samples; s++) {
+    const float* reading = readings.data() + (s % kNumReadings) * kNumChannels;
+    for (int i = 0; i < Sensors::kNumImus; i++)
+      sink = loop_filters[i].filter(imuReading(reading, i))[0];
+  }
+  double loop_ns = nsPerSample(start, samples);
+
+  start = Clock::now();
+  for (int s = 0; s < samples; s++) {
+    float values[kNumChannels];
+    const float* reading = readings.data() + (s % kNumReadings) * kNumChannels;
+    std::copy(reading, reading + kNumChannels, values);
+    full_bank.filter(values);
+    sink = values[0];
+  }
+  double full_ns = nsPerSample(start, samples);
+
+  start = Clock::now();
+  for (int s = 0; s < samples; s++) {
+    float values[kNumChannels];
+    const float* reading = readings.data() + (s % kNumReadings) * kNumChannels;
+    std::copy(reading, reading + kNumChannels, values);
+    bank.filter(values);
+    sink = values[0];
+  }
+  double cached_ns = nsPerSample(start, samples);
+
+#if defined(KALMAN_BANK_NEON)
+  const char* simd = "NEON";
+#elif defined(KALMAN_BANK_SSE)
+  const char* simd = "SSE";
+#else
+  const char* simd = "scalar";
+#endif
+  printf("%d samples of %d channels, bank uses %s\n", samples, kNumChannels, simd);
+  printf("per-IMU Kalman loop   %7.1f ns/sample\n", loop_ns);
+  printf("bank, full update     %7.1f ns/sample (%.1fx)\n", full_ns, loop_ns / full_ns);
+  printf("bank, cached gain     %7.1f ns/sample (%.1fx)\n", cached_ns, loop_ns / cached_ns);
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Checks that MeasurementQueue hands out measurements in time order, then replays synthetic runs
+ * whose keyence readings are published a few ms after the stripes were seen. Late stripes are
+ * fused at the time they were seen, either by the reorder window or by rolling the forward filter
+ * back; both should be as accurate as keyences published on time, and more accurate than
+ * applying the stripes when they arrive. Exits with 1 if any of that does not hold.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "navigation/measurement_queue.hpp"
+#include "navigation/replay.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::SensorCalibration;
+using hyped::data::StripeCounter;
+using hyped::navigation::Measurement;
+using hyped::navigation::MeasurementQueue;
+using hyped::navigation::Navigation;
+using hyped::navigation::replay;
+using hyped::navigation::ReplayResult;
+using hyped::navigation::ReplaySample;
+using hyped::navigation::ReplaySource;
+using hyped::navigation::SyntheticSource;
+using hyped::utils::Logger;
+
+namespace {
+
+constexpr int      kNumMeasurements = 100000;
+constexpr uint32_t kMaxLateness     = 5000;   // us, of the queue test
+constexpr uint32_t kKeyenceDelay    = 3000;   // us
+constexpr int      kNumRuns         = 20;
+
+/**
+ * @brief Restamps the keyence readings of another source with the time they are published at,
+ *        i.e. the stripes are fused when they arrive rather than when they were seen
+ */
+class ArrivalTimeSource : public ReplaySource {
+ public:
+  explicit ArrivalTimeSource(ReplaySource* source) : source_(source) {}
+
+  SensorCalibration getCalibration() override { return source_->getCalibration(); }
+  void startRun() override { source_->startRun(); }
+  bool next(ReplaySample* sample) override
+  {
+    if (!source_->next(sample)) return false;
+    for (StripeCounter& keyence : sample->sensors.keyence_stripe_counter)
+      keyence.count.timestamp = sample->sensors.imu.timestamp;
+    return true;
+  }
+
+ private:
+  ReplaySource* source_;
+};
+
+// Pushes measurements up to kMaxLateness late and pops them once that window has passed
+bool checkQueue()
+{
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint32_t> lateness(0, kMaxLateness);
+  MeasurementQueue<64> queue;
+  Measurement measurement = Measurement();
+  std::vector<uint32_t> pushed, popped;
+  for (int i = 0; i < kNumMeasurements; i++) {
+    uint32_t now = 1000 * i;
+    measurement.timestamp = now + kMaxLateness - lateness(random);
+    measurement.type      = Measurement::kImu;
+    if (!queue.push(measurement)) {
+      printf("FAIL: queue full after %d measurements\n", i);
+      return false;
+    }
+    pushed.push_back(measurement.timestamp);
+    while (queue.pop(now, &measurement)) popped.push_back(measurement.timestamp);
+  }
+  while (queue.pop(UINT32_MAX, &measurement)) popped.push_back(measurement.timestamp);
+
+  std::sort(pushed.begin(), pushed.end());
+  if (popped != pushed) {
+    printf("FAIL: measurements not popped in time order\n");
+    return false;
+  }
+  printf("%d measurements up to %u us late popped in time order\n", kNumMeasurements,
+      kMaxLateness);
+  return true;
+}
+
+struct Errors {
+  double final_rms;     // of the final distance
+  double max_rms;       // of the largest distance error during the run
+  double ns_per_update;
+};
+
+Errors runs(uint32_t keyence_delay, uint32_t reorder_window, bool arrival_time,
+            std::vector<double>* final_errors)
+{
+  Logger log(false, -1);
+  Navigation::Settings settings;
+  settings.reorder_window = reorder_window;
+  SyntheticSource::Profile profile;
+  profile.keyence_delay = keyence_delay;
+
+  Errors errors = {0, 0, 0};
+  for (int seed = 1; seed <= kNumRuns; seed++) {
+    SyntheticSource synthetic(profile, seed);
+    ArrivalTimeSource restamped(&synthetic);
+    ReplaySource* source = arrival_time ? static_cast<ReplaySource*>(&restamped) : &synthetic;
+    ReplayResult r = replay(source, log, settings);
+    errors.final_rms     += r.final_error.distance * r.final_error.distance;
+    errors.max_rms       += r.max_error.distance * r.max_error.distance;
+    errors.ns_per_update += r.nav_seconds * 1e9 / r.num_samples;
+    final_errors->push_back(r.final_error.distance);
+  }
+  errors.final_rms      = std::sqrt(errors.final_rms / kNumRuns);
+  errors.max_rms        = std::sqrt(errors.max_rms / kNumRuns);
+  errors.ns_per_update /= kNumRuns;
+  printf("keyences %4u us late, window %4u us, %-8s final d %.4f m, max d %.4f m, %.0f ns\n",
+      keyence_delay, reorder_window, arrival_time ? "arrival" : "seen", errors.final_rms,
+      errors.max_rms, errors.ns_per_update);
+  return errors;
+}
+
+}  // namespace
+
+int main()
+{
+  if (!checkQueue()) return 1;
+
+  printf("rms over %d runs of the distance errors, stripes fused when seen or when arrived:\n",
+      kNumRuns);
+  std::vector<double> on_time, rollback, window, arrival;
+  Errors e_on_time  = runs(0,             0,                 false, &on_time);
+  Errors e_rollback = runs(kKeyenceDelay, 0,                 false, &rollback);
+  Errors e_window   = runs(kKeyenceDelay, 2 * kKeyenceDelay, false, &window);
+  Errors e_arrival  = runs(kKeyenceDelay, 0,                 true,  &arrival);
+
+  // Without a window nav gets ready at the same sample, so the rollback replays exactly the
+  // updates nav would have made with keyences on time
+  for (int i = 0; i < kNumRuns; i++) {
+    if (std::abs(rollback[i] - on_time[i]) > 1e-4) {
+      printf("FAIL: run %d ends %f m off with rollback, %f m with keyences on time\n", i + 1,
+          rollback[i], on_time[i]);
+      return 1;
+    }
+  }
+  if (e_window.max_rms > 1.2 * e_on_time.max_rms || e_arrival.max_rms < e_rollback.max_rms) {
+    printf("FAIL: late keyences fused in time order are less accurate than expected\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 27/07/2018
+ * Description:
+ * Time-to-ready benchmark of the navigation calibration. Feeds readings of the fake IMUs (as
+ * set up from the data/in files by the IMU manager) into Navigation until it is ready, for a
+ * few calibration tolerances and for the old fixed number of samples. Reports how many samples
+ * that took, what that means at the fake (50 Hz) and real (1 kHz) IMU rates, and how far the
+ * gravity estimates are off. Run from BeagleBone_black/ so that the data files are found.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "navigation/navigation.hpp"
+#include "sensors/fake_imu.hpp"
+#include "utils/concurrent/barrier.hpp"
+#include "utils/logger.hpp"
+#include "utils/math/statistics.hpp"
+
+using hyped::data::ModuleStatus;
+using hyped::data::NavigationVector;
+using hyped::data::SensorCalibration;
+using hyped::data::Sensors;
+using hyped::navigation::Navigation;
+using hyped::sensors::FakeImu;
+using hyped::utils::concurrent::Barrier;
+using hyped::utils::Logger;
+using hyped::utils::math::OnlineStatistics;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr uint32_t kImuPeriod         = 1000;  // us, real IMUs
+constexpr double   kFakeImuRate       = 50;    // Hz, the IMU manager sleeps 20 ms between reads
+constexpr int      kNumManagerSamples = 100;   // samples the IMU manager takes for the variances
+
+struct Case {
+  const char* name;
+  Navigation::Settings settings;
+};
+
+struct Result {
+  int    num_samples;     // IMU samples until ready, not counting the one for init()
+  double max_g_error;     // largest deviation of a gravity estimate from (0, 0, 9.8), m/s^2
+  double wall_ms;
+};
+
+void readImus(std::vector<std::unique_ptr<FakeImu>>& imus, uint32_t timestamp, Sensors* readings)
+{
+  readings->imu.timestamp = timestamp;
+  for (int i = 0; i < Sensors::kNumImus; i++)
+    imus[i]->getData(&readings->imu.value[i]);
+}
+
+Result calibrate(Logger& log, std::vector<std::unique_ptr<FakeImu>>& imus,
+                 const Navigation::Settings& settings)
+{
+  Clock::time_point start = Clock::now();
+  Barrier barrier(1);
+  Navigation nav(barrier, log, settings);
+  Sensors readings;
+  uint32_t timestamp = 0;
+
+  // Variances as the IMU manager would measure them
+  OnlineStatistics<NavigationVector> stats[Sensors::kNumImus][2];
+  for (int s = 0; s < kNumManagerSamples; s++) {
+    readImus(imus, timestamp, &readings);
+    for (int i = 0; i < Sensors::kNumImus; i++) {
+      stats[i][0].update(readings.imu.value[i].acc);
+      stats[i][1].update(readings.imu.value[i].gyr);
+    }
+  }
+  SensorCalibration calibration;
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    calibration.imu_variance[i][0] = stats[i][0].getVariance();
+    calibration.imu_variance[i][1] = stats[i][1].getVariance();
+  }
+
+  readImus(imus, timestamp, &readings);
+  nav.init(calibration, readings);
+  nav.startCalibration();
+  Result result = {0, 0, 0};
+  while (nav.getStatus() != ModuleStatus::kReady) {
+    timestamp += kImuPeriod;
+    readImus(imus, timestamp, &readings);
+    Navigation::Input input;
+    input.imus = &readings.imu;
+    nav.update(input);
+    result.num_samples++;
+  }
+
+  const Navigation::FullOutput& out = nav.getAll();
+  NavigationVector gravity({0, 0, 9.8});
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      double error = std::abs((*out.g)[i][axis] - gravity[axis]);
+      result.max_g_error = std::max(result.max_g_error, error);
+    }
+  }
+  result.wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  return result;
+}
+
+}  // namespace
+
+int main()
+{
+  Logger log(false, -1);
+  std::vector<std::unique_ptr<FakeImu>> imus;
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    imus.emplace_back(new FakeImu(log,
+        "../BeagleBone_black/data/in/fake_imu_input_acc.txt",
+        "../BeagleBone_black/data/in/fake_imu_input_dec.txt",
+        "../BeagleBone_black/data/in/fake_imu_input_em.txt",
+        "../BeagleBone_black/data/in/fake_imu_input_gyr.txt"));
+  }
+
+  std::vector<Case> cases;
+  Navigation::Settings fixed;
+  fixed.calib_min_samples = fixed.calib_max_samples;
+  cases.push_back({"fixed", fixed});
+  for (float tolerance : {0.02f, 0.01f, 0.005f}) {
+    Navigation::Settings settings;
+    settings.calib_acc_tol = tolerance;
+    cases.push_back({"acc_tol", settings});
+  }
+  Navigation::Settings with_gyro;
+  with_gyro.gyro_enable = true;
+  cases.push_back({"+gyro", with_gyro});
+
+  printf("%-8s %9s %9s %12s %12s %12s %9s\n", "case", "acc_tol", "samples", "at 50 Hz (s)",
+      "at 1 kHz (s)", "g error", "wall ms");
+  for (const Case& c : cases) {
+    Result r = calibrate(log, imus, c.settings);
+    printf("%-8s %9g %9d %12.1f %12.1f %12.4f %9.1f\n", c.name, c.settings.calib_acc_tol,
+        r.num_samples, r.num_samples / kFakeImuRate, r.num_samples * kImuPeriod / 1e6,
+        r.max_g_error, r.wall_ms);
+  }
+
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Cost of a single navigation update per measurement type, on a synthetic run. Counts the user
+ * space instructions retired with a hardware counter (perf_event_open) where the kernel offers
+ * one, otherwise falls back to timing. The overhead of the measurement itself is subtracted.
+ * Run it on two builds to compare changes to the navigation maths.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+
+#include "navigation/measurement_queue.hpp"
+#include "navigation/navigation.hpp"
+#include "navigation/replay.hpp"
+#include "utils/concurrent/barrier.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::ModuleStatus;
+using hyped::navigation::Measurement;
+using hyped::navigation::Navigation;
+using hyped::navigation::ReplaySample;
+using hyped::navigation::SyntheticSource;
+using hyped::utils::Logger;
+using hyped::utils::concurrent::Barrier;
+
+namespace {
+
+constexpr int kNumBaselineSamples = 10000;
+
+/**
+ * @brief Instructions retired in user space if there is a hardware counter, nanoseconds otherwise
+ */
+class Counter {
+ public:
+  Counter()
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~Counter() { if (fd_ >= 0) close(fd_); }
+
+  bool countsInstructions() const { return fd_ >= 0; }
+  const char* unit() const { return countsInstructions() ? "instructions" : "ns"; }
+
+  uint64_t read() const
+  {
+    uint64_t value = 0;
+    if (countsInstructions() && ::read(fd_, &value, sizeof(value)) == sizeof(value)) return value;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+ private:
+  int fd_;
+};
+
+// The median rather than the mean, so that the odd preempted update does not count
+struct Cost {
+  std::vector<double> values;
+
+  void add(double value) { values.push_back(value); }
+  int calls() const { return values.size(); }
+  double median(double overhead)
+  {
+    if (values.empty()) return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2] - overhead;
+  }
+};
+
+#ifdef PROXI
+// All proxis about 100 mm from the ground and the rails, the pod slightly off centre
+void fillProximities(uint32_t timestamp, Measurement* measurement)
+{
+  measurement->type      = Measurement::kProximity;
+  measurement->timestamp = timestamp;
+  for (int i = 0; i < hyped::data::Sensors::kNumProximities; i++) {
+    measurement->proxi_front.value[i].operational = true;
+    measurement->proxi_front.value[i].val         = 100 + i % 3;
+    measurement->proxi_back.value[i].operational  = true;
+    measurement->proxi_back.value[i].val          = 101 - i % 3;
+  }
+  measurement->proxi_front.timestamp = measurement->proxi_back.timestamp = timestamp;
+}
+#endif
+
+}  // namespace
+
+int main()
+{
+  Logger log(false, -1);
+  Barrier barrier(1);
+  Counter counter;
+
+  Navigation::Settings settings;
+#ifdef PROXI
+  settings.proxi_displ_enable  = true;
+  settings.proxi_orient_enable = true;
+#endif
+  Navigation nav(barrier, log, settings);
+  SyntheticSource source(SyntheticSource::Profile(), 1);
+  ReplaySample sample = ReplaySample();
+  source.next(&sample);
+  nav.init(source.getCalibration(), sample.sensors);
+  nav.startCalibration();
+
+  // What reading the counter costs by itself
+  Cost baseline;
+  for (int i = 0; i < kNumBaselineSamples; i++) {
+    uint64_t before = counter.read();
+    baseline.add(counter.read() - before);
+  }
+  double overhead = baseline.median(0);
+
+  Cost calibration, imu, keyence, proximity;
+  Measurement measurement = Measurement();
+  bool calibrating = true;
+  while (source.next(&sample)) {
+    measurement.type      = Measurement::kImu;
+    measurement.timestamp = sample.sensors.imu.timestamp;
+    measurement.imus      = sample.sensors.imu;
+    uint64_t before = counter.read();
+    nav.update(measurement);
+    (calibrating ? calibration : imu).add(counter.read() - before);
+
+    if (calibrating) {
+      if (nav.getStatus() == ModuleStatus::kReady) {
+        nav.finishCalibration();
+        source.startRun();
+        calibrating = false;
+      }
+      continue;
+    }
+    if (sample.keyence_updated) {
+      measurement.type    = Measurement::kKeyence;
+      measurement.keyence = sample.sensors.keyence_stripe_counter;
+      before = counter.read();
+      nav.update(measurement);
+      keyence.add(counter.read() - before);
+    }
+#ifdef PROXI
+    fillProximities(measurement.timestamp, &measurement);
+    before = counter.read();
+    nav.update(measurement);
+    proximity.add(counter.read() - before);
+#endif
+  }
+
+  printf("%s per update (median), less %.0f for reading the counter:\n", counter.unit(), overhead);
+  printf("  IMU during calibration %8.0f (%d updates)\n", calibration.median(overhead),
+      calibration.calls());
+  printf("  IMU                    %8.0f (%d updates)\n", imu.median(overhead), imu.calls());
+  printf("  keyence                %8.0f (%d updates)\n", keyence.median(overhead),
+      keyence.calls());
+#ifdef PROXI
+  printf("  proximity              %8.0f (%d updates)\n", proximity.median(overhead),
+      proximity.calls());
+#endif
+  return 0;
+}
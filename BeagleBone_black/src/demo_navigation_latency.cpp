@@ -0,0 +1,174 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Runs navigation::Main on a synthetic run published in real time at 1 kHz, the way the sensors
+ * thread publishes, and drives the state machine through calibration and the run. Then prints the
+ * latency from each IMU sample's timestamp to the publication of the navigation data updated with
+ * it. Exits with 1 if an IMU sample was not used or the 99th percentile is 1 ms or more.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include <thread>
+
+#include "data/data.hpp"
+#include "navigation/main.hpp"
+#include "navigation/replay.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+#include "utils/math/histogram.hpp"
+#include "utils/system.hpp"
+#include "utils/timer.hpp"
+
+using hyped::data::Data;
+using hyped::data::ModuleStatus;
+using hyped::data::State;
+using hyped::data::StateMachine;
+using hyped::data::StripeCounter;
+using hyped::navigation::ReplaySample;
+using hyped::navigation::SyntheticSource;
+using hyped::utils::concurrent::Thread;
+using hyped::utils::Logger;
+using hyped::utils::math::Histogram;
+using hyped::utils::System;
+using hyped::utils::Timer;
+
+namespace {
+
+constexpr uint32_t kLatencyBudget = 1000;   // us, of the 99th percentile
+
+/**
+ * @brief Publishes the samples of a SyntheticSource at the times of their timestamps, shifted to
+ *        the clock of Timer::getTimeMicros()
+ */
+class Publisher : public Thread {
+ public:
+  explicit Publisher(SyntheticSource* source)
+      : source_(source),
+        start_(Timer::getTimeMicros()),
+        num_published_(0),
+        num_before_run_(0),
+        started_run_(false)
+  {}
+
+  void run() override
+  {
+    Data& data = Data::getInstance();
+    ReplaySample sample;
+    while (source_->next(&sample)) {
+      uint64_t at = start_ + sample.sensors.imu.timestamp;
+      uint64_t now = Timer::getTimeMicros();
+      if (at > now) std::this_thread::sleep_for(std::chrono::microseconds(at - now));
+      sample.sensors.imu.timestamp = static_cast<uint32_t>(at);
+      if (num_published_ == 0) {
+        sample.sensors.module_status = ModuleStatus::kInit;
+        data.setSensorsData(sample.sensors);
+      } else {
+        data.setSensorsImuData(sample.sensors.imu);
+        if (sample.keyence_updated) {
+          for (StripeCounter& keyence : sample.sensors.keyence_stripe_counter)
+            keyence.count.timestamp += start_;
+          data.setSensorsKeyenceData(sample.sensors.keyence_stripe_counter);
+        }
+        if (sample.optical_enc_updated)
+          data.setSensorsOpticalEncoderData(sample.sensors.optical_enc_distance);
+      }
+      num_published_++;
+      if (!started_run_) num_before_run_ = num_published_;
+    }
+  }
+
+  void startRun()
+  {
+    source_->startRun();
+    started_run_ = true;
+  }
+
+  int getNumPublished() const { return num_published_; }
+  int getNumBeforeRun() const { return num_before_run_; }
+
+ private:
+  SyntheticSource* source_;
+  uint64_t start_;
+  volatile int num_published_;
+  volatile int num_before_run_;
+  volatile bool started_run_;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  System::parseArgs(argc, argv);
+  System& sys = System::getSystem();
+  Logger log_nav(sys.verbose_nav, sys.debug_nav);
+
+  // Low noise so that calibration is over after its minimum number of samples, and a short run
+  SyntheticSource::Profile profile;
+  profile.acc_noise         = 0.05;
+  profile.acceleration_time = 2.0;
+  SyntheticSource source(profile, 1);
+  Data& data = Data::getInstance();
+  data.setCalibrationData(source.getCalibration());
+
+  hyped::navigation::Main navigation(3, log_nav);
+  Publisher publisher(&source);
+  navigation.start();
+  publisher.start();
+
+  // Idle until nav is initialised, calibrate until it is ready, then start the run
+  StateMachine sm = data.getStateMachineData();
+  while (sm.current_state != State::kAccelerating) {
+    Thread::sleep(1);
+    ModuleStatus status = data.getNavigationData().module_status;
+    if (sm.current_state == State::kIdle && status == ModuleStatus::kInit) {
+      sm.current_state = State::kCalibrating;
+      data.setStateMachineData(sm);
+    } else if (sm.current_state == State::kCalibrating && status == ModuleStatus::kReady) {
+      sm.current_state = State::kAccelerating;
+      publisher.startRun();
+      data.setStateMachineData(sm);
+      sys.navigation_motors_sync_.wait();
+    }
+  }
+  publisher.join();
+  // let nav catch up with the last samples before stopping it
+  Thread::sleep(100);
+  sys.running_ = false;
+  navigation.join();
+
+  const Histogram& latency = navigation.getLatencyHistogram();
+  int num_expected = publisher.getNumPublished() - publisher.getNumBeforeRun();
+  int num_updates  = static_cast<int>(latency.getCount());
+  printf("%d IMU samples published, %d of them during the run, %d navigation updates\n",
+      publisher.getNumPublished(), num_expected, num_updates);
+  printf("latency p50 %u us, p90 %u us, p99 %u us, p99.9 %u us, max %u us\n",
+      latency.getPercentile(0.5), latency.getPercentile(0.9), latency.getPercentile(0.99),
+      latency.getPercentile(0.999), latency.getMax());
+
+  // every sample of the run, and the ones of calibration, which is before it
+  bool ok = num_updates >= num_expected;
+  ok &= latency.getPercentile(0.99) < kLatencyBudget;
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Replays synthetic runs through Navigation with the optical encoders fused and without them:
+ * the default profile, noisier IMUs, no stripes, encoder wheels of the wrong size, and an encoder
+ * that stops counting halfway. Prints the errors against ground truth and the cost per update.
+ * Exits with 1 if fusing the encoders makes any case worse than the tolerance, or does not make
+ * the default profile better. Run from BeagleBone_black/ so that NavSettings.txt is found.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "data/data.hpp"
+#include "navigation/replay.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::ModuleStatus;
+using hyped::navigation::Navigation;
+using hyped::navigation::replay;
+using hyped::navigation::ReplayResult;
+using hyped::navigation::SyntheticSource;
+using hyped::navigation::TrackMap;
+using hyped::utils::Logger;
+
+namespace {
+
+constexpr int kNumRuns = 20;
+// Largest errors with the encoders as a multiple of those without
+constexpr double kTolerance   = 1.1;    // in any case
+constexpr double kImprovement = 0.9;    // of the distance in the default profile
+
+struct Errors {
+  double distance;        // rms over the runs of the largest distance error of a run, m
+  double velocity;        // same for the velocity, m/s
+  double ns_per_update;
+  int num_failed;         // runs that did not end in the ready state
+};
+
+Errors run(const SyntheticSource::Profile& profile, const Navigation::Settings& settings)
+{
+  Logger logger(false, -1);
+  Errors errors = {0, 0, 0, 0};
+  double nav_seconds = 0, num_samples = 0;
+  for (int seed = 1; seed <= kNumRuns; seed++) {
+    SyntheticSource source(profile, seed);
+    ReplayResult r = replay(&source, logger, settings, profile.track);
+    errors.distance += r.max_error.distance * r.max_error.distance;
+    errors.velocity += r.max_error.velocity * r.max_error.velocity;
+    nav_seconds     += r.nav_seconds;
+    num_samples     += r.num_samples;
+    if (r.status != ModuleStatus::kReady) errors.num_failed++;
+  }
+  errors.distance      = std::sqrt(errors.distance / kNumRuns);
+  errors.velocity      = std::sqrt(errors.velocity / kNumRuns);
+  errors.ns_per_update = nav_seconds * 1e9 / num_samples;
+  return errors;
+}
+
+/**
+ * @brief Replays the profile with and without the encoders and prints both
+ *
+ * @return whether the encoders are within the tolerance, and below `improvement` of the distance
+ *         error without them if that is given
+ */
+bool compare(const char* name, const SyntheticSource::Profile& profile,
+             Navigation::Settings settings, double improvement = 0)
+{
+  settings.opt_enc_enable = false;
+  Errors without = run(profile, settings);
+  settings.opt_enc_enable = true;
+  Errors with = run(profile, settings);
+  printf("%-12s without d %.3f m, v %.3f m/s, %3.0f ns | with d %.3f m, v %.3f m/s, %3.0f ns\n",
+      name, without.distance, without.velocity, without.ns_per_update, with.distance,
+      with.velocity, with.ns_per_update);
+
+  bool ok = with.num_failed <= without.num_failed;
+  ok &= with.distance <= kTolerance * without.distance;
+  ok &= with.velocity <= kTolerance * without.velocity;
+  if (improvement > 0) ok &= with.distance <= improvement * without.distance;
+  if (!ok) printf("FAIL: %s\n", name);
+  return ok;
+}
+
+}  // namespace
+
+int main()
+{
+  Navigation::Settings settings = Navigation::readSettings(Navigation::kDefaultSettingsFile);
+  SyntheticSource::Profile profile;
+  printf("largest errors of a run, rms over %d runs, and cost per update:\n", kNumRuns);
+  bool ok = compare("default", profile, settings, kImprovement);
+
+  SyntheticSource::Profile noisy = profile;
+  noisy.acc_noise = 1.0;
+  ok &= compare("noisy IMUs", noisy, settings);
+
+  SyntheticSource::Profile no_stripes = profile;
+  no_stripes.track = TrackMap(std::vector<hyped::data::NavigationType>());
+  ok &= compare("no stripes", no_stripes, settings);
+
+  SyntheticSource::Profile wrong_wheel = profile;
+  wrong_wheel.opt_enc_scale = 0.95;
+  ok &= compare("wrong wheels", wrong_wheel, settings);
+
+  SyntheticSource::Profile failing = profile;
+  failing.opt_enc_fail_at = 100;
+  ok &= compare("encoder fail", failing, settings);
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
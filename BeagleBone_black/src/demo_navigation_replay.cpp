@@ -0,0 +1,113 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 26/07/2018
+ * Description:
+ * Replays sensor data through Navigation faster than real time and reports the throughput and
+ * the error against ground truth. Run from BeagleBone_black/ so that NavSettings.txt is found.
+ *
+ *   ./demo_navigation_replay              one synthetic run
+ *   ./demo_navigation_replay <runs>       <runs> synthetic runs with different noise
+ *   ./demo_navigation_replay <file.rec>   a flight recording, compared to the nav that flew
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "navigation/replay.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::ModuleStatus;
+using hyped::navigation::GroundTruth;
+using hyped::navigation::Navigation;
+using hyped::navigation::RecordingSource;
+using hyped::navigation::replay;
+using hyped::navigation::ReplayResult;
+using hyped::navigation::SyntheticSource;
+using hyped::utils::Logger;
+
+namespace {
+
+void printResult(const ReplayResult& r)
+{
+  printf("%u samples (%u after calibration) in %.3f s: %.0f samples/s, %.0f ns per update\n",
+      r.num_samples, r.num_run_samples, r.seconds, r.num_samples / r.seconds,
+      r.nav_seconds * 1e9 / r.num_samples);
+  printf("status %d, final d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n", static_cast<int>(r.status),
+      r.estimate.distance, r.estimate.velocity, r.estimate.acceleration);
+  if (!r.has_truth) return;
+  printf("truth       d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n",
+      r.truth.distance, r.truth.velocity, r.truth.acceleration);
+  printf("final error d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n",
+      r.final_error.distance, r.final_error.velocity, r.final_error.acceleration);
+  printf("max error   d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n",
+      r.max_error.distance, r.max_error.velocity, r.max_error.acceleration);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  Logger logger(false, -1);   // Navigation logs every 5000 calibration samples otherwise
+  Navigation::Settings settings = Navigation::readSettings(Navigation::kDefaultSettingsFile);
+
+  char* end = nullptr;
+  int runs = argc > 1 ? strtol(argv[1], &end, 10) : 1;
+  if (argc > 1 && *end != '\0') {
+    RecordingSource source(argv[1]);
+    if (!source.isOpen()) {
+      fprintf(stderr, "%s: %s\n", argv[1], source.getError());
+      return 1;
+    }
+    printResult(replay(&source, logger, settings));
+    return 0;
+  }
+
+  SyntheticSource::Profile profile;
+  uint64_t num_samples = 0;
+  double seconds = 0;
+  int num_failed = 0;
+  GroundTruth worst = {0, 0, 0};    // largest final errors over all runs
+  GroundTruth sum_sq = {0, 0, 0};
+  for (int seed = 1; seed <= runs; seed++) {
+    SyntheticSource source(profile, seed);
+    ReplayResult r = replay(&source, logger, settings);
+    if (runs == 1) printResult(r);
+    num_samples += r.num_samples;
+    seconds     += r.seconds;
+    if (r.status != ModuleStatus::kReady) num_failed++;
+    worst.distance     = std::max(worst.distance,     std::abs(r.final_error.distance));
+    worst.velocity     = std::max(worst.velocity,     std::abs(r.final_error.velocity));
+    worst.acceleration = std::max(worst.acceleration, std::abs(r.final_error.acceleration));
+    sum_sq.distance     += r.final_error.distance * r.final_error.distance;
+    sum_sq.velocity     += r.final_error.velocity * r.final_error.velocity;
+    sum_sq.acceleration += r.final_error.acceleration * r.final_error.acceleration;
+  }
+  if (runs > 1) {
+    printf("%d runs, %u samples in %.3f s: %.0f samples/s\n", runs,
+        static_cast<uint32_t>(num_samples), seconds, num_samples / seconds);
+    printf("final error rms d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n",
+        std::sqrt(sum_sq.distance / runs), std::sqrt(sum_sq.velocity / runs),
+        std::sqrt(sum_sq.acceleration / runs));
+    printf("final error max d=%.3f m, v=%.3f m/s, a=%.3f m/s^2\n",
+        worst.distance, worst.velocity, worst.acceleration);
+    printf("%d runs did not end in the ready state\n", num_failed);
+  }
+  return num_failed ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 26/07/2018
+ * Description:
+ * Monte Carlo sweep of the Navigation fusion weights. Every combination of the swept weights is
+ * replayed over the same set of noisy synthetic runs (common random numbers, so the settings are
+ * compared on identical data). The runs are spread over a pool of worker threads, each replaying
+ * into its own Navigation. Settings are ranked by the RMS of the final distance plus velocity
+ * error. Run from BeagleBone_black/ so that NavSettings.txt is found.
+ *
+ *   ./demo_navigation_sweep [runs per setting [threads]]
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "navigation/replay.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::ModuleStatus;
+using hyped::navigation::Navigation;
+using hyped::navigation::replay;
+using hyped::navigation::ReplayResult;
+using hyped::navigation::SyntheticSource;
+using hyped::utils::concurrent::Thread;
+using hyped::utils::Logger;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief A swept weight of Navigation::Settings and the values it takes
+ */
+struct Parameter {
+  const char* name;
+  float Navigation::Settings::* weight;
+  std::vector<float> values;
+};
+
+struct Score {
+  int setting;              // index into the grid
+  double rms_distance;      // of the final errors
+  double rms_velocity;
+  double max_distance;
+  double max_velocity;
+  int num_failed;           // runs that did not end with nav ready
+};
+
+/**
+ * @brief All combinations of the parameter values, applied on top of `base`
+ */
+std::vector<Navigation::Settings> makeGrid(const Navigation::Settings& base,
+                                           const std::vector<Parameter>& parameters)
+{
+  std::vector<Navigation::Settings> grid(1, base);
+  for (const Parameter& p : parameters) {
+    std::vector<Navigation::Settings> next;
+    for (const Navigation::Settings& settings : grid) {
+      for (float value : p.values) {
+        next.push_back(settings);
+        next.back().*p.weight = value;
+      }
+    }
+    grid.swap(next);
+  }
+  return grid;
+}
+
+/**
+ * @brief Noisy run number `seed`: varied trajectory, noisy IMUs and stripe detection
+ */
+SyntheticSource::Profile makeProfile(uint32_t seed)
+{
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  SyntheticSource::Profile profile;
+  profile.acceleration      = 8.0  + 4.0  * uniform(random);
+  profile.acceleration_time = 5.0  + 2.0  * uniform(random);
+  profile.deceleration      = 15.0 + 10.0 * uniform(random);
+  profile.acc_noise         = 0.2  + 0.2  * uniform(random);
+  profile.keyence_noise     = 0.1;
+  return profile;
+}
+
+/**
+ * @brief Pool worker: takes the next (setting, run) job until there are none left. Every job
+ *        replays into a fresh Navigation owned by this thread.
+ */
+class Worker : public Thread {
+ public:
+  Worker(uint8_t id, Logger& log, const std::vector<Navigation::Settings>& grid, int runs,
+         std::atomic<int>* next_job, std::vector<ReplayResult>* results)
+      : Thread(id, log),
+        grid_(grid),
+        runs_(runs),
+        next_job_(next_job),
+        results_(results)
+  {}
+
+  void run() override
+  {
+    int num_jobs = grid_.size() * runs_;
+    for (int job; (job = next_job_->fetch_add(1)) < num_jobs; ) {
+      SyntheticSource source(makeProfile(job % runs_ + 1), job % runs_ + 1);
+      (*results_)[job] = replay(&source, log_, grid_[job / runs_]);
+    }
+  }
+
+ private:
+  const std::vector<Navigation::Settings>& grid_;
+  int runs_;
+  std::atomic<int>* next_job_;
+  std::vector<ReplayResult>* results_;   // one slot per job, written by one worker only
+};
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  int runs        = argc > 1 ? atoi(argv[1]) : 10;
+  int num_threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  if (runs < 1) runs = 1;
+  if (num_threads < 1) num_threads = 1;
+
+  // TODO(anyone): add the proxi weights once the synthetic runs simulate proximity sensors
+  std::vector<Parameter> parameters = {
+    {"jerk_var",       &Navigation::Settings::jerk_var,       {1, 10, 100, 1000}},
+    {"strp_displ_var", &Navigation::Settings::strp_displ_var, {0.001, 0.01, 0.1}},
+  };
+  std::vector<Navigation::Settings> grid =
+      makeGrid(Navigation::readSettings(Navigation::kDefaultSettingsFile), parameters);
+
+  Logger quiet(false, -1);   // Navigation logs every 5000 calibration samples otherwise
+  std::vector<ReplayResult> results(grid.size() * runs);
+  std::atomic<int> next_job(0);
+  std::vector<Worker*> workers;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < num_threads; i++) {
+    workers.push_back(new Worker(i, quiet, grid, runs, &next_job, &results));
+    workers.back()->start();
+  }
+  uint64_t num_samples = 0;
+  for (Worker* worker : workers) {
+    worker->join();
+    delete worker;
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<Score> scores;
+  for (std::size_t s = 0; s < grid.size(); s++) {
+    Score score = {static_cast<int>(s), 0, 0, 0, 0, 0};
+    for (int r = 0; r < runs; r++) {
+      const ReplayResult& result = results[s * runs + r];
+      num_samples += result.num_samples;
+      double d = result.final_error.distance, v = result.final_error.velocity;
+      score.rms_distance += d * d;
+      score.rms_velocity += v * v;
+      score.max_distance  = std::max(score.max_distance, std::abs(d));
+      score.max_velocity  = std::max(score.max_velocity, std::abs(v));
+      if (result.status != ModuleStatus::kReady) score.num_failed++;
+    }
+    score.rms_distance = std::sqrt(score.rms_distance / runs);
+    score.rms_velocity = std::sqrt(score.rms_velocity / runs);
+    scores.push_back(score);
+  }
+  std::sort(scores.begin(), scores.end(), [](const Score& a, const Score& b) {  // NOLINT
+    if (a.num_failed != b.num_failed) return a.num_failed < b.num_failed;
+    return a.rms_distance + a.rms_velocity < b.rms_distance + b.rms_velocity;
+  });
+
+  printf("%u settings x %d runs on %d threads: %.2f s, %.0f runs/s, %.0f samples/s\n",
+      static_cast<uint32_t>(grid.size()), runs, num_threads, seconds,
+      grid.size() * runs / seconds, num_samples / seconds);
+  printf("rank");
+  for (const Parameter& p : parameters) printf(" %12s", p.name);
+  printf("   rms d (m) rms v (m/s)   max d (m) max v (m/s) failed\n");
+  for (std::size_t i = 0; i < scores.size(); i++) {
+    const Score& score = scores[i];
+    printf("%4u", static_cast<uint32_t>(i + 1));
+    for (const Parameter& p : parameters) printf(" %12g", grid[score.setting].*p.weight);
+    printf(" %11.3f %11.3f %11.3f %11.3f %6d\n", score.rms_distance, score.rms_velocity,
+        score.max_distance, score.max_velocity, score.num_failed);
+  }
+  return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Compares the closed-form ground plane fit and tube orientation of navigation (in
+ * NavigationType) with the Eigen JacobiSVD path they replace (in double) on random proxi
+ * geometries, and times both. Exits with 1 if they disagree by more than the tolerances.
+ * The old path fitted the plane through the IMU origin rather than through the centroid of the
+ * points; the reference here centres the points, the old bias is printed for comparison.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <array>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Eigen/Dense"
+#include "Eigen/SVD"
+#include "navigation/navigation.hpp"
+#include "utils/math/plane_fit.hpp"
+
+using hyped::data::NavigationType;
+using hyped::data::NavigationVector;
+using hyped::navigation::tubeOrientation;
+using hyped::utils::math::fitPlaneNormal;
+using hyped::utils::math::Quaternion;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef std::array<NavigationVector, 4> GroundPoints;
+
+constexpr int            kNumSamples       = 100000;
+constexpr NavigationType kMaxTilt          = 0.035;   // rad, ~2 degrees
+constexpr NavigationType kProxiNoise       = 0.001;   // m
+constexpr NavigationType kWeight           = 0.1;     // of the SLERP
+constexpr double         kNormalTolerance  = 1e-4;    // rad
+constexpr double         kOrientTolerance  = 1e-4;    // of each quaternion element
+
+// Prevents the compiler from optimising the fits away
+volatile double sink;
+
+struct Sample {
+  GroundPoints ground;
+  NavigationVector rail;
+  Quaternion<NavigationType> prior;
+};
+
+Eigen::Vector3d toEigen(const NavigationVector& v)
+{
+  return Eigen::Vector3d(v[0], v[1], v[2]);
+}
+
+// The SVD normal of the removed navigation code, optionally through the centroid
+Eigen::Vector3d eigenNormal(const GroundPoints& ground, bool centred)
+{
+  Eigen::Matrix<double, 3, 4> m;
+  for (int i = 0; i < 4; i++) m.col(i) = toEigen(ground[i]);
+  if (centred) m.colwise() -= m.rowwise().mean();
+  Eigen::JacobiSVD<Eigen::Matrix<double, 3, 4>> svd(m, Eigen::ComputeFullU);
+  Eigen::Vector3d n = svd.matrixU().col(svd.matrixU().cols() - 1);
+  if (n(2) < 0.0)
+    n = -n;
+  return n;
+}
+
+// The orientation update of the removed navigation code, with the plane through the centroid
+Eigen::Quaterniond eigenOrientation(const Sample& s)
+{
+  Eigen::Vector3d n = eigenNormal(s.ground, true);
+  Eigen::Vector3d r = toEigen(s.rail);
+  Eigen::Vector3d x = r - r.dot(n)/n.dot(n)*n;
+  x /= x.norm();
+  Eigen::Vector3d y = n.cross(x);
+  y /= y.norm();
+  Eigen::Vector3d z = n/n.norm();
+  Eigen::Matrix3d rot;
+  rot << x, y, z;
+  Eigen::Quaternion<double> q(rot);
+  q = q.conjugate();
+  Eigen::Quaternion<double> prior(s.prior[0], s.prior[1], s.prior[2], s.prior[3]);
+  return q.slerp(kWeight, prior);
+}
+
+Quaternion<NavigationType> closedFormOrientation(const Sample& s)
+{
+  return slerp(tubeOrientation(s.ground, s.rail), s.prior, kWeight);
+}
+
+// Between the lines along a and b, accurate for small angles unlike acos
+double angle(const Eigen::Vector3d& a, const NavigationVector& b)
+{
+  return std::atan2(a.cross(toEigen(b)).norm(), std::abs(a.dot(toEigen(b))));
+}
+
+// Ground proxi points on a random plane tilted by up to kMaxTilt, seen by noisy proxis
+std::vector<Sample> makeSamples()
+{
+  std::mt19937 random(1);
+  std::uniform_real_distribution<NavigationType> tilt(-kMaxTilt, kMaxTilt);
+  std::uniform_real_distribution<NavigationType> height(-0.2, -0.1);
+  std::normal_distribution<NavigationType> noise(0, kProxiNoise);
+  const GroundPoints kProxis = {{hyped::navigation::kGroundProxiRR,
+      hyped::navigation::kGroundProxiFR, hyped::navigation::kGroundProxiFL,
+      hyped::navigation::kGroundProxiRL}};
+
+  std::vector<Sample> samples(kNumSamples);
+  for (Sample& s : samples) {
+    NavigationType slope_x = std::tan(tilt(random)), slope_y = std::tan(tilt(random));
+    NavigationType z0 = height(random);
+    for (int i = 0; i < 4; i++) {
+      s.ground[i]    = kProxis[i];
+      s.ground[i][2] = z0 + slope_x*kProxis[i][0] + slope_y*kProxis[i][1] + noise(random);
+    }
+    s.rail = NavigationVector({3, tilt(random), tilt(random)});
+    // a small random rotation as the orientation so far
+    NavigationVector axis({tilt(random), tilt(random), tilt(random)});
+    s.prior = Quaternion<NavigationType>(std::sqrt(1 - dot(axis, axis)), axis);
+  }
+  return samples;
+}
+
+template <typename F>
+double nanosPerCall(const std::vector<Sample>& samples, F f)
+{
+  Clock::time_point start = Clock::now();
+  for (const Sample& s : samples) sink = f(s);
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / samples.size();
+}
+
+}  // namespace
+
+int main()
+{
+  std::vector<Sample> samples = makeSamples();
+
+  // Equivalence
+  double max_normal_error = 0, max_origin_bias = 0, max_orient_error = 0;
+  for (const Sample& s : samples) {
+    NavigationVector n = fitPlaneNormal(s.ground);
+    max_normal_error = std::max(max_normal_error, angle(eigenNormal(s.ground, true), n));
+    max_origin_bias  = std::max(max_origin_bias,  angle(eigenNormal(s.ground, false), n));
+
+    Eigen::Quaterniond expected = eigenOrientation(s);
+    Quaternion<NavigationType> q = closedFormOrientation(s);
+    // q and -q are the same rotation
+    double sign = expected.w()*q[0] + expected.vec().dot(Eigen::Vector3d(q[1], q[2], q[3])) < 0
+                  ? -1 : 1;
+    double error = std::max(std::max(std::abs(expected.w() - sign*q[0]),
+                                     std::abs(expected.x() - sign*q[1])),
+                            std::max(std::abs(expected.y() - sign*q[2]),
+                                     std::abs(expected.z() - sign*q[3])));
+    max_orient_error = std::max(max_orient_error, error);
+  }
+  printf("largest normal difference to the centred SVD %.2e rad (plane through origin: %.2e)\n",
+      max_normal_error, max_origin_bias);
+  printf("largest orientation difference %.2e\n", max_orient_error);
+
+  // Cost per call
+  double eigen_fit_ns = nanosPerCall(samples, [](const Sample& s) {  // NOLINT
+    return eigenNormal(s.ground, true)(2);
+  });
+  double fit_ns = nanosPerCall(samples, [](const Sample& s) {  // NOLINT
+    return fitPlaneNormal(s.ground)[2];
+  });
+  double eigen_orient_ns = nanosPerCall(samples, [](const Sample& s) {  // NOLINT
+    return eigenOrientation(s).w();
+  });
+  double orient_ns = nanosPerCall(samples, [](const Sample& s) {  // NOLINT
+    return closedFormOrientation(s)[0];
+  });
+  printf("plane fit:   JacobiSVD %.0f ns, closed form %.0f ns per call\n", eigen_fit_ns, fit_ns);
+  printf("orientation: Eigen %.0f ns, closed form %.0f ns per call\n", eigen_orient_ns,
+      orient_ns);
+
+  if (max_normal_error > kNormalTolerance || max_orient_error > kOrientTolerance) {
+    printf("FAIL: closed form differs from Eigen by more than %.0e\n", kOrientTolerance);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
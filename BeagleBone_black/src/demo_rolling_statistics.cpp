@@ -0,0 +1,250 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Checks the ring buffer RollingStatistics against the std::list-backed version it replaced, and
+ * RollingMedian, P2Quantile and ExponentialStatistics against exact computations on noisy
+ * readings with outliers. Then compares the cost of an update and counts heap allocations.
+ * Exits with 1 if any result is off.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <new>
+#include <queue>
+#include <vector>
+
+#include "utils/math/statistics.hpp"
+
+using hyped::utils::math::ExponentialStatistics;
+using hyped::utils::math::OnlineStatistics;
+using hyped::utils::math::P2Quantile;
+using hyped::utils::math::RollingMedian;
+using hyped::utils::math::RollingStatistics;
+using hyped::utils::math::Statistics;
+
+// Counts heap allocations of the whole program
+static int num_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+  num_allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr int    kNumValues      = 1000000;
+constexpr int    kShortWindow    = 16;
+constexpr int    kLongWindow     = 1000;
+constexpr int    kMedianWindow   = 15;
+constexpr double kMeanTolerance  = 1e-3;   // of means and variances
+constexpr double kP2Tolerance    = 0.02;   // of the quantile, as a fraction of the std dev
+constexpr double kEwmaAlpha      = 0.01;
+
+// Prevents the compiler from optimising the updates away
+volatile float sink;
+
+/**
+ * @brief The implementation RollingStatistics had before, for comparison
+ */
+template <typename T>
+class ListRollingStatistics : public Statistics<T> {
+ public:
+  explicit ListRollingStatistics(std::size_t window_size) : window_size_(window_size) {}
+
+  void update(T new_value) override
+  {
+    if (window_.size() < window_size_) {
+      window_.push(new_value);
+      online_.update(new_value);
+      this->sum_      = online_.getSum();
+      this->mean_     = online_.getMean();
+      this->variance_ = online_.getVariance();
+    } else {
+      this->sum_ = this->sum_ + new_value - window_.front();
+      T new_mean = this->sum_ / window_size_;
+      this->variance_ += (new_value - window_.front())
+                          * (new_value - new_mean + window_.front() - this->mean_)
+                          / (window_size_ - 1);
+      this->mean_ = new_mean;
+      window_.pop();
+      window_.push(new_value);
+    }
+  }
+
+ private:
+  const std::size_t window_size_;
+  std::queue<T, std::list<T>> window_;
+  OnlineStatistics<T> online_;
+};
+
+// Gaussian noise around 5 with 1% outliers 20 away
+std::vector<float> makeValues()
+{
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(5, 2);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  std::vector<float> values(kNumValues);
+  for (float& v : values) v = noise(random) + (uniform(random) < 0.01 ? 20 : 0);
+  return values;
+}
+
+template <int N>
+bool checkRolling(const std::vector<float>& values)
+{
+  RollingStatistics<float, N> ring;
+  ListRollingStatistics<float> list(N);
+  double max_error = 0;
+  for (float v : values) {
+    ring.update(v);
+    list.update(v);
+    max_error = std::max(max_error, static_cast<double>(std::abs(ring.getMean() - list.getMean())));
+    max_error = std::max(max_error,
+                         static_cast<double>(std::abs(ring.getVariance() - list.getVariance())));
+  }
+  printf("rolling statistics, window %4d: largest difference to the list version %.1e\n", N,
+      max_error);
+  return max_error <= kMeanTolerance;
+}
+
+bool checkMedian(const std::vector<float>& values)
+{
+  RollingMedian<float, kMedianWindow> median;
+  std::vector<float> window;
+  for (std::size_t i = 0; i < values.size(); i++) {
+    median.update(values[i]);
+    std::size_t first = i + 1 > kMedianWindow ? i + 1 - kMedianWindow : 0;
+    window.assign(values.begin() + first, values.begin() + i + 1);
+    std::sort(window.begin(), window.end());
+    std::size_t n = window.size();
+    float expected = n % 2 ? window[n / 2] : (window[n / 2 - 1] + window[n / 2]) / 2;
+    if (median.getMedian() != expected) {
+      printf("FAIL: rolling median %f at %zu, expected %f\n", median.getMedian(), i, expected);
+      return false;
+    }
+  }
+  printf("rolling median, window %d: exact\n", kMedianWindow);
+  return true;
+}
+
+bool checkQuantiles(const std::vector<float>& values)
+{
+  const double kQuantiles[] = {0.5, 0.9, 0.95};
+  std::vector<float> sorted(values);
+  std::sort(sorted.begin(), sorted.end());
+  bool ok = true;
+  for (double q : kQuantiles) {
+    P2Quantile<float> p2(q);
+    for (float v : values) p2.update(v);
+    float expected = sorted[static_cast<std::size_t>(std::ceil(q * sorted.size())) - 1];
+    double error = std::abs(p2.getQuantile() - expected) / 2;   // in std devs of the noise
+    printf("P2 quantile %.2f: %.3f, exact %.3f (%.4f std dev)\n", q, p2.getQuantile(), expected,
+        error);
+    ok &= error <= kP2Tolerance;
+  }
+  return ok;
+}
+
+// Against the weighted sums written out, over a short prefix
+bool checkExponential(const std::vector<float>& values)
+{
+  const int kNum = 2000;
+  ExponentialStatistics<double> ewma(kEwmaAlpha);
+  double mean = values[0], variance = 0;
+  for (int i = 0; i < kNum; i++) {
+    ewma.update(values[i]);
+    if (i == 0) continue;
+    double delta = values[i] - mean;
+    mean     += kEwmaAlpha * delta;
+    variance  = (1 - kEwmaAlpha) * (variance + kEwmaAlpha * delta * delta);
+  }
+  // Weighted sums: weight of value i is alpha (1 - alpha)^(n - 1 - i), the first value takes
+  // the remaining weight
+  double direct_mean = 0, weight_left = 1;
+  for (int i = kNum - 1; i > 0; i--) {
+    direct_mean += weight_left * kEwmaAlpha * values[i];
+    weight_left *= 1 - kEwmaAlpha;
+  }
+  direct_mean += weight_left * values[0];
+  double error = std::max(std::abs(ewma.getMean() - direct_mean),
+                          std::abs(ewma.getVariance() - variance));
+  printf("exponential statistics: mean %.3f (weighted sum %.3f), std dev %.3f\n", ewma.getMean(),
+      direct_mean, ewma.getStdDev());
+  return error <= kMeanTolerance;
+}
+
+template <typename S>
+void time(const char* name, const std::vector<float>& values, S* statistics)
+{
+  int allocations = num_allocations;
+  Clock::time_point start = Clock::now();
+  for (float v : values) statistics->update(v);
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  printf("  %-28s %6.1f ns, %7d allocations\n", name, ns / values.size(),
+      num_allocations - allocations);
+}
+
+}  // namespace
+
+int main()
+{
+  std::vector<float> values = makeValues();
+  bool ok = checkRolling<kShortWindow>(values) && checkRolling<kLongWindow>(values);
+  ok = ok && checkMedian(std::vector<float>(values.begin(), values.begin() + 100000));
+  ok = ok && checkQuantiles(values);
+  ok = ok && checkExponential(values);
+
+  printf("per update over %d values:\n", kNumValues);
+  ListRollingStatistics<float> list_short(kShortWindow), list_long(kLongWindow);
+  RollingStatistics<float, kShortWindow> ring_short;
+  RollingStatistics<float, kLongWindow> ring_long;
+  RollingMedian<float, kMedianWindow> median;
+  P2Quantile<float> p2(0.5);
+  ExponentialStatistics<float> ewma(kEwmaAlpha);
+  time("list rolling, window 16", values, &list_short);
+  time("ring rolling, window 16", values, &ring_short);
+  time("list rolling, window 1000", values, &list_long);
+  time("ring rolling, window 1000", values, &ring_long);
+  time("rolling median, window 15", values, &median);
+  time("P2 median", values, &p2);
+  time("exponential", values, &ewma);
+  sink = ring_short.getMean() + ring_long.getMean() + median.getMedian() + p2.getQuantile() +
+         ewma.getMean() + list_short.getMean() + list_long.getMean();
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
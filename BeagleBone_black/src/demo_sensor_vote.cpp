@@ -0,0 +1,186 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Fuses four simulated IMUs with SensorVote and with the plain average navigation used before:
+ * all healthy, one drifting away while still operational, one with spikes, and one dropping out.
+ * Then times a vote and the average of healthy IMUs, the fastest of a few runs each. Exits with 1
+ * if the vote is off by more than the tolerances.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "data/data.hpp"
+#include "utils/math/sensor_vote.hpp"
+
+using hyped::data::NavigationVector;
+using hyped::data::Sensors;
+using hyped::utils::math::SensorVote;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+typedef SensorVote<Sensors::kNumImus> ImuVote;
+
+constexpr int   kNumImus    = Sensors::kNumImus;
+constexpr int   kNumSamples = 10000;   // 10 s at 1 kHz
+constexpr int   kNumTimed   = 1000000;
+constexpr int   kNumTimedReadings = 4096;   // a power of 2, so that cycling through is cheap
+constexpr int   kNumRuns    = 5;       // of the timing, the fastest counts
+constexpr float kNoise      = 0.3;     // std dev of an accelerometer, m/s^2
+constexpr float kDriftRate  = 0.5;     // m/s^2 per s, of the drifting IMU
+constexpr float kSpike      = 20;      // m/s^2
+// Root mean square error of the vote, as a multiple of that of the average of healthy IMUs
+constexpr double kHealthyTolerance = 1.1;
+constexpr double kFaultTolerance   = 1.5;
+
+// Prevents the compiler from optimising the votes away
+volatile float sink;
+
+struct Reading {
+  alignas(16) float values[3*kNumImus];   // values[axis*kNumImus + i], aligned as navigation's
+  bool operational[kNumImus];
+};
+
+// What navigation did before: the mean of the operational IMUs
+void average(const Reading& r, float result[3])
+{
+  int num_operational = 0;
+  NavigationVector sum(0);
+  for (int i = 0; i < kNumImus; i++) {
+    if (r.operational[i]) {
+      ++num_operational;
+      sum += NavigationVector({r.values[i], r.values[kNumImus + i], r.values[2*kNumImus + i]});
+    }
+  }
+  sum /= num_operational;
+  for (int axis = 0; axis < 3; axis++) result[axis] = sum[axis];
+}
+
+// Zero acceleration seen by kNumImus noisy IMUs, IMU 2 with the fault
+enum Fault { kNone, kDrift, kSpikes, kDropout };
+
+std::vector<Reading> makeReadings(Fault fault, int num_samples)
+{
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0, kNoise);
+  std::vector<Reading> readings(num_samples);
+  for (int n = 0; n < num_samples; n++) {
+    Reading& r = readings[n];
+    for (int i = 0; i < kNumImus; i++) {
+      r.operational[i] = true;
+      for (int axis = 0; axis < 3; axis++) r.values[axis*kNumImus + i] = noise(random);
+    }
+    float* faulty = r.values + 2;
+    switch (fault) {
+      case kDrift:
+        for (int axis = 0; axis < 3; axis++) faulty[axis*kNumImus] += kDriftRate * n / 1000;
+        break;
+      case kSpikes:
+        if (n % 10 == 0) faulty[0] += kSpike;
+        break;
+      case kDropout:
+        // garbage while not operational
+        r.operational[2] = n % 1000 >= 500;
+        if (!r.operational[2]) faulty[0] = 1e30;
+        break;
+      case kNone:
+        break;
+    }
+  }
+  return readings;
+}
+
+// Root mean square error of the fused x axis over the readings
+template <typename F>
+double rmsError(const std::vector<Reading>& readings, F fuse)
+{
+  double sum = 0;
+  for (const Reading& r : readings) {
+    float result[3];
+    fuse(r, result);
+    sum += result[0]*result[0];
+  }
+  return std::sqrt(sum / readings.size());
+}
+
+bool check(const char* name, Fault fault, double reference, double tolerance)
+{
+  std::vector<Reading> readings = makeReadings(fault, kNumSamples);
+  const float kVariance[3] = {kNoise*kNoise, kNoise*kNoise, kNoise*kNoise};
+  ImuVote vote;
+  vote.configure(kVariance);
+  double vote_error = rmsError(readings, [&vote](const Reading& r, float* result) {  // NOLINT
+    vote.vote(r.values, r.operational, result);
+  });
+  double average_error = rmsError(readings, average);
+  printf("%-9s rms error: vote %.3f, average %.3f m/s^2, IMU 2 weight %.3f\n", name, vote_error,
+      average_error, vote.getWeight(2));
+  return vote_error <= tolerance * reference;
+}
+
+template <typename F>
+double nanosPerCall(const std::vector<Reading>& readings, F fuse)
+{
+  float result[3] = {0, 0, 0};
+  Clock::time_point start = Clock::now();
+  for (int n = 0; n < kNumTimed; n++) {
+    fuse(readings[n % kNumTimedReadings], result);
+    sink = result[0];
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kNumTimed;
+}
+
+}  // namespace
+
+int main()
+{
+  // The average of healthy IMUs is as good as it gets
+  double reference = rmsError(makeReadings(kNone, kNumSamples), average);
+  bool ok = check("healthy", kNone, reference, kHealthyTolerance);
+  ok &= check("drift", kDrift, reference, kFaultTolerance);
+  ok &= check("spikes", kSpikes, reference, kFaultTolerance);
+  ok &= check("dropout", kDropout, reference, kFaultTolerance);
+
+  // Interleaved, so that both see the same load on the machine
+  std::vector<Reading> readings = makeReadings(kNone, kNumTimedReadings);
+  ImuVote vote;
+  double vote_ns    = std::numeric_limits<double>::max();
+  double average_ns = std::numeric_limits<double>::max();
+  for (int run = 0; run < kNumRuns; run++) {
+    vote_ns = std::min(vote_ns, nanosPerCall(readings,
+        [&vote](const Reading& r, float* result) {  // NOLINT
+          vote.vote(r.values, r.operational, result);
+        }));
+    average_ns = std::min(average_ns, nanosPerCall(readings, average));
+  }
+  printf("per reading of %d IMUs: vote %.1f ns, average %.1f ns\n", kNumImus, vote_ns, average_ns);
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
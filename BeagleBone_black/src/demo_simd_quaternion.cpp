@@ -0,0 +1,174 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Checks SimdQuaternion against Quaternion<double>: products and normalisation of random
+ * quaternions, and orientations integrated from constant gyro rates at 1 kHz against the exact
+ * rotation. Then compares the cost of a gyro update with the scalar sin/cos update it replaces.
+ * Exits with 1 if any error is above the tolerances.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "utils/math/quaternion.hpp"
+#include "utils/math/simd_quaternion.hpp"
+#include "utils/math/vector.hpp"
+
+using hyped::utils::math::Quaternion;
+using hyped::utils::math::SimdQuaternion;
+using hyped::utils::math::Vector;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr int    kNumRandom          = 100000;
+constexpr double kPeriod             = 1e-3;    // s, of the gyro readings
+constexpr int    kNumSteps           = 10000;   // 10 s
+constexpr int    kNumTimed           = 1000000;
+constexpr double kProductTolerance   = 1e-6;
+constexpr double kNormTolerance      = 1e-6;    // of |q| - 1 after normalising
+constexpr double kAngleTolerance     = 1e-4;    // rad, after kNumSteps
+
+// Prevents the compiler from optimising the updates away
+volatile float sink;
+
+const char* kBackend =
+#if defined(SIMD_QUATERNION_NEON)
+    "NEON";
+#elif defined(SIMD_QUATERNION_SSE)
+    "SSE";
+#else
+    "scalar";
+#endif
+
+Quaternion<double> toDouble(const SimdQuaternion& q)
+{
+  return Quaternion<double>(q[0], q[1], q[2], q[3]);
+}
+
+Quaternion<double> exactRotation(const Vector<double, 3>& rotation)
+{
+  double theta = std::sqrt(dot(rotation, rotation));
+  if (theta == 0) return Quaternion<double>(1, 0, 0, 0);
+  Vector<double, 3> axis = rotation / theta;
+  return Quaternion<double>(std::cos(theta/2), axis*std::sin(theta/2));
+}
+
+// Angle of the rotation from a to b, from conj(a)*b; unlike acos of a.b this is accurate for small
+// angles and does not depend on the norms
+double angleBetween(const Quaternion<double>& a, const Quaternion<double>& b)
+{
+  Quaternion<double> r(a[0], -a[1], -a[2], -a[3]);
+  r *= b;
+  return 2*std::atan2(std::sqrt(r[1]*r[1] + r[2]*r[2] + r[3]*r[3]), std::abs(r[0]));
+}
+
+// The update navigation did before: sin and cos in double and a scalar product
+void scalarRotate(const Vector<float, 3>& rotation, Quaternion<float>* q)
+{
+  double theta = std::sqrt(dot(rotation, rotation));
+  Quaternion<float> r(1, 0, 0, 0);
+  if (theta > 0) r = Quaternion<float>(std::cos(theta/2), rotation*(std::sin(theta/2)/theta));
+  *q *= r;
+  *q /= q->norm();
+}
+
+bool checkProducts(std::mt19937* random)
+{
+  std::uniform_real_distribution<float> element(-1, 1);
+  double max_product_error = 0, max_norm_error = 0;
+  for (int i = 0; i < kNumRandom; i++) {
+    SimdQuaternion a(element(*random), element(*random), element(*random), element(*random));
+    SimdQuaternion b(element(*random), element(*random), element(*random), element(*random));
+    Quaternion<double> expected = toDouble(a);
+    expected *= toDouble(b);
+    a *= b;
+    for (int j = 0; j < 4; j++)
+      max_product_error = std::max(max_product_error, std::abs(a[j] - expected[j]));
+    a.normalise();
+    max_norm_error = std::max(max_norm_error, std::abs(toDouble(a).norm() - 1));
+  }
+  printf("%s: largest product error %.1e, normalised norm error %.1e\n", kBackend,
+      max_product_error, max_norm_error);
+  return max_product_error <= kProductTolerance && max_norm_error <= kNormTolerance;
+}
+
+// Integrates a constant rate and compares with the exact rotation at the end
+bool checkIntegration(const Vector<double, 3>& rate)
+{
+  SimdQuaternion q;
+  Quaternion<float> scalar(1, 0, 0, 0);
+  Vector<float, 3> step = rate * kPeriod;
+  for (int i = 0; i < kNumSteps; i++) {
+    q.rotate(step);
+    scalarRotate(step, &scalar);
+  }
+  Quaternion<double> exact = exactRotation(rate * (kNumSteps * kPeriod));
+  double error        = angleBetween(toDouble(q), exact);
+  double scalar_error = angleBetween(Quaternion<double>(scalar), exact);
+  printf("rate (%5.1f, %5.1f, %5.1f) rad/s for %.0f s: error %.1e rad (sin/cos update %.1e rad)\n",
+      rate[0], rate[1], rate[2], kNumSteps * kPeriod, error, scalar_error);
+  return error <= kAngleTolerance;
+}
+
+}  // namespace
+
+int main()
+{
+  std::mt19937 random(1);
+  bool ok = checkProducts(&random);
+
+  // Slow turns to the +-2000 deg/s range of the gyros, and one beyond the small angle series
+  ok &= checkIntegration(Vector<double, 3>({0.01, -0.02, 0.005}));
+  ok &= checkIntegration(Vector<double, 3>({0.5, -1.0, 2.0}));
+  ok &= checkIntegration(Vector<double, 3>({20.0, -25.0, 30.0}));
+  ok &= checkIntegration(Vector<double, 3>({150.0, 0, 0}));
+
+  // Cost per gyro update with noisy rates
+  std::normal_distribution<float> noise(0, 0.01);
+  std::vector<Vector<float, 3>> steps(kNumTimed);
+  for (Vector<float, 3>& s : steps) {
+    s  = Vector<float, 3>({noise(random), noise(random), noise(random)});
+    s *= kPeriod;
+  }
+  SimdQuaternion q;
+  Clock::time_point start = Clock::now();
+  for (const Vector<float, 3>& s : steps) q.rotate(s);
+  sink = q[0];
+  double simd_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  Quaternion<float> scalar(1, 0, 0, 0);
+  start = Clock::now();
+  for (const Vector<float, 3>& s : steps) scalarRotate(s, &scalar);
+  sink = scalar[0];
+  double scalar_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  printf("gyro update: sin/cos %.1f ns, %s %.1f ns\n", scalar_ns / kNumTimed, kBackend,
+      simd_ns / kNumTimed);
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
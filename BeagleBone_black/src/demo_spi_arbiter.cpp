@@ -0,0 +1,149 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Shares the SPI bus between devices with different profiles through SpiDevice handles. First
+ * one thread alternates between devices that only differ in clock, then between devices in
+ * different modes, and counts the times the mode is set. Then two threads hammer a device each,
+ * with chip select hooks that yield while they hold the device selected, and every hook checks
+ * that no other device is selected. Exits with 1 if two devices are ever selected at once or
+ * the mode is set other than when it changes. Prints the cost of a read through the arbiter,
+ * which without an SPI device is all there is to a read.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include <atomic>
+
+#include "utils/concurrent/thread.hpp"
+#include "utils/io/spi.hpp"
+#include "utils/system.hpp"
+
+using hyped::utils::concurrent::Thread;
+using hyped::utils::io::SPI;
+using hyped::utils::io::SpiDevice;
+using hyped::utils::System;
+namespace spi = hyped::utils::io::spi;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr int kNumAlternations = 1000;
+constexpr int kNumReads        = 20000;   // per thread
+
+std::atomic<int> num_selected(0);     // devices selected right now
+std::atomic<int> num_collisions(0);
+
+// Stands in for the GPIO of a device, holding it selected for a while
+class CheckedDevice : public spi::ChipSelect {
+ public:
+  CheckedDevice(uint32_t clock_hz, uint8_t mode) : device(clock_hz, mode, this) {}
+
+  void select() override
+  {
+    if (num_selected.fetch_add(1) != 0) num_collisions++;
+    Thread::yield();
+  }
+
+  void deselect() override
+  {
+    num_selected.fetch_sub(1);
+  }
+
+  SpiDevice device;
+};
+
+class Reader : public Thread {
+ public:
+  explicit Reader(SpiDevice* device) : device_(device) {}
+
+  void run() override
+  {
+    uint8_t rx[14];
+    for (int i = 0; i < kNumReads; i++) device_->read(0x3B, rx, sizeof(rx));
+  }
+
+ private:
+  SpiDevice* device_;
+};
+
+/**
+ * @return the number of times the mode was set reading a and b in turn
+ */
+uint32_t alternate(CheckedDevice* a, CheckedDevice* b)
+{
+  SPI& spi = SPI::getInstance();
+  uint8_t rx[1];
+  uint32_t start = spi.getNumModeChanges();
+  for (int i = 0; i < kNumAlternations; i++) {
+    a->device.read(0x75, rx, 1);
+    b->device.read(0x75, rx, 1);
+  }
+  return spi.getNumModeChanges() - start;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  System::parseArgs(argc, argv);
+  SPI& spi = SPI::getInstance();
+  bool ok = true;
+
+  // like the MPU9250 at its configuration and its data clock, and a device in mode 0
+  CheckedDevice fast(20000000, 3);
+  CheckedDevice slow(1000000, 3);
+  CheckedDevice other_mode(4000000, 0);
+  uint8_t rx[1];
+  fast.device.read(0x75, rx, 1);
+
+  uint32_t clock_only = alternate(&fast, &slow);
+  uint32_t with_mode  = alternate(&fast, &other_mode);
+  printf("%d alternations: clock only %u mode changes, clock and mode %u mode changes\n",
+      kNumAlternations, clock_only, with_mode);
+  ok &= clock_only == 0;
+  // the bus starts out in the mode of `fast`
+  ok &= with_mode == 2 * kNumAlternations - 1;
+
+  Reader reader_fast(&fast.device);
+  Reader reader_other(&other_mode.device);
+  uint32_t start_messages = spi.getNumMessages();
+  uint32_t start_modes    = spi.getNumModeChanges();
+  Clock::time_point start = Clock::now();
+  reader_fast.start();
+  reader_other.start();
+  reader_fast.join();
+  reader_other.join();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  uint32_t num_messages = spi.getNumMessages() - start_messages;
+  printf("2 threads: %u reads, %u mode changes, %d collisions, %.0f ns per read\n", num_messages,
+      spi.getNumModeChanges() - start_modes, num_collisions.load(),
+      seconds * 1e9 / num_messages);
+  ok &= num_collisions == 0;
+  ok &= num_messages == 2 * kNumReads;
+  // the hooks yield with the bus held, so the threads mostly take turns and change the mode
+  ok &= spi.getNumModeChanges() - start_modes <= num_messages;
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Counts the SPI_IOC_MESSAGE calls, transfers and chip select writes of a sweep of the sensors,
+ * one register read after another with SPI::read() and as one spi::Batch. Sweeps the data
+ * registers of the four IMUs, each on a GPIO chip select, and eight registers of a device on the
+ * chip select the kernel drives. The counts do not need an SPI device, without one nothing is
+ * transferred. Exits with 1 if a batch takes more calls than the reads one by one, a chip select
+ * is not toggled around each transfer, or the registers behind the kernel's chip select are not
+ * read in a single call.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "data/data.hpp"
+#include "utils/io/spi.hpp"
+#include "utils/system.hpp"
+
+using hyped::data::Sensors;
+using hyped::utils::io::SPI;
+using hyped::utils::io::SpiDevice;
+using hyped::utils::System;
+namespace spi = hyped::utils::io::spi;
+
+namespace {
+
+constexpr uint8_t  kReadFlag        = 0x80;
+constexpr uint8_t  kImuMode         = 3;
+constexpr uint32_t kImuClock        = 20000000;   // Hz
+constexpr uint8_t  kImuDataAddr     = 0x3B;       // accelerometer, temperature and gyroscope
+constexpr uint16_t kImuDataLen      = 14;
+constexpr int      kNumRegisters    = 8;          // behind the kernel's chip select
+
+// Stands in for the GPIO of an IMU, counts the writes and checks they pair up
+class CountingChipSelect : public spi::ChipSelect {
+ public:
+  CountingChipSelect()
+      : device(kImuClock, kImuMode, this),
+        num_writes_(0),
+        is_selected_(false),
+        ok_(true)
+  {}
+
+  void select() override
+  {
+    ok_ &= !is_selected_;
+    is_selected_ = true;
+    num_writes_++;
+  }
+
+  void deselect() override
+  {
+    ok_ &= is_selected_;
+    is_selected_ = false;
+    num_writes_++;
+  }
+
+  int  getNumWrites() const { return num_writes_; }
+  bool isOk() const { return ok_ && !is_selected_; }
+
+  SpiDevice device;
+
+ private:
+  int  num_writes_;
+  bool is_selected_;
+  bool ok_;
+};
+
+struct Cost {
+  uint32_t num_messages;
+  int num_transfers;
+  int num_cs_writes;
+};
+
+void report(const char* name, const Cost& one_by_one, const Cost& batch)
+{
+  printf("%-22s one by one %2u calls, %2d transfers, %d GPIO writes | batch %2u calls, "
+         "%2d transfers, %d GPIO writes\n", name, one_by_one.num_messages,
+      one_by_one.num_transfers, one_by_one.num_cs_writes, batch.num_messages,
+      batch.num_transfers, batch.num_cs_writes);
+}
+
+int countWrites(const CountingChipSelect* cs, int num)
+{
+  int num_writes = 0;
+  for (int i = 0; i < num; i++) num_writes += cs[i].getNumWrites();
+  return num_writes;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  System::parseArgs(argc, argv);
+  SPI& spi = SPI::getInstance();
+  spi::Batch batch;
+  uint8_t rx[kImuDataLen];
+  bool ok = true;
+
+  // IMUs, as MPU9250::getData() and MPU9250::queueData()
+  CountingChipSelect imu_cs[Sensors::kNumImus];
+  uint32_t start = spi.getNumMessages();
+  for (CountingChipSelect& cs : imu_cs) {
+    cs.select();
+    spi.read(kImuDataAddr | kReadFlag, rx, kImuDataLen);
+    cs.deselect();
+  }
+  Cost one_by_one = {spi.getNumMessages() - start, 2 * Sensors::kNumImus,
+                     countWrites(imu_cs, Sensors::kNumImus)};
+
+  CountingChipSelect batch_cs[Sensors::kNumImus];
+  for (CountingChipSelect& cs : batch_cs) {
+    batch.select(&cs.device);
+    ok &= batch.read(kImuDataAddr | kReadFlag, kImuDataLen) != nullptr;
+  }
+  start = spi.getNumMessages();
+  spi.submit(&batch);
+  Cost batched = {spi.getNumMessages() - start, batch.getNumTransfers(),
+                  countWrites(batch_cs, Sensors::kNumImus)};
+  report("IMU sweep", one_by_one, batched);
+  ok &= batched.num_messages <= one_by_one.num_messages;
+  ok &= batched.num_cs_writes == 2 * Sensors::kNumImus;
+  for (const CountingChipSelect& cs : batch_cs) ok &= cs.isOk();
+
+  // a device the kernel selects
+  start = spi.getNumMessages();
+  for (int i = 0; i < kNumRegisters; i++) spi.read(i | kReadFlag, rx, 1);
+  one_by_one = {spi.getNumMessages() - start, 2 * kNumRegisters, 0};
+
+  batch.clear();
+  for (int i = 0; i < kNumRegisters; i++) ok &= batch.read(i | kReadFlag, 1) != nullptr;
+  start = spi.getNumMessages();
+  spi.submit(&batch);
+  batched = {spi.getNumMessages() - start, batch.getNumTransfers(), 0};
+  report("kernel chip select", one_by_one, batched);
+  ok &= batched.num_messages == 1;
+
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Passes IMU-sized samples from a producer thread to a consumer thread through SpscRing in bursts
+ * every millisecond, like ImuManager draining the IMU FIFOs at 16 times their output data rate.
+ * First with a consumer that keeps up and then with one that sleeps for longer than the ring
+ * lasts now and then, like a busy sensors thread. Every sample carries its sequence
+ * number in all of its values, so a torn copy shows. Exits with 1 if a sample is torn, out of
+ * order or missing without being counted as dropped, or if the consumer that keeps up loses more
+ * than a few.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+
+#include "data/data.hpp"
+#include "utils/concurrent/spsc_ring.hpp"
+#include "utils/concurrent/thread.hpp"
+#include "utils/logger.hpp"
+
+using hyped::data::DataPoint;
+using hyped::data::Imu;
+using hyped::data::Sensors;
+using hyped::utils::concurrent::SpscRing;
+using hyped::utils::concurrent::Thread;
+using hyped::utils::Logger;
+
+namespace {
+
+typedef DataPoint<std::array<Imu, Sensors::kNumImus>> Sample;
+typedef SpscRing<Sample, 64> Ring;
+
+constexpr uint32_t kBurst      = 16;    // samples pushed every ms
+constexpr uint32_t kNumSamples = 2000 * kBurst;
+// a consumer that keeps up may still be preempted for a while on a loaded machine
+constexpr double   kMaxDropped = 0.001;   // of the samples
+
+Logger log(false, -1);
+
+Sample makeSample(uint32_t n)
+{
+  Sample sample;
+  sample.timestamp = n;
+  for (Imu& imu : sample.value) {
+    imu.operational = true;
+    for (int axis = 0; axis < 3; axis++) {
+      imu.acc[axis] = n;
+      imu.gyr[axis] = n;
+    }
+  }
+  return sample;
+}
+
+bool isWhole(const Sample& sample)
+{
+  for (const Imu& imu : sample.value) {
+    for (int axis = 0; axis < 3; axis++) {
+      if (imu.acc[axis] != sample.timestamp || imu.gyr[axis] != sample.timestamp) return false;
+    }
+  }
+  return true;
+}
+
+class Producer : public Thread {
+ public:
+  explicit Producer(Ring* ring) : Thread(0, log), ring_(ring), done_(false) {}
+
+  void run() override
+  {
+    // 1..kNumSamples, the values need to be exact as floats
+    for (uint32_t n = 1; n <= kNumSamples; n++) {
+      ring_->push(makeSample(n));
+      if (n % kBurst == 0) Thread::sleep(1);
+    }
+    done_.store(true, std::memory_order_release);
+  }
+
+  bool isDone() const { return done_.load(std::memory_order_acquire); }
+
+ private:
+  Ring* ring_;
+  std::atomic<bool> done_;
+};
+
+struct Result {
+  uint32_t num_received;
+  uint32_t num_torn;
+  uint32_t num_out_of_order;
+  uint32_t num_dropped;
+};
+
+/**
+ * @param pause_every    The consumer sleeps for 10 ms after every this many samples, 0 never
+ */
+Result run(uint32_t pause_every)
+{
+  Ring ring;
+  Producer producer(&ring);
+  Result r = {0, 0, 0, 0};
+  producer.start();
+
+  uint32_t last = 0;
+  Sample sample;
+  while (true) {
+    bool done = producer.isDone();
+    if (!ring.pop(&sample)) {
+      if (done) break;
+      std::this_thread::yield();
+      continue;
+    }
+    if (!isWhole(sample)) r.num_torn++;
+    if (sample.timestamp <= last) r.num_out_of_order++;
+    last = sample.timestamp;
+    r.num_received++;
+    if (pause_every > 0 && r.num_received % pause_every == 0) Thread::sleep(10);
+  }
+  producer.join();
+  r.num_dropped = ring.getNumDropped();
+  return r;
+}
+
+bool report(const char* name, const Result& r, double max_dropped)
+{
+  printf("%-10s %u received, %u dropped, %u torn, %u out of order\n", name, r.num_received,
+      r.num_dropped, r.num_torn, r.num_out_of_order);
+  bool ok = r.num_torn == 0 && r.num_out_of_order == 0;
+  ok &= r.num_received + r.num_dropped == kNumSamples;
+  ok &= r.num_dropped <= max_dropped * kNumSamples;
+  return ok;
+}
+
+}  // namespace
+
+int main()
+{
+  printf("%u samples of %zu bytes in bursts of %u through a ring of %zu\n", kNumSamples,
+      sizeof(Sample), kBurst, Ring::capacity());
+  bool ok = report("keeping up", run(0), kMaxDropped);
+  // drops most of the samples of each pause, but counts all of them
+  ok &= report("pausing", run(1000), 1);
+  if (!ok) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -37,7 +37,9 @@ int main()
 
   OnlineStatistics<float> os1, os21, os22, os30;
   std::array<OnlineStatistics<float>, 5> os3x;
-  RollingStatistics<float> rs1(1), rs2(4), rs3(5000);
+  RollingStatistics<float, 1> rs1;
+  RollingStatistics<float, 4> rs2;
+  RollingStatistics<float, 5000> rs3;
 
   os1.update(a1[0]);
   std::cout << "OnlineStats for [" << a1 << "]:" << std::endl;
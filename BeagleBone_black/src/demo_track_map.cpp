@@ -0,0 +1,125 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Checks the bucketed stripe lookups of TrackMap against a linear search over the stripes, on the
+ * competition track and on randomly spaced tracks, and compares the cost of a query. Exits with 1
+ * on the first disagreement.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include <vector>
+
+#include "navigation/track_map.hpp"
+
+using hyped::data::NavigationType;
+using hyped::navigation::TrackMap;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+constexpr int kNumQueries = 1000000;
+constexpr int kNumTracks  = 20;
+
+// Prevents the compiler from optimising the queries away
+volatile int sink;
+
+int linearStripeBefore(const TrackMap& track, NavigationType distance)
+{
+  int n = 0;
+  while (n < track.getNumStripes() && track.getStripe(n + 1) <= distance) n++;
+  return n;
+}
+
+int linearNearestStripe(const TrackMap& track, NavigationType distance)
+{
+  int n = linearStripeBefore(track, distance);
+  if (n < track.getNumStripes() &&
+      track.getStripe(n + 1) - distance < distance - track.getStripe(n)) n++;
+  return n;
+}
+
+// Queries uniformly spread from before the start to past the last stripe, plus every stripe
+std::vector<NavigationType> makeQueries(const TrackMap& track, std::mt19937* random)
+{
+  NavigationType length = track.getStripe(track.getNumStripes());
+  std::uniform_real_distribution<NavigationType> uniform(-0.1 * length, 1.1 * length);
+  std::vector<NavigationType> queries(kNumQueries);
+  for (NavigationType& q : queries) q = uniform(*random);
+  for (int n = 0; n <= track.getNumStripes(); n++) queries.push_back(track.getStripe(n));
+  return queries;
+}
+
+bool check(const TrackMap& track, const std::vector<NavigationType>& queries)
+{
+  for (NavigationType q : queries) {
+    int before  = track.getStripeBefore(q);
+    int nearest = track.getNearestStripe(q);
+    if (before != linearStripeBefore(track, q) || nearest != linearNearestStripe(track, q)) {
+      printf("FAIL at %f m: before %d (expected %d), nearest %d (expected %d)\n", q,
+          before, linearStripeBefore(track, q), nearest, linearNearestStripe(track, q));
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main()
+{
+  std::mt19937 random(1);
+
+  // The shipped track map is the competition track
+  TrackMap file_track = TrackMap::readFile(TrackMap::kDefaultTrackMapFile);
+  TrackMap competition;
+  if (file_track.getNumStripes() != competition.getNumStripes()) {
+    printf("FAIL: %s has %d stripes, expected %d\n", TrackMap::kDefaultTrackMapFile,
+        file_track.getNumStripes(), competition.getNumStripes());
+    return 1;
+  }
+  std::vector<NavigationType> queries = makeQueries(competition, &random);
+  if (!check(competition, queries) || !check(file_track, queries)) return 1;
+
+  // Irregular tracks: spacings from 0.5 m to 60 m
+  std::uniform_real_distribution<NavigationType> spacing(0.5, 60);
+  for (int t = 0; t < kNumTracks; t++) {
+    std::vector<NavigationType> stripes(1 + t * 10);
+    NavigationType position = 0;
+    for (NavigationType& s : stripes) s = position += spacing(random);
+    TrackMap track(stripes);
+    if (!check(track, makeQueries(track, &random))) return 1;
+  }
+  printf("lookups agree with linear search on %d tracks\n", kNumTracks + 1);
+
+  // Cost per query on the competition track
+  Clock::time_point start = Clock::now();
+  for (NavigationType q : queries) sink = linearNearestStripe(competition, q);
+  double linear_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  start = Clock::now();
+  for (NavigationType q : queries) sink = competition.getNearestStripe(q);
+  double bucket_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  printf("nearest stripe: linear search %.1f ns per query, buckets %.1f ns per query\n",
+      linear_ns / queries.size(), bucket_ns / queries.size());
+
+  printf("OK\n");
+  return 0;
+}
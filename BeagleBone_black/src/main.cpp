@@ -29,6 +29,7 @@
 #include "utils/concurrent/thread.hpp"
 
 #include "data/data.hpp"
+#include "data/recorder.hpp"
 #include "utils/logger.hpp"
 #include "utils/system.hpp"
 
@@ -41,6 +42,10 @@ using hyped::utils::System;
 using hyped::data::Navigation;
 using hyped::data::Sensors;
 using hyped::data::Data;
+using hyped::data::Recorder;
+
+// size of the flight recording file, enough for several runs worth of all channels
+constexpr uint64_t kRecordingSize = 256ull << 20;
 
 int main(int argc, char* argv[])
 {
@@ -59,6 +64,15 @@ int main(int argc, char* argv[])
   log_system.DBG2("MAIN", "DBG2");
   log_system.DBG3("MAIN", "DBG3");
 
+  Recorder* recorder = nullptr;
+  if (sys.record_file) {
+    recorder = new Recorder(log_system, sys.record_file, kRecordingSize);
+    if (recorder->isOpen()) {
+      recorder->start();
+      Data::getInstance().setRecorder(recorder);
+    }
+  }
+
   Thread* state_machine   = new hyped::state_machine::Main(0, log_state);
   Thread* motor     = new hyped::motor_control::Main(1, log_motor);
   Thread* sensors   = new hyped::sensors::Main(2, log_sensor);
@@ -113,5 +127,15 @@ int main(int argc, char* argv[])
   delete motor;
   delete navigation;
   delete communications;
+
+  if (recorder) {
+    Data::getInstance().setRecorder(nullptr);
+    recorder->stop();
+    if (recorder->isOpen()) recorder->join();
+    log_system.INFO("MAIN", "recorded %u kB, %u records dropped",
+        static_cast<uint32_t>(recorder->getNumBytesUsed() / 1024),
+        static_cast<uint32_t>(recorder->getNumDropped()));
+    delete recorder;
+  }
   return 0;
 }
@@ -41,7 +41,11 @@ using utils::Timer;
 
 namespace motor_control {
 
+using data::Channel;
+
 constexpr double  kHalbachRadius    = 0.148;
+// Upper bound on how long the thread sleeps waiting for a state or navigation update
+constexpr uint32_t kMaxWaitMillis   = 10;
 const std::string kAccelerationData = "../BeagleBone_black/data/configuration/AccelerationSlip.txt";
 const std::string kDecelerationData = "../BeagleBone_black/data/configuration/DecelerationSlip.txt";
 
@@ -79,11 +83,12 @@ void Main::run()
   log_.INFO("MOTOR", "Starting motor controllers");
   System& sys = System::getSystem();
   while (run_ && sys.running_) {
+    uint32_t state_version = data_.getVersion(Channel::kStateMachine);
     state_ = data_.getStateMachineData();
 
     if (state_.current_state == data::State::kIdle) {
       if (!motors_init_) initMotors();
-      yield();
+      data_.waitForUpdate(Channel::kStateMachine, state_version, kMaxWaitMillis);
 
     } else if (state_.current_state == data::State::kCalibrating) {
       if (!slip_calculated_) {
@@ -91,12 +96,12 @@ void Main::run()
         calculateSlip(kDecelerationData);
       }
       if (!motors_ready_ && !motor_failure_) prepareMotors();
-      yield();
+      data_.waitForUpdate(Channel::kStateMachine, state_version, kMaxWaitMillis);
 
     } else if (state_.current_state == data::State::kReady) {
       // Wait for launch command
       updateMotorData();
-      yield();
+      data_.waitForUpdate(Channel::kStateMachine, state_version, kMaxWaitMillis);
 
     } else if (state_.current_state == data::State::kAccelerating) {
       accelerateMotors();
@@ -108,7 +113,7 @@ void Main::run()
       // Wait for state machine to transition to kExiting
       communicator_->sendTargetVelocity(0);
       updateMotorData();
-      yield();
+      data_.waitForUpdate(Channel::kStateMachine, state_version, kMaxWaitMillis);
 
     } else if (state_.current_state == data::State::kExiting) {
       servicePropulsion();
@@ -119,7 +124,7 @@ void Main::run()
     } else if (state_.current_state == data::State::kFailureStopped) {
       enterPreOperational();
       updateMotorData();
-      yield();
+      data_.waitForUpdate(Channel::kStateMachine, state_version, kMaxWaitMillis);
 
     } else {
       run_ = false;
@@ -251,6 +256,7 @@ void Main::accelerateMotors()
     log_.INFO("MOTOR", "Motor state: Accelerating");
   }
 
+  uint32_t nav_version = 0;
   while (state_.current_state == data::State::kAccelerating) {
     // Check for motors critical failure flag
     communicator_->healthCheck();
@@ -264,8 +270,10 @@ void Main::accelerateMotors()
       break;
     }
 
-    // Otherwise step up motor velocity
+    // Otherwise step up motor velocity once navigation has something new
     log_.DBG2("MOTOR", "Motor State: Accelerating\n");
+    data_.waitForUpdate(Channel::kNavigation, nav_version, kMaxWaitMillis);
+    nav_version = data_.getVersion(Channel::kNavigation);
     data::Navigation nav_ = data_.getNavigationData();
     target_velocity_      = accelerationVelocity(nav_.velocity);
     communicator_->sendTargetVelocity(target_velocity_);
@@ -370,7 +378,10 @@ int32_t Main::accelerationVelocity(NavigationType velocity)
 int32_t Main::decelerationVelocity(NavigationType velocity)
 {
   // Decrease velocity from max RPM to 0, with updates every 45 milliseconds
-  while (timer.getTimeMicros() - time_of_update_ < 45000);
+  uint64_t elapsed;
+  while ((elapsed = timer.getTimeMicros() - time_of_update_) < 45000) {
+    sleep((45000 - elapsed + 999) / 1000);
+  }
   int32_t rpm;
   time_of_update_ = timer.getTimeMicros();
   if (dec_index_ < (int32_t) deceleration_slip_[1].size()) {
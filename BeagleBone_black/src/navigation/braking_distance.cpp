@@ -0,0 +1,92 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "navigation/braking_distance.hpp"
+
+namespace hyped {
+namespace navigation {
+
+constexpr NavigationType BrakingDistanceTable::kMaxVelocity;
+constexpr NavigationType BrakingDistanceTable::kStep;
+constexpr NavigationType BrakingDistanceTable::kSwitchVelocity;
+constexpr int            BrakingDistanceTable::kSize;
+constexpr int            BrakingDistanceTable::kSwitchIndex;
+
+namespace {
+
+// A polynomial fit for the braking distance at a specific (normalised) velocity, where
+// kCoeffSlow for < 50m/s and kCoeffFast for > 50m/s because kCoeffFast is inaccurate
+// at < 10m/s but they both agree between ~10 and ~50m/s.
+constexpr std::array<double, 16> kCoeffSlow = {
+     136.3132, 158.9403,  63.6093, -35.4894, -149.2755, 152.6967, 502.5464, -218.4689,
+    -779.534,   95.7285, 621.1013,  50.4598, -245.099,  -54.5,     38.0642,   12.3548};
+constexpr std::array<double, 16> kCoeffFast = {
+     258.6,  299.2,  115.2, -104.7, -260.9, 488.5, 940.8, -808.5, -1551.9,  551.7,
+    1315.7,  -61.4, -551.4,  -84.5,   90.7,  26.2};
+
+double evaluate(const std::array<double, 16>& coeff, double norm_v)
+{
+  // Evaluated in double: the terms are up to 10^3 times larger than the sum near 0 m/s
+  double braking_distance = 2.0;
+  double var = 1.0;
+  for (unsigned int i = 0; i < coeff.size(); ++i) {
+    braking_distance += coeff[i] * var;
+    var *= norm_v;
+  }
+  return braking_distance;
+}
+
+double slowFit(double velocity)
+{
+  return evaluate(kCoeffSlow, (velocity - 30.0079) / 17.2325);
+}
+
+double fastFit(double velocity)
+{
+  return evaluate(kCoeffFast, (velocity - 41.4985) / 23.5436);
+}
+
+}  // namespace
+
+NavigationType brakingDistanceFit(NavigationType velocity)
+{
+  if (velocity < BrakingDistanceTable::kSwitchVelocity) return slowFit(velocity);
+  return fastFit(velocity);
+}
+
+BrakingDistanceTable::BrakingDistanceTable()
+{
+  static_assert(kSize == static_cast<int>(kMaxVelocity / kStep + 0.5) + 1,
+                "kSize does not cover [0, kMaxVelocity]");
+  static_assert(kSwitchIndex == static_cast<int>(kSwitchVelocity / kStep + 0.5),
+                "kSwitchIndex is not the entry of kSwitchVelocity");
+  // The entry of kSwitchVelocity is there twice, the end of the slow fit's segment and the
+  // start of the fast fit's
+  for (int i = 0; i <= kSwitchIndex; ++i)
+    distance_[i] = slowFit(i * kStep);
+  for (int i = kSwitchIndex; i < kSize; ++i)
+    distance_[i + 1] = fastFit(i * kStep);
+}
+
+const BrakingDistanceTable& BrakingDistanceTable::getInstance()
+{
+  static BrakingDistanceTable table;
+  return table;
+}
+
+}}  // namespace hyped::navigation
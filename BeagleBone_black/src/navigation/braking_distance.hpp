@@ -0,0 +1,82 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Braking distance as a function of velocity. The fitted polynomials are sampled once into a
+ * dense table, lookups interpolate linearly between the two nearest entries of the same fit.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_NAVIGATION_BRAKING_DISTANCE_HPP_
+#define BEAGLEBONE_BLACK_NAVIGATION_BRAKING_DISTANCE_HPP_
+
+#include <array>
+
+#include "data/data.hpp"
+#include "utils/utils.hpp"
+
+namespace hyped {
+
+using data::NavigationType;
+
+namespace navigation {
+
+/**
+ * @brief Polynomial fit of the braking distance (m) at `velocity` (m/s). Costs 16 multiply-adds.
+ */
+NavigationType brakingDistanceFit(NavigationType velocity);
+
+/**
+ * @brief brakingDistanceFit() sampled every kStep m/s over [0, kMaxVelocity], in two segments
+ *        that meet at kSwitchVelocity, where the fit switches from the slow to the fast
+ *        polynomial. Velocities outside that range fall back to the fit.
+ */
+class BrakingDistanceTable {
+ public:
+  // the fast fit diverges above ~75 m/s, beyond the speeds it was fitted to
+  static constexpr NavigationType kMaxVelocity    = 80;    // m/s
+  static constexpr NavigationType kStep           = 0.02;  // m/s
+  static constexpr int            kSize           = 4001;  // kMaxVelocity/kStep + 1
+  static constexpr NavigationType kSwitchVelocity = 50;    // m/s, the fast fit from here on
+  static constexpr int            kSwitchIndex    = 2500;  // kSwitchVelocity/kStep
+
+  /**
+   * @brief Shared table, built on the first call
+   */
+  static const BrakingDistanceTable& getInstance();
+
+  /**
+   * @brief Braking distance (m) at `velocity` (m/s)
+   */
+  NavigationType lookup(NavigationType velocity) const
+  {
+    NavigationType position = velocity * (1 / kStep);
+    // also false for NaN
+    if (!(position >= 0 && position < kSize - 1)) return brakingDistanceFit(velocity);
+    int i = static_cast<int>(position);
+    NavigationType fraction = position - i;
+    // the fast fit's entries are one further on, behind the slow fit's entry of the switch
+    i += velocity >= kSwitchVelocity;
+    return distance_[i] + fraction * (distance_[i + 1] - distance_[i]);
+  }
+
+ private:
+  BrakingDistanceTable();
+  std::array<NavigationType, kSize + 1> distance_;
+  NO_COPY_ASSIGN(BrakingDistanceTable);
+};
+
+}}  // namespace hyped::navigation
+
+#endif  // BEAGLEBONE_BLACK_NAVIGATION_BRAKING_DISTANCE_HPP_
@@ -18,77 +18,102 @@
 
 #include "navigation/main.hpp"
 
-#include <memory>
+#include <algorithm>
 
 #include "utils/system.hpp"
+#include "utils/timer.hpp"
 
 namespace hyped {
 
+using data::Channel;
+using data::DataPoint;
 using data::ModuleStatus;
 using data::State;
 using utils::concurrent::ScopedLock;
 using utils::System;
+using utils::Timer;
 
 namespace navigation {
 
+// Upper bound on how long the thread sleeps waiting for new data before re-checking its state
+constexpr uint32_t kMaxWaitMillis = 10;
+
+constexpr int Main::kMeasurementQueueSize;
+constexpr int Main::kMaxImuBatch;
+constexpr uint64_t Main::kLatencyReportPeriod;
+
 Main::Main(uint8_t id, Logger& log)
     : Thread(id, log),
       data_(data::Data::getInstance()),
-      nav_(System::getSystem().navigation_motors_sync_, log)
+      nav_(System::getSystem().navigation_motors_sync_, log),
+      readings_(),
+      measurement_(),
+      imu_version_(0),
+      imu_next_(0),
+      num_imu_dropped_(0),
+#ifdef PROXI
+      proxi_front_version_(0),
+      proxi_back_version_(0),
+#endif
+      keyence_version_(0),
+      opt_enc_version_(0)
 {
   updateData();
 }
 
 void Main::run()
 {
-  std::unique_ptr<Sensors> last_readings(new Sensors());
-  std::unique_ptr<Sensors> readings(new Sensors());
-
-  // Views of the Sensors structs
-#ifdef PROXI
-  std::unique_ptr<Navigation::ProximityArray> last_proxis(new Navigation::ProximityArray());
-  std::unique_ptr<Navigation::ProximityArray> proxis(new Navigation::ProximityArray());
-  // Set up pointers as to unify the front and rear proxis in a single array
-  for (int i = 0; i < Sensors::kNumProximities; ++i) {
-    (*proxis)[i] = &(readings->proxi_front.value[i]);
-    (*proxis)[i + Sensors::kNumProximities] = &(readings->proxi_back.value[i]);
-    (*last_proxis)[i] = &(last_readings->proxi_front.value[i]);
-    (*last_proxis)[i + Sensors::kNumProximities] = &(last_readings->proxi_back.value[i]);
-  }
-#endif
   log_.INFO("NAV", "Main started");
 
   System& sys = System::getSystem();
+  // Channel to sleep on (outside of l_) before the next iteration, and its last seen version
+  Channel wait_channel = Channel::kSensors;
+  uint32_t wait_version = 0;
+  bool wait = false;
+  auto waitFor = [&](Channel channel, uint32_t version) {  // NOLINT [whitespace/braces]
+    wait_channel = channel;
+    wait_version = version;
+    wait = true;
+  };
   while (sys.running_) {
+    if (wait) {
+      data_.waitForUpdate(wait_channel, wait_version, kMaxWaitMillis);
+      wait = false;
+    }
     ScopedLock L(&l_);
+    uint32_t sm_version = data_.getVersion(Channel::kStateMachine);
     // State updates
     State current_state = data_.getStateMachineData().current_state;
     switch (current_state) {
-      case State::kIdle :
-        *readings = data_.getSensorsData();
-        if ((readings->module_status == ModuleStatus::kInit ||
-             readings->module_status == ModuleStatus::kReady) &&
+      case State::kIdle : {
+        uint32_t sensors_version = data_.getVersion(Channel::kSensors);
+        ModuleStatus sensors_status = data_.getSensorsStatus();
+        if ((sensors_status == ModuleStatus::kInit ||
+             sensors_status == ModuleStatus::kReady) &&
             nav_.getStatus() == ModuleStatus::kStart) {  // NOLINT [whitespace/braces]
-          nav_.init(data_.getCalibrationData(), *readings);
-          *last_readings = data_.getSensorsData();
-          *readings = data_.getSensorsData();
+          markSensorsSeen();
+          readings_ = data_.getSensorsData();
+          nav_.init(data_.getCalibrationData(), readings_);
           updateData();
         }
-        yield();
+        waitFor(Channel::kSensors, sensors_version);
         continue;
+      }
       case State::kCalibrating :
         if (!nav_.is_calibrating_) {
           if (nav_.startCalibration()) {
             log_.INFO("NAV", "Calibration started");
           } else {
             log_.ERR("NAV", "Calibration couldn't start");
-            yield();
+            waitFor(Channel::kStateMachine, sm_version);
             continue;
           }
         }
         break;
       case State::kReady :
-        yield();
+        // nothing to do until the run starts, which starts from the IMU samples after that
+        imu_next_ = data_.getSensorsImuHistory().getCount();
+        waitFor(Channel::kStateMachine, sm_version);
         continue;
       case State::kAccelerating :
         if (nav_.is_calibrating_) {
@@ -101,44 +126,18 @@ void Main::run()
         break;
     }
 
-    // Data updates
-    *readings = data_.getSensorsData();
-    // check if time goes backwards, ignore such readings
-    if (readings->imu.timestamp < last_readings->imu.timestamp) {
-      log_.ERR("NAV", "new reading has past timestamp %u", readings->imu.timestamp);
-      yield();
+    // Data updates, one for each IMU sample
+    int num_imus = fetchSensors();
+    if (num_imus == 0) {
+      // sleep until the IMUs are published again
+      waitFor(Channel::kSensorsImu, imu_version_);
       continue;
     }
-
-    // TODO(Brano): Accelerations and gyros should be in separate arrays in data::Sensors.
-    if (!imuChanged(*last_readings, *readings)) {
-      // let other threads run, maybe someone will update the sensors data
-      yield();
-      continue;
+    uint32_t window = nav_.settings_.reorder_window;
+    for (int i = 0; i < num_imus; i++) {
+      uint32_t timestamp = imu_timestamps_[i];
+      applyMeasurements(timestamp > window ? timestamp - window : 0);
     }
-    Navigation::Input input;
-#ifdef PROXI
-     if (proxiChanged(*last_readings, *readings)) {
-      input.proxis = &(*proxis);
-     }
-#endif
-     if (stripeCntChanged(*last_readings, *readings)) {
-      input.sc = &readings->keyence_stripe_counter;
-     }
-     if (opticalEncDistChanged(*last_readings, *readings)) {
-      input.optical_enc_distance = &readings->optical_enc_distance;
-     }
-     if (imuChanged(*last_readings, *readings)) {
-      input.imus = &readings->imu;
-     }
-     nav_.update(input);
-
-    updateData();
-
-    readings.swap(last_readings);
-#ifdef PROXI
-    proxis.swap(last_proxis);
-#endif
   }
 }
 
@@ -148,38 +147,120 @@ const Navigation::FullOutput& Main::getAllNavData()
   return nav_.getAll();
 }
 
-bool Main::imuChanged(const Sensors& old_data, const Sensors& new_data)
+void Main::markSensorsSeen()
 {
-  return new_data.imu.timestamp != old_data.imu.timestamp;
+  imu_version_         = data_.getVersion(Channel::kSensorsImu);
+  imu_next_            = data_.getSensorsImuHistory().getCount();
+#ifdef PROXI
+  proxi_front_version_ = data_.getVersion(Channel::kSensorsProxiFront);
+  proxi_back_version_  = data_.getVersion(Channel::kSensorsProxiBack);
+#endif
+  keyence_version_     = data_.getVersion(Channel::kSensorsKeyence);
+  opt_enc_version_     = data_.getVersion(Channel::kSensorsOpticalEncoder);
 }
 
-#ifdef PROXI
-bool Main::proxiChanged(const Sensors& old_data, const Sensors& new_data)
+int Main::fetchSensors()
 {
+  // the version goes first: a sample published after it will wake up the next wait
+  imu_version_ = data_.getVersion(Channel::kSensorsImu);
+  uint64_t first = imu_next_;
+  int num_samples = data_.getSensorsImuHistory().getFrom(&imu_next_, imu_samples_.data(),
+                                                         kMaxImuBatch);
+  uint32_t num_dropped = imu_next_ - first - num_samples;
+  if (num_dropped > 0) {
+    num_imu_dropped_ += num_dropped;
+    log_.ERR("NAV", "%u IMU samples overwritten before they could be used, %u in total",
+        num_dropped, num_imu_dropped_);
+  }
+
+  // TODO(Brano): Accelerations and gyros should be in separate arrays in data::Sensors.
+  int num_imus = 0;
+  for (int i = 0; i < num_samples; i++) {
+    const DataPoint<Navigation::ImuArray>& imus = imu_samples_[i].value;
+    if (imus.timestamp <= readings_.imu.timestamp) {
+      // check if time goes backwards, ignore such readings
+      if (imus.timestamp < readings_.imu.timestamp)
+        log_.ERR("NAV", "new reading has past timestamp %u", imus.timestamp);
+      continue;
+    }
+    readings_.imu = imus;
+    measurement_.type      = Measurement::kImu;
+    measurement_.timestamp = imus.timestamp;
+    measurement_.imus      = imus;
+    pushMeasurement();
+    imu_timestamps_[num_imus++] = imus.timestamp;
+  }
+  if (num_imus == 0) return 0;
+
+  // The other channels are only copied when they have been published since the last call
+#ifdef PROXI
   // Both front and back should be always updated at the same time
-  return old_data.proxi_front.timestamp != new_data.proxi_front.timestamp &&
-         old_data.proxi_back.timestamp  != new_data.proxi_back.timestamp;
-}
+  uint32_t front_version = data_.getVersion(Channel::kSensorsProxiFront);
+  uint32_t back_version  = data_.getVersion(Channel::kSensorsProxiBack);
+  if (front_version != proxi_front_version_ && back_version != proxi_back_version_) {
+    proxi_front_version_   = front_version;
+    proxi_back_version_    = back_version;
+    readings_.proxi_front  = data_.getSensorsProxiFrontData();
+    readings_.proxi_back   = data_.getSensorsProxiBackData();
+    measurement_.type        = Measurement::kProximity;
+    measurement_.timestamp   = std::max(readings_.proxi_front.timestamp,
+                                        readings_.proxi_back.timestamp);
+    measurement_.proxi_front = readings_.proxi_front;
+    measurement_.proxi_back  = readings_.proxi_back;
+    pushMeasurement();
+  }
 #endif
+  uint32_t version = data_.getVersion(Channel::kSensorsKeyence);
+  if (version != keyence_version_) {
+    keyence_version_ = version;
+    readings_.keyence_stripe_counter = data_.getSensorsKeyenceData();
+    // the reading is as of the latest edge either keyence has seen
+    measurement_.type      = Measurement::kKeyence;
+    measurement_.timestamp = 0;
+    for (const StripeCounter& keyence : readings_.keyence_stripe_counter)
+      measurement_.timestamp = std::max(measurement_.timestamp, keyence.count.timestamp);
+    measurement_.keyence   = readings_.keyence_stripe_counter;
+    pushMeasurement();
+  }
+  version = data_.getVersion(Channel::kSensorsOpticalEncoder);
+  if (version != opt_enc_version_) {
+    opt_enc_version_ = version;
+    readings_.optical_enc_distance = data_.getSensorsOpticalEncoderData();
+    // optical encoder readings carry no timestamp, they are taken to be as old as the latest IMU
+    // sample
+    measurement_.type                 = Measurement::kOpticalEncoder;
+    measurement_.timestamp            = readings_.imu.timestamp;
+    measurement_.optical_enc_distance = readings_.optical_enc_distance;
+    pushMeasurement();
+  }
+  return num_imus;
+}
 
-inline bool Main::stripeCntChanged(const Sensors& old_data, const Sensors& new_data)
+void Main::pushMeasurement()
 {
-  for (int i = 0; i < Sensors::kNumKeyence; i++) {
-    if (new_data.keyence_stripe_counter[i].count.value != old_data.keyence_stripe_counter[i].count.value) //NOLINT
-      return true;
+  if (queue_.full()) {
+    // out of room: the earliest measurement goes to nav before its window has passed
+    log_.DBG("NAV", "Measurement queue full, applying %u early", queue_.earliest());
+    applyMeasurements(queue_.earliest());
   }
-
-  return false;
+  queue_.push(measurement_);
 }
 
-inline bool Main::opticalEncDistChanged(const Sensors& old_data, const Sensors& new_data)
+void Main::applyMeasurements(uint32_t until)
 {
-  for (int i = 0; i < Sensors::kNumOptEnc; i++) {
-    if (new_data.optical_enc_distance[i] != old_data.optical_enc_distance[i])
-      return true;
-  }
+  while (queue_.pop(until, &measurement_)) {
+    nav_.update(measurement_);
+    if (measurement_.type != Measurement::kImu) continue;
 
-  return false;
+    // every IMU sample is published, the other readings with the next one
+    updateData();
+    // timestamps are the low 32 bits of Timer::getTimeMicros(), the difference wraps around
+    latency_.record(static_cast<uint32_t>(Timer::getTimeMicros()) - measurement_.timestamp);
+    if (latency_.getCount() % kLatencyReportPeriod == 0) {
+      log_.DBG("NAV", "IMU to publication latency: p50 %u us, p99 %u us, max %u us",
+          latency_.getPercentile(0.5), latency_.getPercentile(0.99), latency_.getMax());
+    }
+  }
 }
 
 void Main::updateData()
@@ -200,7 +281,7 @@ void Main::updateData()
       nav_.acceleration_[0], nav_.acceleration_[1], nav_.acceleration_[2],
       nav_.velocity_.value[0], nav_.velocity_.value[1], nav_.velocity_.value[2],
       nav_.displacement_.value[0], nav_.displacement_.value[1], nav_.displacement_.value[2],
-      nav_.getBrakingDistance(), nav_.getEmergencyBrakingDistance(), nav_.num_gravity_samples_);
+      nav_data.braking_distance, nav_data.emergency_braking_distance, nav_.num_gravity_samples_);
 }
 
 }}  // namespace hyped::navigation
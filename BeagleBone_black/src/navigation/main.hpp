@@ -19,12 +19,15 @@
 #ifndef BEAGLEBONE_BLACK_NAVIGATION_MAIN_HPP_
 #define BEAGLEBONE_BLACK_NAVIGATION_MAIN_HPP_
 
+#include <array>
 #include <cstdint>
 
 #include "data/data.hpp"
+#include "navigation/measurement_queue.hpp"
 #include "navigation/navigation.hpp"
 #include "utils/concurrent/lock.hpp"
 #include "utils/concurrent/thread.hpp"
+#include "utils/math/histogram.hpp"
 
 namespace hyped {
 
@@ -32,26 +35,74 @@ using data::Sensors;
 using utils::concurrent::Lock;
 using utils::concurrent::Thread;
 using utils::Logger;
+using utils::math::Histogram;
 
 namespace navigation {
 
 class Main: public Thread {
  public:
+  // Enough for the IMU and all other channels to publish during a few reorder windows
+  static constexpr int kMeasurementQueueSize = 32;
+  // IMU samples taken from the history per wake-up, a longer backlog takes several
+  static constexpr int kMaxImuBatch = 16;
+  // The latency percentiles are logged once per this many IMU samples
+  static constexpr uint64_t kLatencyReportPeriod = 10000;
+
   Main(uint8_t id, Logger& log);
   void run() override;
   const Navigation::FullOutput& getAllNavData();
 
+  /**
+   * @brief Microseconds from the timestamp of each IMU sample to the publication of the
+   *        navigation data updated with it, including the reorder window, if any, that
+   *        measurements are held back by before they are applied. Safe to read from any thread.
+   */
+  const Histogram& getLatencyHistogram() const { return latency_; }
+
  private:
-  bool imuChanged(const Sensors& old_data, const Sensors& new_data);
-  bool proxiChanged(const Sensors& old_data, const Sensors& new_data);
-  inline bool stripeCntChanged(const Sensors& old_data, const Sensors& new_data);
-  inline bool opticalEncDistChanged(const Sensors& old_data, const Sensors& new_data);
+  /**
+   * @brief Marks the current version of every sensors channel as seen by fetchSensors()
+   */
+  void markSensorsSeen();
+  /**
+   * @brief Pushes every IMU sample published since the last call into the measurement queue,
+   *        at most kMaxImuBatch of them, and their timestamps into `imu_timestamps_`. Copies the
+   *        other sensors channels republished since the last call into `readings_` and pushes
+   *        them too. Other channels are not touched.
+   *
+   * @return number of new IMU samples
+   */
+  int fetchSensors();
+  // Pushes measurement_ into queue_, making room if it is full
+  void pushMeasurement();
+  // Passes the queued measurements up to `until` to nav_ in time order, publishes the navigation
+  // data after each IMU sample and records its latency
+  void applyMeasurements(uint32_t until);
   void updateData();
 
 
   data::Data& data_;
   Navigation nav_;
   Lock l_;
+
+  // Latest sensor readings and the versions of the channels they were read at
+  Sensors readings_;
+  // Readings waiting for the reorder window to pass; measurement_ is the scratch entry moved in
+  // and out of it
+  MeasurementQueue<kMeasurementQueueSize> queue_;
+  Measurement measurement_;
+  uint32_t imu_version_;
+  uint64_t imu_next_;         // number of the next IMU sample to take from the history
+  uint32_t num_imu_dropped_;  // overwritten in the history before they could be taken
+  std::array<DataPoint<DataPoint<Navigation::ImuArray>>, kMaxImuBatch> imu_samples_;
+  std::array<uint32_t, kMaxImuBatch> imu_timestamps_;
+  Histogram latency_;
+#ifdef PROXI
+  uint32_t proxi_front_version_;
+  uint32_t proxi_back_version_;
+#endif
+  uint32_t keyence_version_;
+  uint32_t opt_enc_version_;
 };
 
 }}  // namespace hyped::navigation
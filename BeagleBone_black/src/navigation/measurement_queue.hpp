@@ -0,0 +1,166 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Bounded queue of timestamped sensor measurements for navigation. Measurements from different
+ * sensors are published at different rates and with different delays; the queue hands them out
+ * in the order of their timestamps, equal timestamps in the order they were pushed. All storage
+ * is allocated with the queue, pushing and popping only moves slot indices around a binary heap.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_NAVIGATION_MEASUREMENT_QUEUE_HPP_
+#define BEAGLEBONE_BLACK_NAVIGATION_MEASUREMENT_QUEUE_HPP_
+
+#include <array>
+#include <cstdint>
+
+#include "data/data.hpp"
+
+namespace hyped {
+
+using data::DataPoint;
+using data::Imu;
+#ifdef PROXI
+using data::Proximity;
+#endif
+using data::Sensors;
+using data::StripeCounter;
+
+namespace navigation {
+
+/**
+ * @brief Reading of a single sensors channel. Only the field matching `type` is meaningful.
+ */
+struct Measurement {
+  enum Type : uint8_t {
+    kImu,
+    kKeyence,
+    kOpticalEncoder,
+#ifdef PROXI
+    kProximity,
+#endif
+  };
+
+  Type     type;
+  uint32_t timestamp;   // us, the queue orders by this
+  uint32_t sequence;    // set by the queue, breaks timestamp ties in push order
+
+  DataPoint<array<Imu, Sensors::kNumImus>>            imus;
+  array<StripeCounter, Sensors::kNumKeyence>          keyence;
+  array<float, Sensors::kNumOptEnc>                   optical_enc_distance;
+#ifdef PROXI
+  DataPoint<array<Proximity, Sensors::kNumProximities>> proxi_front;
+  DataPoint<array<Proximity, Sensors::kNumProximities>> proxi_back;
+#endif
+};
+
+template <int N>
+class MeasurementQueue {
+  static_assert(N > 0 && N <= 256, "slot indices are stored in a byte");
+
+ public:
+  static constexpr int kCapacity = N;
+
+  MeasurementQueue()
+      : size_(0),
+        next_sequence_(0)
+  {
+    for (int i = 0; i < N; ++i) heap_[i] = i;   // heap_[size_..N) lists the free slots
+  }
+
+  int  size()  const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full()  const { return size_ == N; }
+
+  /**
+   * @brief Timestamp of the earliest measurement, the queue must not be empty
+   */
+  uint32_t earliest() const { return slots_[heap_[0]].timestamp; }
+
+  /**
+   * @brief Copies `measurement` into the queue
+   *
+   * @return false if the queue is full, the measurement is then dropped
+   */
+  bool push(const Measurement& measurement)
+  {
+    if (full()) return false;
+    uint8_t slot = heap_[size_];
+    slots_[slot] = measurement;
+    slots_[slot].sequence = next_sequence_++;
+    siftUp(size_++);
+    return true;
+  }
+
+  /**
+   * @brief Moves the earliest measurement to `measurement` if its timestamp is at most `until`
+   *
+   * @return false if there is no such measurement
+   */
+  bool pop(uint32_t until, Measurement* measurement)
+  {
+    if (empty() || earliest() > until) return false;
+    uint8_t slot = heap_[0];
+    *measurement = slots_[slot];
+    heap_[0] = heap_[--size_];
+    heap_[size_] = slot;
+    siftDown(0);
+    return true;
+  }
+
+ private:
+  bool before(uint8_t a, uint8_t b) const
+  {
+    const Measurement& x = slots_[a];
+    const Measurement& y = slots_[b];
+    if (x.timestamp != y.timestamp) return x.timestamp < y.timestamp;
+    return static_cast<int32_t>(x.sequence - y.sequence) < 0;    // survives wrap-around
+  }
+
+  void siftUp(int i)
+  {
+    uint8_t slot = heap_[i];
+    while (i > 0 && before(slot, heap_[(i - 1) / 2])) {
+      heap_[i] = heap_[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap_[i] = slot;
+  }
+
+  void siftDown(int i)
+  {
+    uint8_t slot = heap_[i];
+    while (2*i + 1 < size_) {
+      int child = 2*i + 1;
+      if (child + 1 < size_ && before(heap_[child + 1], heap_[child])) child++;
+      if (!before(heap_[child], slot)) break;
+      heap_[i] = heap_[child];
+      i = child;
+    }
+    heap_[i] = slot;
+  }
+
+  std::array<Measurement, N> slots_;
+  std::array<uint8_t, N>     heap_;     // slot indices, a binary heap over [0, size_)
+  int      size_;
+  uint32_t next_sequence_;
+};
+
+template <int N>
+constexpr int MeasurementQueue<N>::kCapacity;
+
+}}  // namespace hyped::navigation
+
+#endif  // BEAGLEBONE_BLACK_NAVIGATION_MEASUREMENT_QUEUE_HPP_
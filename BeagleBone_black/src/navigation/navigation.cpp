@@ -19,19 +19,51 @@
 #include "navigation.hpp"
 
 #include <algorithm>  // std::min
+#include <limits>
 #include <map>
 #include <string>
 #include <sstream>
 
-#ifdef PROXI
-#include "Eigen/Dense"
-#include "Eigen/SVD"
-#endif
-
 namespace hyped {
 namespace navigation {
 
 const Navigation::Settings Navigation::kDefaultSettings;
+
+// Optical encoders
+// The velocity is measured over at least the minimum interval, so that the timestamps (of the
+// latest IMU sample) are precise enough, and not over more than the maximum
+constexpr NavigationType kOptEncMinInterval = 0.02;  // s
+constexpr NavigationType kOptEncMaxInterval = 0.1;   // s
+// The encoders are only fused once the scale is known to this variance, i.e. after a stripe
+constexpr NavigationType kOptEncMaxScaleVar = 1e-4;
+constexpr NavigationType kOptEncMinScaleDistance = 5;  // m between stripes to estimate the scale
+constexpr NavigationType kOptEncScaleDrift = 1e-4;  // added to the scale variance at each stripe
+constexpr NavigationType kOptEncVarAlpha = 0.05;  // weight of the newest innovation in variances
+constexpr NavigationType kOptEncMinVar = 1e-6;
+// The error of the stripe the displacement is measured from is shared by all the measurements up
+// to the next stripe, which the filter takes as independent, so it counts this many times over
+constexpr NavigationType kOptEncAnchorWeight = 10;
+
+Quaternion<NavigationType> tubeOrientation(const std::array<NavigationVector, 4>& ground_points,
+                                           const NavigationVector& rail_direction)
+{
+  // Unit normal n of the least-squares ground plane, pointing up
+  NavigationVector n = fitPlaneNormal(ground_points);
+  if (n[2] < 0)
+    n = -n;
+
+  // Calculate rejection of r on n and use cross product to complete the basis of tube ref. frame
+  const NavigationVector& r = rail_direction;
+  NavigationVector x = r - dot(r, n)*n;
+  x /= std::sqrt(dot(x, x));
+  NavigationVector y = cross(n, x);
+  y /= std::sqrt(dot(y, y));
+
+  // The opposite rotation to that of the tube frame
+  Quaternion<NavigationType> q = fromRotationMatrix(x, y, n);
+  for (int i = 1; i < 4; i++) q[i] = -q[i];
+  return q;
+}
 #ifdef PROXI
 float proxiMean(const Proximity* const a, const Proximity* const b)
 {
@@ -45,15 +77,22 @@ float proxiMean(const Proximity* const a, const Proximity* const b)
 }
 #endif
 
+constexpr const char* Navigation::kDefaultSettingsFile;
+
 Navigation::Navigation(Barrier& post_calibration_barrier,
                        Logger& log,
-                       std::string file_path)
+                       const Settings& settings,
+                       const TrackMap& track_map)
     : post_calibration_barrier_(post_calibration_barrier),
       log_(log),
+      settings_(settings),
+      track_map_(track_map),
       status_(ModuleStatus::kStart),
       is_calibrating_(false),
       num_gravity_samples_(0),
       num_gyro_samples_(0),
+      acc_offset_channels_(),
+      gyr_offset_channels_(),
       acceleration_(0),  // TODO(Brano): Should this be g or 0?
       velocity_(0, NavigationVector(0)),
       displacement_(0, NavigationVector(0)),
@@ -61,9 +100,25 @@ Navigation::Navigation(Barrier& post_calibration_barrier,
       prev_angular_velocity_(0 , NavigationVector()),
       orientation_(1, 0, 0, 0),
       acceleration_integrator_(&velocity_),
-      velocity_integrator_(&displacement_)
+      velocity_integrator_(&displacement_),
+      forward_initialised_(false),
+      forward_timestamp_(0),
+      forward_acc_var_(1),
+      forward_history_start_(0),
+      forward_history_size_(0),
+      imu_timestamp_(0),
+      imu_period_(0),
+      opt_enc_last_(0, 0),
+      opt_enc_window_(0, 0),
+      opt_enc_rate_(0),
+      opt_enc_scale_(1),
+      opt_enc_scale_var_(settings.opt_enc_scale_var),
+      opt_enc_anchor_(0),
+      opt_enc_anchor_displ_(0),
+      opt_enc_displ_var_(settings.opt_enc_displ_var),
+      opt_enc_vel_var_(settings.opt_enc_vel_var),
+      braking_distance_table_(BrakingDistanceTable::getInstance())
 {
-  readDataFromFile(file_path);
   out_.status              = &status_;
   out_.is_calibrating      = &is_calibrating_;
   out_.num_gravity_samples = &num_gravity_samples_;
@@ -77,7 +132,15 @@ Navigation::Navigation(Barrier& post_calibration_barrier,
   out_.orientation         = &orientation_;
 }
 
-void Navigation::readDataFromFile(std::string file_path)
+Navigation::Navigation(Barrier& post_calibration_barrier,
+                       Logger& log,
+                       std::string file_path,
+                       std::string track_map_path)
+    : Navigation(post_calibration_barrier, log, readSettings(file_path),
+                 TrackMap::readFile(track_map_path))
+{}
+
+Navigation::Settings Navigation::readSettings(std::string file_path)
 {
   std::map<std::string, float> map_settings;
   std::string variable_name;
@@ -97,11 +160,26 @@ void Navigation::readDataFromFile(std::string file_path)
   }
   file.close();
 
-  settings_.prox_orient_w = map_settings["prox_orient_w"];
-  settings_.prox_displ_w  = map_settings["prox_displ_w"];
-  settings_.strp_displ_w  = map_settings["strp_displ_w"];
-  settings_.prox_vel_w    = map_settings["prox_vel_w"];
-  settings_.strp_vel_w    = map_settings["strp_vel_w"];
+  Settings settings;
+  std::map<std::string, float Settings::*> fields = {
+    {"calib_acc_tol",  &Settings::calib_acc_tol},
+    {"calib_gyr_tol",  &Settings::calib_gyr_tol},
+    {"prox_orient_w",  &Settings::prox_orient_w},
+    {"prox_displ_w",   &Settings::prox_displ_w},
+    {"strp_displ_w",   &Settings::strp_displ_w},
+    {"prox_vel_w",     &Settings::prox_vel_w},
+    {"strp_vel_w",     &Settings::strp_vel_w},
+    {"jerk_var",       &Settings::jerk_var},
+    {"strp_displ_var", &Settings::strp_displ_var},
+    {"opt_enc_displ_var", &Settings::opt_enc_displ_var},
+    {"opt_enc_vel_var",   &Settings::opt_enc_vel_var},
+    {"opt_enc_scale_var", &Settings::opt_enc_scale_var},
+  };
+  for (const auto& field : fields) {
+    auto setting = map_settings.find(field.first);
+    if (setting != map_settings.end()) settings.*field.second = setting->second;
+  }
+  return settings;
 }
 
 NavigationType Navigation::getAcceleration() const
@@ -127,32 +205,7 @@ NavigationType Navigation::getEmergencyBrakingDistance() const
 
 NavigationType Navigation::getBrakingDistance() const
 {
-  // A polynomial fit for the braking distance at a specific (normalised) velocity, where
-  // kCoeffSlow for < 50m/s and kCoeffFast for > 50m/s because kCoeffFast is inaccurate
-  // at < 10m/s but they both agree between ~10 and ~50m/s.
-  static constexpr std::array<NavigationType, 16> kCoeffSlow = {
-       136.3132, 158.9403,  63.6093, -35.4894, -149.2755, 152.6967, 502.5464, -218.4689,
-      -779.534,   95.7285, 621.1013,  50.4598, -245.099,  -54.5,     38.0642,   12.3548};
-  static constexpr std::array<NavigationType, 16> kCoeffFast = {
-       258.6,  299.2,  115.2, -104.7, -260.9, 488.5, 940.8, -808.5, -1551.9,  551.7,
-      1315.7,  -61.4, -551.4,  -84.5,   90.7,  26.2};
-
-  NavigationType braking_distance = 2.0;
-  NavigationType var = 1.0;
-  if (getVelocity() < 50.0) {
-    NavigationType norm_v = (getVelocity() - 30.0079) / 17.2325;
-    for (unsigned int i = 0; i < kCoeffSlow.size(); ++i) {
-      braking_distance += kCoeffSlow[i] * var;
-      var *= norm_v;
-    }
-  } else {
-    NavigationType norm_v = (getVelocity() - 41.4985) / 23.5436;
-    for (unsigned int i = 0; i < kCoeffFast.size(); ++i) {
-      braking_distance += kCoeffFast[i] * var;
-      var *= norm_v;
-    }
-  }
-  return braking_distance;
+  return braking_distance_table_.lookup(getVelocity());
 }
 
 ModuleStatus Navigation::getStatus() const
@@ -194,19 +247,25 @@ bool Navigation::finishCalibration()
 
 void Navigation::init(SensorCalibration sc, Sensors readings)
 {
+  // Noise of a single IMU for the votes, averaged over the IMUs
+  float acc_var[3] = {0, 0, 0}, gyr_var[3] = {0, 0, 0};
   for (int i = 0; i < Sensors::kNumImus; i++) {
     // TODO(Brano,Uday): Properly initialise filters (with std dev of sensors and stuff)
-    acceleration_filter_[i].configure(readings.imu.value[i].acc,
-                                      sc.imu_variance[i][0].sqrt(),
-                                      NavigationVector(0.1));
-    gyro_filter_[i].configure(readings.imu.value[i].gyr,
-                              sc.imu_variance[i][1].sqrt(),
-                              NavigationVector(0.1));
+    for (int axis = 0; axis < 3; axis++) {
+      acceleration_filter_.configure(axis*Sensors::kNumImus + i, readings.imu.value[i].acc[axis],
+                                     std::sqrt(sc.imu_variance[i][0][axis]), 0.1);
+      gyro_filter_.configure(axis*Sensors::kNumImus + i, readings.imu.value[i].gyr[axis],
+                             std::sqrt(sc.imu_variance[i][1][axis]), 0.1);
+      acc_var[axis] += sc.imu_variance[i][0][axis] / Sensors::kNumImus;
+      gyr_var[axis] += sc.imu_variance[i][1][axis] / Sensors::kNumImus;
+    }
     log_.INFO("NAV",
               "IMU[%d]: accl variance = (%.3f, %.3f, %.3f), gyro variance = (%.3f, %.3f, %.3f)",
               i, sc.imu_variance[i][0][0], sc.imu_variance[i][0][1], sc.imu_variance[i][0][1],
               sc.imu_variance[i][1][0], sc.imu_variance[i][1][1], sc.imu_variance[i][1][1]);
   }
+  acceleration_vote_.configure(acc_var);
+  gyro_vote_.configure(gyr_var);
 #ifdef PROXI
   for (int i = 0; i < Sensors::kNumProximities; ++i) {
     proximity_filter_[i].configure(readings.proxi_front.value[i].val,
@@ -219,6 +278,17 @@ void Navigation::init(SensorCalibration sc, Sensors readings)
               i, sc.proxi_front_variance[i], sc.proxi_back_variance[i]);
   }
 #endif
+  // Noise of the forward acceleration averaged over all IMUs
+  forward_acc_var_ = 0;
+  for (int i = 0; i < Sensors::kNumImus; i++)
+    forward_acc_var_ += sc.imu_variance[i][0][0] / (Sensors::kNumImus * Sensors::kNumImus);
+  // The pod stands still at the start of the encoder displacement
+  opt_enc_last_ = DataPoint<NavigationType>(readings.imu.timestamp,
+      *std::max_element(readings.optical_enc_distance.begin(),
+                        readings.optical_enc_distance.end()));
+  opt_enc_window_       = opt_enc_last_;
+  opt_enc_anchor_       = opt_enc_last_.value;
+  opt_enc_anchor_displ_ = 0;
   log_.INFO("NAV", "Navigation initialised.");
   log_.DBG("NAV",
       "After init: a=(%.3f, %.3f, %.3f), v=(%.3f, %.3f, %.3f), d=(%.3f, %.3f, %.3f)",
@@ -230,12 +300,11 @@ void Navigation::init(SensorCalibration sc, Sensors readings)
 }
 
 
-std::array<NavigationType, 3> Navigation::getNearestStripeDists(uint16_t stripe_count)
+std::array<NavigationType, 3> Navigation::getNearestStripeDists(int stripe_count) const
 {
   std::array<NavigationType, 3> arr;
   for (unsigned int i = 0; i < arr.size(); ++i)
-    arr[i] = kStripeLocations[std::min(stripe_count + i, (unsigned int)kStripeLocations.size())]
-             - getDisplacement();
+    arr[i] = track_map_.getStripe(stripe_count + i) - getDisplacement();
   return arr;
 }
 
@@ -258,31 +327,62 @@ void Navigation::update(Input input)
   }
 }
 
-void Navigation::imuUpdate(DataPoint<ImuArray> imus)
+void Navigation::update(const Measurement& measurement)
 {
-  for (unsigned int i = 0; i < imus.value.size(); ++i) {
-    log_.DBG3("NAV", "Before filtering: a[%d]=(%.3f, %.3f, %.3f), omega[%d]=(%.3f, %.3f, %.3f)",
-        i, imus.value[i].acc[0], imus.value[i].acc[1], imus.value[i].acc[2],
-        i, imus.value[i].gyr[0], imus.value[i].gyr[1], imus.value[i].gyr[2]);
-
-    imus.value[i].acc = acceleration_filter_[i].filter(imus.value[i].acc);
-    if (settings_.gyro_enable) {
-      imus.value[i].gyr = gyro_filter_[i].filter(imus.value[i].gyr);
+  Input input;
+  switch (measurement.type) {
+    case Measurement::kImu:
+      input.imus = const_cast<DataPoint<ImuArray>*>(&measurement.imus);
+      break;
+    case Measurement::kKeyence:
+      input.sc = const_cast<StripeCounterArray*>(&measurement.keyence);
+      break;
+    case Measurement::kOpticalEncoder: {
+      DataPoint<array<float, Sensors::kNumOptEnc>> optical_enc_distance(
+          measurement.timestamp, measurement.optical_enc_distance);
+      input.optical_enc_distance = &optical_enc_distance;
+      update(input);
+      return;
     }
-
-    log_.DBG3("NAV", " After filtering: a[%d]=(%.3f, %.3f, %.3f), omega[%d]=(%.3f, %.3f, %.3f)",
-        i, imus.value[i].acc[0], imus.value[i].acc[1], imus.value[i].acc[2],
-        i, imus.value[i].gyr[0], imus.value[i].gyr[1], imus.value[i].gyr[2]);
+#ifdef PROXI
+    case Measurement::kProximity: {
+      ProximityArray proxis;
+      for (int i = 0; i < Sensors::kNumProximities; ++i) {
+        proxis[i] = const_cast<Proximity*>(&measurement.proxi_front.value[i]);
+        proxis[i + Sensors::kNumProximities] =
+            const_cast<Proximity*>(&measurement.proxi_back.value[i]);
+      }
+      input.proxis = &proxis;
+      update(input);
+      return;
+    }
+#endif
   }
+  update(input);
+}
 
+void Navigation::imuUpdate(DataPoint<ImuArray> imus)
+{
+  imu_period_    = imus.timestamp - imu_timestamp_;
+  imu_timestamp_ = imus.timestamp;
+
+  // Channel axis*kNumImus + i holds the axis of IMU i, the layout the votes take. The votes load
+  // the axes as vectors.
+  constexpr int kNumImus = Sensors::kNumImus;
+  alignas(16) NavigationType acc_channels[3*kNumImus];
+  alignas(16) NavigationType gyr_channels[3*kNumImus];
+  bool operational[kNumImus];
   int num_operational = 0;
-  NavigationVector acc(0), gyr(0);
-  for (unsigned int i = 0; i < imus.value.size(); ++i) {
-    if (imus.value[i].operational) {
-      ++num_operational;
-      acc += imus.value[i].acc - g_[i];
-      gyr += imus.value[i].gyr - gyro_offsets_[i];
+  for (int i = 0; i < kNumImus; ++i) {
+    const Imu& imu = imus.value[i];
+    log_.DBG3("NAV", "Before filtering: a[%d]=(%.3f, %.3f, %.3f), omega[%d]=(%.3f, %.3f, %.3f)",
+        i, imu.acc[0], imu.acc[1], imu.acc[2], i, imu.gyr[0], imu.gyr[1], imu.gyr[2]);
+    for (int axis = 0; axis < 3; axis++) {
+      acc_channels[axis*kNumImus + i] = imu.acc[axis];
+      gyr_channels[axis*kNumImus + i] = imu.gyr[axis];
     }
+    operational[i]   = imu.operational;
+    num_operational += imu.operational;
   }
 
   if (num_operational < 2) {
@@ -292,12 +392,34 @@ void Navigation::imuUpdate(DataPoint<ImuArray> imus)
       return;
   }
 
+  // Calibration needs the unfiltered samples: their variance is what its confidence intervals
+  // are based on
   if (is_calibrating_) {
     calibrationUpdate(imus.value);
-  } else {
-    accelerometerUpdate(DataPoint<NavigationVector>(imus.timestamp, acc/num_operational));
-    if (settings_.gyro_enable)
-             gyroUpdate(DataPoint<NavigationVector>(imus.timestamp, gyr/num_operational));
+  }
+
+  acceleration_filter_.filter(acc_channels);
+  if (settings_.gyro_enable) {
+    gyro_filter_.filter(gyr_channels);
+  }
+  for (int i = 0; i < kNumImus; ++i) {
+    log_.DBG3("NAV", " After filtering: a[%d]=(%.3f, %.3f, %.3f), omega[%d]=(%.3f, %.3f, %.3f)",
+        i, acc_channels[i], acc_channels[kNumImus + i], acc_channels[2*kNumImus + i],
+        i, gyr_channels[i], gyr_channels[kNumImus + i], gyr_channels[2*kNumImus + i]);
+  }
+  if (is_calibrating_)
+    return;
+
+  for (int k = 0; k < 3*kNumImus; ++k) {
+    acc_channels[k] -= acc_offset_channels_[k];
+    gyr_channels[k] -= gyr_offset_channels_[k];
+  }
+  NavigationVector acc, gyr;
+  acceleration_vote_.vote(acc_channels, operational, &acc[0]);
+  accelerometerUpdate(DataPoint<NavigationVector>(imus.timestamp, acc));
+  if (settings_.gyro_enable) {
+    gyro_vote_.vote(gyr_channels, operational, &gyr[0]);
+    gyroUpdate(DataPoint<NavigationVector>(imus.timestamp, gyr));
   }
 }
 #ifdef PROXI
@@ -338,29 +460,52 @@ void Navigation::calibrationUpdate(ImuArray imus)
   if ((num_gravity_samples_ % 5000) == 0)
     log_.INFO("NAV", "No. of gravity samples: %d", num_gravity_samples_);
 
-  // Online mean algorithm
+  // Online mean and variance algorithm
   ++num_gyro_samples_;
   ++num_gravity_samples_;
   for (unsigned int i = 0; i < data::Sensors::kNumImus; ++i) {
-    g_[i] = g_[i] + (imus[i].acc - g_[i])/num_gravity_samples_;
-    gyro_offsets_[i] = gyro_offsets_[i] + (imus[i].gyr - gyro_offsets_[i])/num_gyro_samples_;
+    gravity_stats_[i].update(imus[i].acc);
+    gyro_stats_[i].update(imus[i].gyr);
+    g_[i]            = gravity_stats_[i].getMean();
+    gyro_offsets_[i] = gyro_stats_[i].getMean();
+    for (int axis = 0; axis < 3; axis++) {
+      acc_offset_channels_[axis*Sensors::kNumImus + i] = g_[i][axis];
+      gyr_offset_channels_[axis*Sensors::kNumImus + i] = gyro_offsets_[i][axis];
+    }
   }
 
-  if (num_gravity_samples_ > kMinNumCalibrationSamples
-      && num_gyro_samples_ > kMinNumCalibrationSamples)
+  if (status_ != ModuleStatus::kReady && isCalibrationConverged()) {
+    log_.INFO("NAV", "Calibration finished after %d samples", num_gravity_samples_);
     status_ = ModuleStatus::kReady;
+  }
 }
 
-void Navigation::gyroUpdate(DataPoint<NavigationVector> angular_velocity)
+bool Navigation::isCalibrationConverged() const
 {
-  double theta             = prev_angular_velocity_.value.norm();
-  double angle_of_rotation = (angular_velocity.timestamp - prev_angular_velocity_.timestamp)
-                             * theta/2;
-  double scalar_part  = cos(angle_of_rotation);
-  auto   vector_part  = (prev_angular_velocity_.value/theta)*sin(angle_of_rotation);
+  if (num_gravity_samples_ < settings_.calib_min_samples) return false;
+  if (num_gravity_samples_ >= settings_.calib_max_samples) return true;
+
+  // The 95% confidence interval of a mean of n samples is +-1.96 sqrt(variance/n)
+  constexpr double kZ = 1.96;
+  double n = num_gravity_samples_;
+  double max_acc_var = settings_.calib_acc_tol*settings_.calib_acc_tol * n / (kZ*kZ);
+  double max_gyr_var = settings_.calib_gyr_tol*settings_.calib_gyr_tol * n / (kZ*kZ);
+  for (unsigned int i = 0; i < data::Sensors::kNumImus; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      if (gravity_stats_[i].getVariance()[axis] > max_acc_var) return false;
+      if (settings_.gyro_enable && gyro_stats_[i].getVariance()[axis] > max_gyr_var) return false;
+    }
+  }
+  return true;
+}
 
-  Quaternion<int16_t> rotation_quaternion(scalar_part, vector_part);
-  orientation_          *= rotation_quaternion;
+void Navigation::gyroUpdate(DataPoint<NavigationVector> angular_velocity)
+{
+  // Rotation since the previous reading at the previous rate, timestamps are in us
+  NavigationType dt = (angular_velocity.timestamp - prev_angular_velocity_.timestamp) * 1e-6;
+  SimdQuaternion orientation(orientation_);
+  orientation.rotate(prev_angular_velocity_.value * dt);
+  orientation_           = orientation.toQuaternion();
   prev_angular_velocity_ = angular_velocity;
 }
 
@@ -376,12 +521,16 @@ void Navigation::accelerometerUpdate(DataPoint<NavigationVector> acceleration)
   acceleration_ = acceleration.value;
   acceleration_integrator_.update(acceleration);  // Updates velocity
   velocity_integrator_.update(velocity_);  // Updates displacement
+  if (settings_.kalman_enable)
+    forwardImuUpdate(DataPoint<NavigationType>(acceleration.timestamp, acceleration.value[0]));
 
-  auto dists = getNearestStripeDists(stripe_count_);
-  if (std::abs(dists[2]) < std::abs(dists[1])) {
-    if (status_ != ModuleStatus::kCriticalFailure)
+  // Being nearer to the stripe after next than to the next one means a stripe went unseen
+  if (track_map_.getNearestStripe(getDisplacement()) > stripe_count_ + 1) {
+    if (status_ != ModuleStatus::kCriticalFailure) {
+      auto dists = getNearestStripeDists(stripe_count_);
       log_.ERR("NAV", "Critical failure: missed stripe (oldCnt=%d, nearestStripes=[%f, %f, %f])",
             stripe_count_, dists[0], dists[1], dists[2]);
+    }
     status_ = ModuleStatus::kCriticalFailure;
   }
 
@@ -395,10 +544,12 @@ void Navigation::accelerometerUpdate(DataPoint<NavigationVector> acceleration)
 void Navigation::proximityOrientationUpdate(Proximities ground, Proximities rail)
 {
   // Ground points
-  NavigationVector a = kGroundProxiRR;     a[2] -= ground.rr;
-  NavigationVector b = kGroundProxiFR;     b[2] -= ground.fr;
-  NavigationVector c = kGroundProxiFL;     c[2] -= ground.fl;
-  NavigationVector d = kGroundProxiRL;     d[2] -= ground.rl;
+  std::array<NavigationVector, 4> ground_points = {{
+      kGroundProxiRR, kGroundProxiFR, kGroundProxiFL, kGroundProxiRL}};
+  ground_points[0][2] -= ground.rr;
+  ground_points[1][2] -= ground.fr;
+  ground_points[2][2] -= ground.fl;
+  ground_points[3][2] -= ground.rl;
 
   // Rail points
   NavigationVector e_l = kRailProxiRL;     e_l[1] -= rail.rl;
@@ -407,41 +558,11 @@ void Navigation::proximityOrientationUpdate(Proximities ground, Proximities rail
   NavigationVector f_r = kRailProxiFR;     f_r[1] += rail.fr;
 
   // Vector EF in the vertical plane of the I beam
-  NavigationVector temp_r = (f_l + f_r)/2 - (e_l + e_r)/2;
-  Eigen::Vector3d r(temp_r[0], temp_r[1], temp_r[2]);
-
-  // Calculate the normal n of the ground plane given by a, b, c, and d
-  Eigen::Matrix<double, 3, 4> m;
-  m << a[0], b[0], c[0], d[0],
-       a[1], b[1], c[1], d[1],
-       a[2], b[2], c[2], d[2];
-
-  Eigen::JacobiSVD<Eigen::Matrix<double, 3, 4>> svd(m, Eigen::ComputeFullU);
-  Eigen::Vector3d n = svd.matrixU().col(svd.matrixU().cols() - 1);
-  if (n(2) < 0.0)
-    n = -n;
-
-  // Calculate rejection of r on n and use cross product to complete the basis of tube ref. frame
-  Eigen::Vector3d x = r - r.dot(n)/n.dot(n)*n;
-  x /= x.norm();
-  Eigen::Vector3d y = n.cross(x);
-  y /= y.norm();
-  Eigen::Vector3d z = n/n.norm();
-  Eigen::Matrix3d rot;
-  rot << x, y, z;
-
-  // Calculate orientation quaternion
-  Eigen::Quaternion<double> q(rot);
-  q = q.conjugate();  // We want the opposite rotation
-  Eigen::Quaternion<double> orientation(
-      orientation_[0], orientation_[1], orientation_[2], orientation_[3]);
+  NavigationVector r = (f_l + f_r)/2 - (e_l + e_r)/2;
 
   // SLERP (weighted average of the two orientation estimates)
-  orientation = q.slerp(settings_.prox_orient_w, orientation);
-  orientation_[0] = orientation.w();
-  orientation_[1] = orientation.x();
-  orientation_[2] = orientation.y();
-  orientation_[3] = orientation.z();
+  orientation_ = slerp(tubeOrientation(ground_points, r), orientation_,
+                       static_cast<NavigationType>(settings_.prox_orient_w));
 }
 
 
@@ -515,9 +636,9 @@ void Navigation::stripeCounterUpdate(StripeCounterArray scs)
     return;
   }
 
-  uint16_t timestamp;
+  uint32_t timestamp;
   if (scs[0].count.value == scs[1].count.value) {
-    auto dists = getNearestStripeDists(scs[0].count.value - 1);
+    auto dists = getNearestStripeDists(static_cast<int>(scs[0].count.value) - 1);
     if (std::abs(dists[0]) < std::abs(dists[1]) || std::abs(dists[2]) < std::abs(dists[1])) {
       // Ideally, we'd have dists[1]==0 but if dists[1] is not the closest stripe, something has
       // definitely gone wrong.
@@ -534,8 +655,8 @@ void Navigation::stripeCounterUpdate(StripeCounterArray scs)
   } else {
     // Distance given by the current stripe should match distance, therefore the dists array should
     // provide [-ve, ~0, +ve] if the stripe count and distance are in agreement
-    auto dists_l = getNearestStripeDists(scs[0].count.value - 1);
-    auto dists_r = getNearestStripeDists(scs[1].count.value - 1);
+    auto dists_l = getNearestStripeDists(static_cast<int>(scs[0].count.value) - 1);
+    auto dists_r = getNearestStripeDists(static_cast<int>(scs[1].count.value) - 1);
     if (std::abs(dists_l[0]) < std::abs(dists_l[1]) ||
         std::abs(dists_l[2]) < std::abs(dists_l[1]) ||
         scs[0].count.value == 0) {
@@ -567,11 +688,16 @@ void Navigation::stripeCounterUpdate(StripeCounterArray scs)
     }
   }
 
-  DataPoint<NavigationType> dp(timestamp, kStripeLocations[stripe_count_]);
+  DataPoint<NavigationType> dp(timestamp, track_map_.getStripe(stripe_count_));
 
   // Update x-axis (forwards) displacement
-  displacement_.value[0] = (1 - settings_.strp_displ_w) * displacement_.value[0] +
-                          settings_.strp_displ_w  * dp.value;
+  if (settings_.kalman_enable) {
+    forwardStripeUpdate(dp);
+    if (settings_.opt_enc_enable) opticalEncoderStripe(dp);
+  } else {
+    displacement_.value[0] = (1 - settings_.strp_displ_w) * displacement_.value[0] +
+                            settings_.strp_displ_w  * dp.value;
+  }
 
   // Update x-axis velocity
   // velocity_.value[0] = (1 - settings_.strp_vel_w) * velocity_.value[0] +
@@ -584,9 +710,212 @@ void Navigation::stripeCounterUpdate(StripeCounterArray scs)
       displacement_.value[0], displacement_.value[1], displacement_.value[2]);
 }
 
-void Navigation::opticalEncoderUpdate(array<float, Sensors::kNumOptEnc> optical_enc_distance)
+void Navigation::opticalEncoderUpdate(
+    DataPoint<array<float, Sensors::kNumOptEnc>> optical_enc_distance)
+{
+  // A wheel that slips or an encoder that fails counts too little, never too much
+  const array<float, Sensors::kNumOptEnc>& distances = optical_enc_distance.value;
+  NavigationType distance = *std::max_element(distances.begin(), distances.end());
+  if (distance == opt_enc_last_.value) return;
+
+  // The distance is exact when it changes. The velocity is the mean over a window of changes,
+  // windows do not overlap so that their errors are independent.
+  uint32_t timestamp = optical_enc_distance.timestamp;
+  opt_enc_last_      = DataPoint<NavigationType>(timestamp, distance);
+  NavigationType dt  = (timestamp - opt_enc_window_.timestamp) * 1e-6;
+  bool has_velocity  = dt >= kOptEncMinInterval && dt <= kOptEncMaxInterval;
+  if (has_velocity) opt_enc_rate_ = (distance - opt_enc_window_.value) / dt;
+  if (dt >= kOptEncMinInterval) opt_enc_window_ = opt_enc_last_;
+  // Until the scale has been measured the slip could be anything
+  if (!settings_.kalman_enable || !forward_initialised_ || opt_enc_scale_var_ > kOptEncMaxScaleVar)
+    return;
+
+  // In track metres. The distance changed at some point since the previous IMU sample, on
+  // average half an IMU period before the timestamp, and the velocity is half a window old.
+  const ForwardFilter::StateVector& x = forward_filter_.getState();
+  const ForwardFilter::StateMatrix& P = forward_filter_.getCovariance();
+  NavigationType period    = std::min<NavigationType>(imu_period_ * 1e-6, kOptEncMinInterval);
+  NavigationType speed     = opt_enc_scale_*opt_enc_rate_;
+  NavigationType travelled = distance - opt_enc_anchor_;
+  NavigationType displ     = opt_enc_anchor_displ_ + opt_enc_scale_*travelled + speed*period/2;
+  NavigationType velocity  = speed + x(2)*dt/2;
+  // Variances of the scale, of the time of the change (uniform over the IMU period) and of the
+  // stripe the displacement is measured from
+  NavigationType timing_var      = speed*speed*period*period/12;
+  NavigationType displ_scale_var = opt_enc_scale_var_*travelled*travelled + timing_var
+                                   + kOptEncAnchorWeight*settings_.strp_displ_var;
+  NavigationType vel_scale_var   = opt_enc_scale_var_*opt_enc_rate_*opt_enc_rate_
+                                   + (has_velocity ? 2*timing_var/(dt*dt) : 0);
+
+  // A squared innovation is on average the variance of the filter plus that of the measurement,
+  // which is the uncertainty of the scale plus the variance estimated here
+  NavigationType r = displ - x(0);
+  opt_enc_displ_var_ += kOptEncVarAlpha*(r*r - P(0, 0) - displ_scale_var - opt_enc_displ_var_);
+  opt_enc_displ_var_  = std::max(opt_enc_displ_var_, kOptEncMinVar);
+  NavigationType vel_var = std::numeric_limits<NavigationType>::infinity();
+  if (has_velocity) {
+    r = velocity - x(1);
+    opt_enc_vel_var_ += kOptEncVarAlpha*(r*r - P(1, 1) - vel_scale_var - opt_enc_vel_var_);
+    opt_enc_vel_var_  = std::max(opt_enc_vel_var_, kOptEncMinVar);
+    vel_var = opt_enc_vel_var_ + vel_scale_var;
+  }
+  log_.DBG3("NAV", "Optical encoders: d=%.3f m (var %.2e), v=%.3f m/s (var %.2e), scale %.4f",
+      displ, opt_enc_displ_var_ + displ_scale_var, velocity, vel_var, opt_enc_scale_);
+  forwardOpticalEncoderUpdate(DataPoint<NavigationType>(timestamp, displ),
+                              opt_enc_displ_var_ + displ_scale_var, velocity, vel_var);
+}
+
+void Navigation::opticalEncoderStripe(DataPoint<NavigationType> stripe)
+{
+  // Encoder distance when the stripe was seen, from the last change at the last rate
+  NavigationType dt = static_cast<int32_t>(stripe.timestamp - opt_enc_last_.timestamp) * 1e-6;
+  dt = std::max(-kOptEncMaxInterval, std::min(dt, kOptEncMaxInterval));
+  NavigationType distance  = opt_enc_last_.value + opt_enc_rate_*dt;
+  NavigationType travelled = distance - opt_enc_anchor_;
+
+  if (travelled >= kOptEncMinScaleDistance) {
+    // Scalar Kalman filter of the scale, which drifts as the slip changes with the acceleration
+    NavigationType ratio     = (stripe.value - opt_enc_anchor_displ_) / travelled;
+    NavigationType ratio_var = 2*settings_.strp_displ_var / (travelled*travelled);
+    opt_enc_scale_var_ += kOptEncScaleDrift;
+    NavigationType gain = opt_enc_scale_var_ / (opt_enc_scale_var_ + ratio_var);
+    opt_enc_scale_     += gain*(ratio - opt_enc_scale_);
+    opt_enc_scale_var_ *= 1 - gain;
+    log_.DBG2("NAV", "Optical encoder scale %.4f (std dev %.4f) after stripe at %.2f m",
+        opt_enc_scale_, std::sqrt(opt_enc_scale_var_), stripe.value);
+  }
+  opt_enc_anchor_       = distance;
+  opt_enc_anchor_displ_ = stripe.value;
+}
+
+void Navigation::forwardImuUpdate(DataPoint<NavigationType> acceleration)
+{
+  if (!forward_initialised_) {
+    // Starts from the calibrated standstill, only the acceleration is uncertain
+    ForwardFilter::StateVector x(displacement_.value[0], velocity_.value[0], acceleration.value);
+    ForwardFilter::StateMatrix P = ForwardFilter::StateMatrix::Zero();
+    P(2, 2) = forward_acc_var_;
+    forward_filter_.configure(x, P);
+    forward_timestamp_     = acceleration.timestamp;
+    forward_history_size_  = 0;
+    forward_initialised_   = true;
+  }
+
+  ForwardUpdate update;
+  update.timestamp = acceleration.timestamp;
+  update.kind      = ForwardUpdate::kAcceleration;
+  update.value     = acceleration.value;
+  update.variance  = forward_acc_var_;
+  forwardInsert(update);
+}
+
+void Navigation::forwardStripeUpdate(DataPoint<NavigationType> stripe)
+{
+  if (!forward_initialised_) return;
+
+  ForwardUpdate update;
+  update.timestamp = stripe.timestamp;
+  update.kind      = ForwardUpdate::kStripe;
+  update.value     = stripe.value;
+  update.variance  = settings_.strp_displ_var;
+  forwardInsert(update);
+}
+
+void Navigation::forwardOpticalEncoderUpdate(DataPoint<NavigationType> displacement,
+                                             NavigationType displacement_variance,
+                                             NavigationType velocity,
+                                             NavigationType velocity_variance)
+{
+  if (!forward_initialised_) return;
+
+  ForwardUpdate update;
+  update.timestamp         = displacement.timestamp;
+  update.kind              = ForwardUpdate::kOpticalEncoder;
+  update.value             = displacement.value;
+  update.variance          = displacement_variance;
+  update.velocity          = velocity;
+  update.velocity_variance = velocity_variance;
+  forwardInsert(update);
+}
+
+void Navigation::forwardInsert(ForwardUpdate update)
+{
+  // Almost always the newest measurement: no rollback
+  int i = forward_history_size_;
+  while (i > 0 && forwardHistory(i - 1).timestamp > update.timestamp) i--;
+
+  if (i == 0 && forward_history_size_ > 0) {
+    log_.DBG1("NAV", "Measurement at %u older than the forward history, applied at %u",
+        update.timestamp, forward_timestamp_);
+    update.timestamp = forward_timestamp_;
+    i = forward_history_size_;
+  } else if (i < forward_history_size_) {
+    // Roll back to the update just before this one
+    const ForwardUpdate& previous = forwardHistory(i - 1);
+    forward_filter_.configure(previous.x, previous.P);
+    forward_timestamp_ = previous.timestamp;
+  }
+
+  // Make room at i, dropping the oldest update if the history is full
+  if (forward_history_size_ == kForwardHistorySize) {
+    forward_history_start_ = (forward_history_start_ + 1) % kForwardHistorySize;
+    forward_history_size_--;
+    i--;
+  }
+  forward_history_size_++;
+  for (int j = forward_history_size_ - 1; j > i; --j) forwardHistory(j) = forwardHistory(j - 1);
+  forwardHistory(i) = update;
+
+  for (; i < forward_history_size_; ++i) forwardApply(&forwardHistory(i));
+  publishForwardState();
+}
+
+void Navigation::forwardApply(ForwardUpdate* update)
+{
+  // Constant acceleration model driven by white jerk noise
+  NavigationType dt = (update->timestamp - forward_timestamp_) / 1e6;
+  NavigationType q  = settings_.jerk_var;
+  ForwardFilter::StateMatrix F, Q;
+  F << 1, dt, dt*dt/2,
+       0,  1, dt,
+       0,  0, 1;
+  Q << dt*dt*dt*dt*dt/20, dt*dt*dt*dt/8, dt*dt*dt/6,
+       dt*dt*dt*dt/8,     dt*dt*dt/3,    dt*dt/2,
+       dt*dt*dt/6,        dt*dt/2,       dt;
+  forward_filter_.predict(F, q*Q);
+  forward_timestamp_ = update->timestamp;
+
+  ForwardFilter::Column<1>    z(update->value);
+  ForwardFilter::Matrix<1, 1> R(update->variance);
+  bool has_velocity = update->kind == ForwardUpdate::kOpticalEncoder
+                      && !std::isinf(update->velocity_variance);
+  if (update->kind == ForwardUpdate::kAcceleration) {
+    ForwardFilter::Matrix<1, 3> H(0, 0, 1);
+    forward_filter_.update(z, H, R);
+  } else if (has_velocity) {
+    ForwardFilter::Column<2>    z2(update->value, update->velocity);
+    ForwardFilter::Matrix<2, 3> H2;
+    ForwardFilter::Matrix<2, 2> R2;
+    H2 << 1, 0, 0,
+          0, 1, 0;
+    R2 << update->variance, 0,
+          0, update->velocity_variance;
+    forward_filter_.update(z2, H2, R2);
+  } else {
+    // a stripe or an encoder displacement
+    ForwardFilter::Matrix<1, 3> H(1, 0, 0);
+    forward_filter_.update(z, H, R);
+  }
+  update->x = forward_filter_.getState();
+  update->P = forward_filter_.getCovariance();
+}
+
+void Navigation::publishForwardState()
 {
-  // TODO(anyone): implement
+  const ForwardFilter::StateVector& x = forward_filter_.getState();
+  displacement_.value[0] = x(0);
+  velocity_.value[0]     = x(1);
+  acceleration_[0]       = x(2);
 }
 
 }}  // namespace hyped::navigation
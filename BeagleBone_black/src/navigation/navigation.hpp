@@ -26,14 +26,22 @@
 #include <fstream>
 
 #include "data/data.hpp"
+#include "navigation/braking_distance.hpp"
+#include "navigation/measurement_queue.hpp"
+#include "navigation/track_map.hpp"
 #include "utils/concurrent/barrier.hpp"
 #include "utils/logger.hpp"
 #include "utils/math/differentiator.hpp"
 #include "utils/math/integrator.hpp"
 #include "utils/math/kalman.hpp"
+#include "utils/math/kalman_bank.hpp"
+#include "utils/math/kalman_filter.hpp"
+#include "utils/math/plane_fit.hpp"
 #include "utils/math/quaternion.hpp"
+#include "utils/math/sensor_vote.hpp"
+#include "utils/math/simd_quaternion.hpp"
+#include "utils/math/statistics.hpp"
 #include "utils/math/vector.hpp"
-#include "utils/system.hpp"
 
 namespace hyped {
 
@@ -53,9 +61,14 @@ using utils::Logger;
 using utils::math::Differentiator;
 using utils::math::Integrator;
 using utils::math::Kalman;
+using utils::math::KalmanBank;
+using utils::math::KalmanFilter;
+using utils::math::fitPlaneNormal;
+using utils::math::OnlineStatistics;
 using utils::math::Quaternion;
+using utils::math::SensorVote;
+using utils::math::SimdQuaternion;
 using utils::math::Vector;
-using utils::System;
 
 namespace navigation {
 
@@ -71,12 +84,14 @@ const NavigationVector kRailProxiRL({-2,  0.1, -0.1});
 const NavigationVector kRailProxiRR({-2, -0.1, -0.1});
 
 constexpr NavigationType kEmergencyDeceleration = 24;  // m/s^2
-constexpr std::array<NavigationType, 42> kStripeLocations = {0.0,
-      30.48,   60.96,   91.44,  121.92,  152.4,  182.88,  213.36,  243.84,  274.32,  304.8,
-     335.28,  365.76,  396.24,  426.72,  457.2,  487.68,  518.16,  548.64,  579.12,  609.6,
-     640.08,  670.56,  701.04,  731.52,  762.0,  792.48,  822.96,  853.44,  883.92,  914.4,
-     944.88,  975.36, 1005.84, 1036.32, 1066.8, 1097.28, 1127.76, 1158.24, 1188.72, 1219.2,
-    1249.68};
+
+/**
+ * @brief Orientation of the pod w.r.t. the tube frame, whose z-axis is the normal of the ground
+ *        plane fitted through `ground_points` and whose x-axis is `rail_direction` projected onto
+ *        that plane. Both are in the pod frame.
+ */
+Quaternion<NavigationType> tubeOrientation(const std::array<NavigationVector, 4>& ground_points,
+                                           const NavigationVector& rail_direction);
 
 class Navigation {
   friend class Main;
@@ -87,28 +102,52 @@ class Navigation {
   typedef std::array<Proximity*,    2*Sensors::kNumProximities> ProximityArray;
 #endif
   typedef std::array<StripeCounter, Sensors::kNumKeyence>       StripeCounterArray;
+  // Calibration never takes more IMU samples than this
+  static constexpr int kMaxNumCalibrationSamples = 200000;
+  // Forward filter updates kept to fuse late stripes at their own time, 64 ms at 1 kHz
+  static constexpr int kForwardHistorySize = 64;
   struct Settings {
 #ifdef PROXI
     bool proxi_displ_enable = false;  // Needs updated proxi positions
     bool proxi_orient_enable = false;  // Needs updated proxi positions
 #endif
     bool gyro_enable = false;  // Not fully implemented (rotate a)
-    bool opt_enc_enable = false;  // Not implemented
+    bool opt_enc_enable = false;  // Needs the encoder wheels mounted and kalman_enable
     bool keyence_enable = true;
+    bool kalman_enable = true;  ///< Forward motion from the [x, v, a] filter, not the weights
     // TODO(Brano): Change the default values
     float prox_orient_w = 0.1;  ///< Weight (from [0,1]) of proxi vs imu in orientation calculation
     float prox_displ_w = 0.1;  ///< Weight (from [0,1]) of proxi vs imu in displacement calculation
     float strp_displ_w = 1.0;  ///< Weight [0,1] of stripe count vs imu in displacement calculation
     float prox_vel_w = 0.01;  ///< Weight (from [0,1]) of proxi vs imu in velocity calculation
     float strp_vel_w = 0.0;  ///< Weight [0,1]  of stripe count vs imu in velocity calculation
+    float jerk_var = 100.0;  ///< Process noise of the forward filter, (m/s^3)^2 per s
+    float strp_displ_var = 0.01;  ///< Variance (m^2) of the position at which stripes are seen
+    // Initial variances of the optical encoders, updated online from how well they agree with
+    // the forward filter
+    float opt_enc_displ_var = 0.01;  ///< Of the displacement since the last stripe, m^2
+    float opt_enc_vel_var = 0.01;  ///< Of the velocity, (m/s)^2
+    float opt_enc_scale_var = 0.0025;  ///< Of the initial slip scale (1 = no slip)
+    // Calibration finishes once the 95% confidence intervals of all gravity (and, if the gyros
+    // are enabled, gyro offset) estimates are narrower than +-tolerance
+    float calib_acc_tol = 0.005;  ///< Tolerance of the gravity estimates, m/s^2
+    float calib_gyr_tol = 0.001;  ///< Tolerance of the gyro offsets, rad/s
+    int calib_min_samples = 1000;  ///< Calibration takes at least this many IMU samples...
+    int calib_max_samples = kMaxNumCalibrationSamples;  ///< ...and at most this many
+    // Measurements are held back this long (us) behind the newest IMU sample so that readings
+    // published late are still applied in time order; later ones need a rollback of the filter.
+    // The rollback ends where the readings in order do, so by default nothing is held back and
+    // every IMU sample is applied as soon as it is fetched.
+    uint32_t reorder_window = 0;
   };
+
   struct Input {
     DataPoint<ImuArray> *imus = nullptr;
 #ifdef PROXI
     ProximityArray *proxis = nullptr;
 #endif
     StripeCounterArray *sc = nullptr;
-    array<float, Sensors::kNumOptEnc> *optical_enc_distance = nullptr;
+    DataPoint<array<float, Sensors::kNumOptEnc>> *optical_enc_distance = nullptr;
   };
   struct FullOutput {
     const ModuleStatus*     status;
@@ -135,10 +174,31 @@ class Navigation {
    * @param post_calibration_barrier Navigation module will wait on this barrier at the end of the
    *                                 transition to 'operational' state. It is primarily meant for
    *                                 syncing with motors module.
+   * @param log                      Logger for all nav messages
+   * @param settings                 Sensor fusion settings
+   * @param track_map                Stripe positions of the track
+   */
+  Navigation(Barrier& post_calibration_barrier, Logger& log, const Settings& settings,
+             const TrackMap& track_map = TrackMap());
+
+  /**
+   * @brief Construct a new Navigation object with the fusion weights read from a settings file
+   *        and the stripes from a track map file
    */
   Navigation(Barrier& post_calibration_barrier,
-             Logger& log = System::getLogger(),
-             std::string file_path = "../BeagleBone_black/data/configuration/NavSettings.txt");
+             Logger& log,
+             std::string file_path = kDefaultSettingsFile,
+             std::string track_map_path = TrackMap::kDefaultTrackMapFile);
+
+  /**
+   * @brief Reads the fusion weights from a settings file, the other settings keep their default
+   *
+   * @param file_path  File with one "<name> <value>" pair per line
+   */
+  static Settings readSettings(std::string file_path);
+
+  static constexpr const char* kDefaultSettingsFile =
+      "../BeagleBone_black/data/configuration/NavSettings.txt";
 
   /**
    * @brief Get the acceleration value
@@ -206,6 +266,10 @@ class Navigation {
    */
   void init(SensorCalibration sc, Sensors readings);
   void update(Input);
+  /**
+   * @brief Applies a single measurement, e.g. the next one out of a MeasurementQueue
+   */
+  void update(const Measurement& measurement);
 
  private:
   /**
@@ -222,17 +286,19 @@ class Navigation {
   };
 #endif
 
-  static constexpr int kMinNumCalibrationSamples = 200000;
   static const Settings kDefaultSettings;
+  // Forward (x-axis) motion, state [displacement, velocity, acceleration]
+  typedef KalmanFilter<3, NavigationType> ForwardFilter;
   /**
    * @brief Calculates distance to the given stripe, the next stripe and the one after that.
    *
    * @param  stripe_count  Number of stripes.
    * @return std::array<NavigationType, 3> Index 0 contains distance to last stripe (should be
    *                                       negative); indices 1 and 2 contain distances to the
-   *                                       next 2 stripes (both should be positive).
+   *                                       next 2 stripes (both should be positive). Stripes
+   *                                       beyond either end of the track are infinitely far.
    */
-  std::array<NavigationType, 3> getNearestStripeDists(uint16_t stripe_count);
+  std::array<NavigationType, 3> getNearestStripeDists(int stripe_count) const;
 
   /**
    * @brief Updates navigation based on new IMU and stripe counter readings. Should be called when
@@ -248,6 +314,8 @@ class Navigation {
   void proximityUpdate(ProximityArray proxis);
 #endif
   void calibrationUpdate(ImuArray imus);
+  // Whether the calibration has enough samples for the tolerances of settings_
+  bool isCalibrationConverged() const;
   void gyroUpdate(DataPoint<NavigationVector> angular_velocity);  // Point number 1
   void accelerometerUpdate(DataPoint<NavigationVector> acceleration);  // Points 3, 4, 5, 6
 #ifdef PROXI
@@ -255,13 +323,69 @@ class Navigation {
   void proximityDisplacementUpdate(Proximities ground, Proximities rail);  // Point number 7
 #endif
   void stripeCounterUpdate(StripeCounterArray scs);  // Point number 7
-  void opticalEncoderUpdate(array<float, Sensors::kNumOptEnc> optical_enc_distance);
-  void readDataFromFile(std::string file_path);
+  /**
+   * @brief Corrects the forward filter with the displacement and velocity of the optical encoders,
+   *        taken when their distance changes. Encoder metres are converted to track metres by a
+   *        slip scale estimated at the stripes, and the variances of both measurements follow how
+   *        far they are from the filter.
+   *
+   * @param optical_enc_distance  Distance counted by each encoder
+   */
+  void opticalEncoderUpdate(DataPoint<array<float, Sensors::kNumOptEnc>> optical_enc_distance);
+  // Re-estimates the slip scale from the encoder distance since the previous stripe and anchors
+  // the encoder displacement at `stripe`
+  void opticalEncoderStripe(DataPoint<NavigationType> stripe);
+  // Measurement of the forward filter and the filter state right after it was applied
+  struct ForwardUpdate {
+    enum Kind {
+      kAcceleration,
+      kStripe,                        // value is a stripe location
+      kOpticalEncoder                 // value is a displacement, with a velocity if its variance
+    };                                // is finite
+    ForwardUpdate()
+        : timestamp(0), kind(kAcceleration), value(0), variance(0), velocity(0),
+          velocity_variance(0)
+    {
+      x.setZero();
+      P.setZero();
+    }
+
+    uint32_t timestamp;
+    Kind kind;
+    NavigationType value;
+    NavigationType variance;
+    NavigationType velocity;
+    NavigationType velocity_variance;
+    ForwardFilter::StateVector x;
+    ForwardFilter::StateMatrix P;
+  };
+  // Predicts the forward filter to `acceleration.timestamp` and corrects it with the IMU reading
+  void forwardImuUpdate(DataPoint<NavigationType> acceleration);
+  // Corrects the forward filter with an encoder displacement and velocity (not if infinite
+  // variance) at the time of the latest IMU sample
+  void forwardOpticalEncoderUpdate(DataPoint<NavigationType> displacement,
+                                   NavigationType displacement_variance,
+                                   NavigationType velocity, NavigationType velocity_variance);
+  // Corrects the forward filter with the position of the stripe seen at `stripe.timestamp`. A
+  // stripe seen before the latest IMU sample rolls the filter back to that time and replays the
+  // samples since; one older than the whole history is applied at the latest sample's time.
+  void forwardStripeUpdate(DataPoint<NavigationType> stripe);
+  // Inserts `update` into forward_history_ in time order and (re)applies it and all after it
+  void forwardInsert(ForwardUpdate update);
+  // Predicts the forward filter to `update->timestamp`, corrects it and stores the result
+  void forwardApply(ForwardUpdate* update);
+  ForwardUpdate& forwardHistory(int i)
+  {
+    return forward_history_[(forward_history_start_ + i) % kForwardHistorySize];
+  }
+  // Copies the forward filter state to acceleration_, velocity_ and displacement_
+  void publishForwardState();
 
   // Admin stuff
   Barrier& post_calibration_barrier_;
   Logger& log_;
   Settings settings_;
+  TrackMap track_map_;
   ModuleStatus status_;
   FullOutput out_;
 
@@ -271,6 +395,12 @@ class Navigation {
   std::array<NavigationVector, Sensors::kNumImus> g_;  // Acc offsets (gravitational acc)
   int num_gyro_samples_;
   std::array<NavigationVector, Sensors::kNumImus> gyro_offsets_;  // Measured during calibration
+  // g_ and gyro_offsets_ in the channel layout of the IMU filters
+  std::array<NavigationType, 3*Sensors::kNumImus> acc_offset_channels_;
+  std::array<NavigationType, 3*Sensors::kNumImus> gyr_offset_channels_;
+  // Mean and variance of the calibration samples, in double as they sum up to 10^5 samples
+  std::array<OnlineStatistics<Vector<double, 3>>, Sensors::kNumImus> gravity_stats_;
+  std::array<OnlineStatistics<Vector<double, 3>>, Sensors::kNumImus> gyro_stats_;
 
   // Most up-to-date values of pod's acceleration, velocity and displacement in 3D; used for output
   NavigationVector acceleration_;
@@ -282,15 +412,42 @@ class Navigation {
   DataPoint<NavigationVector> prev_angular_velocity_;  // To calculate how much has the pod rotated
   Quaternion<NavigationType> orientation_;  // Pod's orientation is updated with every gyro reading
 
-  // Filters for reducing noise in sensor data before processing the data in any other way
-  std::array<Kalman<NavigationVector>, Sensors::kNumImus> acceleration_filter_;  // One for each IMU
-  std::array<Kalman<NavigationVector>, Sensors::kNumImus> gyro_filter_;          // One for each IMU
+  // Filters for reducing noise in sensor data before processing the data in any other way, one
+  // channel for each axis of each IMU (channel axis*kNumImus + i)
+  KalmanBank<3*Sensors::kNumImus> acceleration_filter_;
+  KalmanBank<3*Sensors::kNumImus> gyro_filter_;
+  // Fuse the filtered IMUs, weighting down any that disagrees with the others
+  SensorVote<Sensors::kNumImus> acceleration_vote_;
+  SensorVote<Sensors::kNumImus> gyro_vote_;
 #ifdef PROXI
   std::array<Kalman<float>, 2*Sensors::kNumProximities> proximity_filter_;
 #endif
   Integrator<NavigationVector> acceleration_integrator_;  // Acceleration to velocity
   Integrator<NavigationVector> velocity_integrator_;      // Velocity to displacement
   Differentiator<NavigationType> stripe_differentiator_;  // Stripe cnt distance to velocity
+
+  ForwardFilter forward_filter_;
+  bool forward_initialised_;
+  uint32_t forward_timestamp_;          // of the last prediction
+  NavigationType forward_acc_var_;      // of the averaged forward IMU acceleration, (m/s^2)^2
+  std::array<ForwardUpdate, kForwardHistorySize> forward_history_;   // ring buffer, oldest first
+  int forward_history_start_;
+  int forward_history_size_;
+
+  // Optical encoders, distances in encoder metres unless scaled
+  uint32_t imu_timestamp_;              // of the last IMU sample
+  uint32_t imu_period_;                 // us from the IMU sample before
+  DataPoint<NavigationType> opt_enc_last_;  // distance at the last change and when it was seen
+  DataPoint<NavigationType> opt_enc_window_;  // start of the current velocity window
+  NavigationType opt_enc_rate_;         // encoder metres per s over the last window
+  NavigationType opt_enc_scale_;        // track metres per encoder metre, 1/(1 - slip)
+  NavigationType opt_enc_scale_var_;
+  NavigationType opt_enc_anchor_;       // distance at the last stripe...
+  NavigationType opt_enc_anchor_displ_;  // ...and the displacement there
+  NavigationType opt_enc_displ_var_;    // online estimates of the measurement variances
+  NavigationType opt_enc_vel_var_;
+
+  const BrakingDistanceTable& braking_distance_table_;
 #ifdef PROXI
   Differentiator<Vector<NavigationType, 2>> proxi_differentiator_;
 #endif
@@ -0,0 +1,405 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 26/07/2018
+ * Description:
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "navigation/replay.hpp"
+
+#include <array>
+#include <chrono>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "utils/concurrent/barrier.hpp"
+
+namespace hyped {
+
+using data::Channel;
+using data::recorder::RecordHeader;
+using utils::concurrent::Barrier;
+
+namespace navigation {
+
+// -------------------------------------------------------------------------------------------------
+// RecordingSource
+// -------------------------------------------------------------------------------------------------
+RecordingSource::RecordingSource(const char* file_path)
+    : reader_(file_path),
+      calibration_(),
+      current_(),
+      pending_(),
+      has_pending_(false)
+#ifdef PROXI
+      , proxi_front_updated_(false),
+      proxi_back_updated_(false)
+#endif
+{}
+
+bool RecordingSource::next(ReplaySample* sample)
+{
+  RecordHeader header;
+  const void* payload;
+  while (reader_.next(&header, &payload)) {
+    if (header.channel != static_cast<uint16_t>(Channel::kSensorsImu)) {
+      apply(header, payload);
+      continue;
+    }
+    DataPoint<Navigation::ImuArray> imus;
+    if (!RecordingReader::decode(header, payload, &imus)) continue;
+
+    // everything read since the pending sample, including its navigation output, is now known
+    bool ready = has_pending_;
+    if (ready) {
+      *sample           = pending_;
+      sample->has_truth = current_.has_truth;
+      sample->truth     = current_.truth;
+    }
+#ifdef PROXI
+    // like navigation::Main, only pass proxis on once both front and back have been updated
+    current_.proxi_updated = proxi_front_updated_ && proxi_back_updated_;
+    if (current_.proxi_updated) proxi_front_updated_ = proxi_back_updated_ = false;
+#endif
+    pending_              = current_;
+    pending_.sensors.imu  = imus;
+    has_pending_          = true;
+    current_.keyence_updated     = false;
+    current_.optical_enc_updated = false;
+    if (ready) return true;
+  }
+
+  if (!has_pending_) return false;
+  *sample           = pending_;
+  sample->has_truth = current_.has_truth;
+  sample->truth     = current_.truth;
+  has_pending_      = false;
+  return true;
+}
+
+void RecordingSource::apply(const RecordHeader& header, const void* payload)
+{
+  switch (static_cast<Channel>(header.channel)) {
+    case Channel::kNavigation: {
+      data::Navigation nav;
+      if (RecordingReader::decode(header, payload, &nav)) {
+        current_.has_truth          = true;
+        current_.truth.distance     = nav.distance;
+        current_.truth.velocity     = nav.velocity;
+        current_.truth.acceleration = nav.acceleration;
+      }
+      break;
+    }
+#ifdef PROXI
+    case Channel::kSensorsProxiFront:
+      if (RecordingReader::decode(header, payload, &current_.sensors.proxi_front))
+        proxi_front_updated_ = true;
+      break;
+    case Channel::kSensorsProxiBack:
+      if (RecordingReader::decode(header, payload, &current_.sensors.proxi_back))
+        proxi_back_updated_ = true;
+      break;
+#endif
+    case Channel::kSensorsKeyence:
+      if (RecordingReader::decode(header, payload, &current_.sensors.keyence_stripe_counter))
+        current_.keyence_updated = true;
+      break;
+    case Channel::kSensorsOpticalEncoder:
+      if (RecordingReader::decode(header, payload, &current_.sensors.optical_enc_distance))
+        current_.optical_enc_updated = true;
+      break;
+    case Channel::kCalibration:
+      RecordingReader::decode(header, payload, &calibration_);
+      break;
+    default:
+      break;
+  }
+}
+
+// -------------------------------------------------------------------------------------------------
+// SyntheticSource
+// -------------------------------------------------------------------------------------------------
+SyntheticSource::SyntheticSource(const Profile& profile, uint32_t seed)
+    : profile_(profile),
+      random_(seed),
+      acc_noise_(0, profile.acc_noise),
+      gyr_noise_(0, profile.gyr_noise),
+      unit_noise_(0, 1),
+      sample_(0),
+      stripe_count_(0),
+      stripe_seen_at_(0),
+      keyence_pending_(false),
+      prev_distance_(0),
+      wheel_distance_(),
+      opt_enc_distance_()
+{
+  placeNextStripe();
+  scheduleRun(profile_.stationary_samples);
+}
+
+void SyntheticSource::startRun()
+{
+  if (sample_ < first_sample_) scheduleRun(sample_);
+}
+
+void SyntheticSource::scheduleRun(uint32_t first_sample)
+{
+  first_sample_ = first_sample;
+  double top_speed = profile_.acceleration * profile_.acceleration_time;
+  double duration  = profile_.acceleration_time + top_speed / profile_.deceleration
+                     + profile_.stopped_time;
+  last_sample_ = first_sample_ + std::ceil(duration * 1e6 / profile_.imu_period);
+}
+
+SensorCalibration SyntheticSource::getCalibration()
+{
+  SensorCalibration calibration;
+#ifdef PROXI
+  calibration.proxi_front_variance.fill(1);
+  calibration.proxi_back_variance.fill(1);
+#endif
+  for (auto& imu : calibration.imu_variance) {
+    imu[0] = NavigationVector(profile_.acc_noise * profile_.acc_noise);
+    imu[1] = NavigationVector(profile_.gyr_noise * profile_.gyr_noise);
+  }
+  return calibration;
+}
+
+GroundTruth SyntheticSource::getTruth(double t) const
+{
+  GroundTruth truth = {0, 0, 0};
+  if (t <= 0) return truth;
+
+  double a = profile_.acceleration;
+  double t_acc = profile_.acceleration_time;
+  if (t < t_acc) {
+    truth.acceleration = a;
+    truth.velocity     = a * t;
+    truth.distance     = a * t * t / 2;
+    return truth;
+  }
+  double top_speed = a * t_acc;
+  double d         = profile_.deceleration;
+  double t_dec     = std::min(t - t_acc, top_speed / d);
+  truth.acceleration = t - t_acc < top_speed / d ? -d : 0;
+  truth.velocity     = top_speed - d * t_dec;
+  truth.distance     = a * t_acc * t_acc / 2 + top_speed * t_dec - d * t_dec * t_dec / 2;
+  return truth;
+}
+
+bool SyntheticSource::next(ReplaySample* sample)
+{
+  if (sample_ > last_sample_) return false;
+
+  uint32_t timestamp = sample_ * profile_.imu_period;
+  double t = (static_cast<double>(sample_) - first_sample_)
+             * profile_.imu_period / 1e6;
+  GroundTruth truth = getTruth(t);
+
+  sample->has_truth = true;
+  sample->truth     = truth;
+
+  Sensors& sensors = sample->sensors;
+  sensors.imu.timestamp = timestamp;
+  for (Imu& imu : sensors.imu.value) {
+    imu.operational = true;
+    imu.acc[0] = truth.acceleration + acc_noise_(random_);
+    imu.acc[1] = acc_noise_(random_);
+    imu.acc[2] = profile_.gravity + acc_noise_(random_);
+    imu.gyr[0] = gyr_noise_(random_);
+    imu.gyr[1] = gyr_noise_(random_);
+    imu.gyr[2] = gyr_noise_(random_);
+  }
+
+  // both keyences see a stripe as soon as the pod passes it, the counters are published
+  // keyence_delay later
+  while (truth.distance >= next_stripe_at_) {
+    stripe_count_++;
+    stripe_seen_at_  = timestamp;
+    keyence_pending_ = true;
+    placeNextStripe();
+  }
+  sample->keyence_updated = sample_ == 0 ||
+      (keyence_pending_ && timestamp - stripe_seen_at_ >= profile_.keyence_delay);
+  if (sample->keyence_updated) {
+    keyence_pending_ = false;
+    for (StripeCounter& keyence : sensors.keyence_stripe_counter) {
+      keyence.operational = true;
+      keyence.count       = DataPoint<uint32_t>(stripe_seen_at_, stripe_count_);
+    }
+  }
+
+  // the wheels turn for the distance they do not slide for, the encoders count whole turns
+  double turned = (truth.distance - prev_distance_) * profile_.opt_enc_scale
+                  * (1 - profile_.opt_enc_slip * std::abs(truth.acceleration));
+  prev_distance_ = truth.distance;
+  sample->optical_enc_updated = sample_ == 0;
+  for (int i = 0; i < Sensors::kNumOptEnc; i++) {
+    if (i == 1 && truth.distance >= profile_.opt_enc_fail_at) continue;
+    wheel_distance_[i] += turned;
+    float counted = std::floor(wheel_distance_[i] / profile_.opt_enc_resolution)
+                    * profile_.opt_enc_resolution;
+    sample->optical_enc_updated |= counted != opt_enc_distance_[i];
+    opt_enc_distance_[i] = counted;
+  }
+  sensors.optical_enc_distance = opt_enc_distance_;
+#ifdef PROXI
+  sample->proxi_updated = false;
+#endif
+
+  sample_++;
+  return true;
+}
+
+void SyntheticSource::placeNextStripe()
+{
+  // infinitely far after the last stripe
+  next_stripe_at_ = profile_.track.getStripe(stripe_count_ + 1);
+  if (std::isinf(next_stripe_at_)) return;
+  if (profile_.keyence_noise > 0) next_stripe_at_ += profile_.keyence_noise * unit_noise_(random_);
+}
+
+// -------------------------------------------------------------------------------------------------
+// Replay
+// -------------------------------------------------------------------------------------------------
+namespace {
+
+// Keeps the larger of the absolute errors
+void updateMaxError(const GroundTruth& error, GroundTruth* max_error)
+{
+  max_error->distance     = std::max(max_error->distance,     std::abs(error.distance));
+  max_error->velocity     = std::max(max_error->velocity,     std::abs(error.velocity));
+  max_error->acceleration = std::max(max_error->acceleration, std::abs(error.acceleration));
+}
+
+// Truth at an IMU sample that is waiting in the measurement queue
+struct PendingTruth {
+  bool has_truth;
+  GroundTruth truth;
+};
+
+}  // namespace
+
+ReplayResult replay(ReplaySource* source, Logger& log, const Navigation::Settings& settings,
+                    const TrackMap& track_map)
+{
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Clock::duration nav_time(0);
+
+  ReplayResult result = ReplayResult();
+  Barrier barrier(1);   // nobody to sync with
+  Navigation nav(barrier, log, settings, track_map);
+  ReplaySample sample = ReplaySample();
+  if (!source->next(&sample)) return result;
+
+  nav.init(source->getCalibration(), sample.sensors);
+  nav.startCalibration();
+  bool calibrating = true;
+
+  MeasurementQueue<kReplayQueueSize> queue;
+  Measurement measurement = Measurement();
+  // Truths of the IMU samples in the queue, oldest first
+  std::array<PendingTruth, kReplayQueueSize> truths;
+  int truths_start = 0, truths_size = 0;
+
+  // Applies the queued measurements up to `until`, checking each IMU sample against its truth
+  auto apply = [&](uint32_t until) {  // NOLINT [whitespace/braces]
+    while (queue.pop(until, &measurement)) {
+      Clock::time_point before = Clock::now();
+      nav.update(measurement);
+      nav_time += Clock::now() - before;
+      if (measurement.type != Measurement::kImu) continue;
+
+      const PendingTruth& truth = truths[truths_start];
+      truths_start = (truths_start + 1) % kReplayQueueSize;
+      truths_size--;
+      result.num_samples++;
+      if (calibrating) {
+        if (nav.getStatus() == ModuleStatus::kReady) {
+          nav.finishCalibration();
+          source->startRun();
+          calibrating = false;
+        }
+        continue;
+      }
+      result.num_run_samples++;
+      if (truth.has_truth) {
+        GroundTruth error = {nav.getDisplacement() - truth.truth.distance,
+                             nav.getVelocity() - truth.truth.velocity,
+                             nav.getAcceleration() - truth.truth.acceleration};
+        updateMaxError(error, &result.max_error);
+        result.has_truth   = true;
+        result.truth       = truth.truth;
+        result.final_error = error;
+      }
+    }
+  };
+  auto push = [&]() {  // NOLINT [whitespace/braces]
+    if (queue.full()) apply(queue.earliest());
+    queue.push(measurement);
+  };
+
+  while (source->next(&sample)) {
+    const Sensors& sensors = sample.sensors;
+    uint32_t now = sensors.imu.timestamp;
+    while (truths_size == kReplayQueueSize) apply(queue.earliest());
+    PendingTruth& truth = truths[(truths_start + truths_size++) % kReplayQueueSize];
+    truth.has_truth = sample.has_truth;
+    truth.truth     = sample.truth;
+
+    measurement.type      = Measurement::kImu;
+    measurement.timestamp = now;
+    measurement.imus      = sensors.imu;
+    push();
+    if (sample.keyence_updated) {
+      measurement.type      = Measurement::kKeyence;
+      measurement.timestamp = 0;
+      for (const StripeCounter& keyence : sensors.keyence_stripe_counter)
+        measurement.timestamp = std::max(measurement.timestamp, keyence.count.timestamp);
+      measurement.keyence   = sensors.keyence_stripe_counter;
+      push();
+    }
+    if (sample.optical_enc_updated) {
+      measurement.type                 = Measurement::kOpticalEncoder;
+      measurement.timestamp            = now;
+      measurement.optical_enc_distance = sensors.optical_enc_distance;
+      push();
+    }
+#ifdef PROXI
+    if (sample.proxi_updated) {
+      measurement.type        = Measurement::kProximity;
+      measurement.timestamp   = std::max(sensors.proxi_front.timestamp,
+                                         sensors.proxi_back.timestamp);
+      measurement.proxi_front = sensors.proxi_front;
+      measurement.proxi_back  = sensors.proxi_back;
+      push();
+    }
+#endif
+    apply(now > settings.reorder_window ? now - settings.reorder_window : 0);
+  }
+  apply(std::numeric_limits<uint32_t>::max());
+
+  result.status                = nav.getStatus();
+  result.estimate.distance     = nav.getDisplacement();
+  result.estimate.velocity     = nav.getVelocity();
+  result.estimate.acceleration = nav.getAcceleration();
+  result.seconds     = std::chrono::duration<double>(Clock::now() - start).count();
+  result.nav_seconds = std::chrono::duration<double>(nav_time).count();
+  return result;
+}
+
+}}  // namespace hyped::navigation
@@ -0,0 +1,221 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 26/07/2018
+ * Description:
+ * Offline replay of sensor streams through Navigation, as fast as the CPU allows. The stream
+ * comes either from a flight recording (see data/recorder.hpp) or from a synthetic run with a
+ * known trajectory, so that nav changes can be regression-tested against ground truth without
+ * the sensors, the other modules or wall-clock timing.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_NAVIGATION_REPLAY_HPP_
+#define BEAGLEBONE_BLACK_NAVIGATION_REPLAY_HPP_
+
+#include <cstdint>
+#include <random>
+
+#include <array>
+#include <limits>
+
+#include "data/data.hpp"
+#include "data/recorder.hpp"
+#include "navigation/navigation.hpp"
+#include "utils/logger.hpp"
+
+namespace hyped {
+
+using data::RecordingReader;
+
+namespace navigation {
+
+/**
+ * @brief Forward motion of the pod along the track
+ */
+struct GroundTruth {
+  NavigationType distance;
+  NavigationType velocity;
+  NavigationType acceleration;
+};
+
+/**
+ * @brief One IMU sample together with the other sensors as they were when it was published
+ */
+struct ReplaySample {
+  Sensors sensors;
+  bool keyence_updated;         // keyence_stripe_counter changed since the previous sample
+  bool optical_enc_updated;     // optical_enc_distance changed since the previous sample
+#ifdef PROXI
+  bool proxi_updated;           // both proxi_front and proxi_back changed
+#endif
+  bool has_truth;               // false if truth is unknown at this sample
+  GroundTruth truth;
+};
+
+/**
+ * @brief Stream of samples to replay
+ */
+class ReplaySource {
+ public:
+  virtual ~ReplaySource() {}
+
+  /**
+   * @brief Sensor variances to initialise Navigation with
+   */
+  virtual SensorCalibration getCalibration() = 0;
+
+  /**
+   * @brief Produces the next sample, IMU timestamps must increase
+   *
+   * @return false at the end of the stream
+   */
+  virtual bool next(ReplaySample* sample) = 0;
+
+  /**
+   * @brief Called once nav has finished calibrating, i.e. when the pod would be launched
+   */
+  virtual void startRun() {}
+};
+
+/**
+ * @brief Replays the sensors of a flight recording. The truth is the navigation output that was
+ *        published live after each IMU sample, i.e. the replay reports how far the current
+ *        Navigation deviates from the one that flew.
+ */
+class RecordingSource : public ReplaySource {
+ public:
+  explicit RecordingSource(const char* file_path);
+
+  bool isOpen() const { return reader_.isOpen(); }
+  const char* getError() const { return reader_.getError(); }
+
+  SensorCalibration getCalibration() override { return calibration_; }
+  bool next(ReplaySample* sample) override;
+
+ private:
+  // Applies a single non-IMU record to current_
+  void apply(const data::recorder::RecordHeader& header, const void* payload);
+
+  RecordingReader reader_;
+  SensorCalibration calibration_;
+  ReplaySample current_;        // state of all sensors after the records read so far
+  ReplaySample pending_;        // last IMU sample read, waits for the navigation output after it
+  bool has_pending_;
+#ifdef PROXI
+  bool proxi_front_updated_;
+  bool proxi_back_updated_;
+#endif
+};
+
+/**
+ * @brief Synthetic run with an exactly known trajectory: the pod stands still for calibration,
+ *        accelerates at a constant rate from the moment nav is ready (startRun()), brakes at a
+ *        constant rate until it stops, and stands still again. IMU readings get gravity and
+ *        Gaussian noise added; keyence counters increment at the stripes of the profile's track
+ *        map.
+ */
+class SyntheticSource : public ReplaySource {
+ public:
+  struct Profile {
+    uint32_t       imu_period         = 1000;   // us between IMU samples
+    // the run starts after this many samples even if nav never gets ready, the first sample
+    // initialises nav and calibration takes at most the maximum after that
+    int            stationary_samples = Navigation::kMaxNumCalibrationSamples + 2;
+    NavigationType acceleration       = 9.8;    // m/s^2
+    NavigationType acceleration_time  = 6.0;    // s
+    NavigationType deceleration       = 19.6;   // m/s^2, positive
+    NavigationType stopped_time       = 1.0;    // s to keep going after the pod has stopped
+    NavigationType gravity            = 9.8;    // m/s^2 along z
+    NavigationType acc_noise          = 0.3;    // standard deviation, m/s^2
+    NavigationType gyr_noise          = 0.01;   // standard deviation, rad/s
+    NavigationType keyence_noise      = 0;      // standard deviation of the position (m) at
+                                                // which a stripe is detected
+    uint32_t       keyence_delay      = 0;      // us from a stripe being seen to the counters
+                                                // being published, less than between stripes
+    NavigationType opt_enc_resolution = 0.25;   // m per count, about a turn of the 8 cm wheels
+    NavigationType opt_enc_scale      = 1.0;    // encoder m per m, e.g. of a wrong wheel size
+    NavigationType opt_enc_slip       = 0.002;  // fraction of the distance the wheels slide for
+                                                // per m/s^2 of acceleration or deceleration
+    NavigationType opt_enc_fail_at    =         // m after which the second encoder stops
+        std::numeric_limits<NavigationType>::infinity();
+    TrackMap       track;                       // should match the track map nav is given
+  };
+
+  SyntheticSource(const Profile& profile, uint32_t seed);
+
+  SensorCalibration getCalibration() override;
+  bool next(ReplaySample* sample) override;
+  void startRun() override;
+
+  /**
+   * @brief Exact motion at `t` seconds after the start of the acceleration
+   */
+  GroundTruth getTruth(double t) const;
+
+ private:
+  Profile profile_;
+  std::mt19937 random_;
+  std::normal_distribution<NavigationType> acc_noise_;
+  std::normal_distribution<NavigationType> gyr_noise_;
+  std::normal_distribution<NavigationType> unit_noise_;
+  uint32_t sample_;           // index of the next sample
+  uint32_t first_sample_;     // index of the sample at which the acceleration starts
+  uint32_t last_sample_;      // index of the last sample of the run
+  uint32_t stripe_count_;
+  uint32_t stripe_seen_at_;         // timestamp of the last stripe
+  bool keyence_pending_;            // the last stripe has not been published yet
+  NavigationType next_stripe_at_;   // distance at which the next stripe will be detected
+  double prev_distance_;            // true distance at the previous sample
+  std::array<double, Sensors::kNumOptEnc> wheel_distance_;  // turned by each encoder wheel
+  std::array<float, Sensors::kNumOptEnc> opt_enc_distance_;  // published, in whole turns
+
+  // Draws where the stripe after the current one will be detected
+  void placeNextStripe();
+  // Starts the acceleration at sample `first_sample`
+  void scheduleRun(uint32_t first_sample);
+};
+
+// Measurements the replay queue holds, enough for a 16 ms reorder window at 1 kHz
+constexpr int kReplayQueueSize = 64;
+
+struct ReplayResult {
+  uint32_t       num_samples;         // IMU samples passed to Navigation::update()
+  uint32_t       num_run_samples;     // ... of which after calibration
+  double         seconds;             // wall time of the whole replay
+  double         nav_seconds;         // ... spent in Navigation::update()
+  ModuleStatus   status;              // final nav status
+  bool           has_truth;
+  GroundTruth    estimate;            // final nav output
+  GroundTruth    truth;               // truth at the last sample
+  GroundTruth    final_error;         // estimate - truth at the last sample
+  GroundTruth    max_error;           // largest absolute errors after calibration
+};
+
+/**
+ * @brief Feeds the whole stream through a fresh Navigation, the same way navigation::Main
+ *        does: the first sample initialises the filters, the following ones calibrate until
+ *        nav is ready, the rest are the run. The sensors go through a MeasurementQueue with
+ *        the reorder window of `settings`, so IMU samples are applied that much later; each is
+ *        still compared against its own truth.
+ *
+ * @param log       logger used by Navigation, keep quiet for benchmarks
+ * @param settings  fusion settings of the Navigation, e.g. Navigation::readSettings()
+ * @param track_map stripes the Navigation expects, same as the source's
+ */
+ReplayResult replay(ReplaySource* source, Logger& log, const Navigation::Settings& settings,
+                    const TrackMap& track_map = TrackMap());
+
+}}  // namespace hyped::navigation
+
+#endif  // BEAGLEBONE_BLACK_NAVIGATION_REPLAY_HPP_
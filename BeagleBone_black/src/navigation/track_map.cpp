@@ -0,0 +1,103 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "navigation/track_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace hyped {
+namespace navigation {
+
+namespace {
+
+std::vector<NavigationType> competitionTrack()
+{
+  std::vector<NavigationType> stripes;
+  for (int i = 1; i <= 41; i++) stripes.push_back(i * 30.48);
+  return stripes;
+}
+
+}  // namespace
+
+constexpr const char* TrackMap::kDefaultTrackMapFile;
+constexpr int TrackMap::kMaxNumBuckets;
+
+TrackMap::TrackMap()
+    : TrackMap(competitionTrack())
+{}
+
+TrackMap::TrackMap(const std::vector<NavigationType>& stripes)
+    : positions_(1, 0),
+      inverse_bucket_width_(0)
+{
+  if (stripes.size() >= std::numeric_limits<uint16_t>::max()) {
+    throw std::invalid_argument("Too many stripes");
+  }
+  NavigationType min_spacing = std::numeric_limits<NavigationType>::infinity();
+  for (NavigationType stripe : stripes) {
+    if (!(stripe > positions_.back())) {
+      throw std::invalid_argument("Stripes must be after the start and in increasing order");
+    }
+    min_spacing = std::min(min_spacing, stripe - positions_.back());
+    positions_.push_back(stripe);
+  }
+  if (stripes.empty()) return;    // every distance is before the first (non-existent) stripe
+
+  // With buckets no wider than the closest stripes, a bucket contains at most one stripe
+  NavigationType length = positions_.back();
+  int num_buckets = std::min(static_cast<int>(std::ceil(length / min_spacing)) + 1,
+                             kMaxNumBuckets);
+  inverse_bucket_width_ = (num_buckets - 1) / length;
+  buckets_.resize(num_buckets);
+  uint16_t n = 0;
+  for (int bucket = 0; bucket < num_buckets; bucket++) {
+    NavigationType start = bucket / inverse_bucket_width_;
+    while (n < getNumStripes() && positions_[n + 1] <= start) n++;
+    buckets_[bucket] = n;
+  }
+}
+
+TrackMap TrackMap::readFile(std::string file_path)
+{
+  std::ifstream file(file_path);
+  if (!file.is_open()) {
+    throw std::invalid_argument("Wrong file path");
+  }
+
+  std::vector<NavigationType> stripes;
+  std::string line;
+  while (getline(file, line)) {
+    std::stringstream input(line);
+    NavigationType stripe;
+    if (line.empty() || line[0] == '#') continue;
+    if (!(input >> stripe)) {
+      throw std::invalid_argument("Invalid line in track map: " + line);
+    }
+    stripes.push_back(stripe);
+  }
+  return TrackMap(stripes);
+}
+
+}}  // namespace hyped::navigation
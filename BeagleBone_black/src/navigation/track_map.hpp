@@ -0,0 +1,110 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Positions of the stripes along the track. Stripes may be spaced unevenly; queries for the
+ * stripe nearest to a position go through a table of buckets no wider than the closest pair of
+ * stripes, so each query looks at most at two stripes and never allocates.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_NAVIGATION_TRACK_MAP_HPP_
+#define BEAGLEBONE_BLACK_NAVIGATION_TRACK_MAP_HPP_
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace hyped {
+
+using data::NavigationType;
+
+namespace navigation {
+
+class TrackMap {
+ public:
+  static constexpr const char* kDefaultTrackMapFile =
+      "../BeagleBone_black/data/configuration/TrackMap.txt";
+  // Upper bound on the size of the bucket table; tracks with stripes closer together than
+  // length/kMaxNumBuckets still work, the queries just may have to look at a few more stripes
+  static constexpr int kMaxNumBuckets = 1 << 16;
+
+  /**
+   * @brief The 2018 competition track: a stripe every 100 ft (30.48 m) for 41 stripes
+   */
+  TrackMap();
+
+  /**
+   * @brief Track with stripes at the given distances from the start, in increasing order
+   */
+  explicit TrackMap(const std::vector<NavigationType>& stripes);
+
+  /**
+   * @brief Reads a track map file with the distance (m) of one stripe per line. Empty lines and
+   *        lines starting with '#' are ignored. Throws std::invalid_argument if the file cannot be
+   *        read or the stripes are not in increasing order.
+   */
+  static TrackMap readFile(std::string file_path);
+
+  int getNumStripes() const { return static_cast<int>(positions_.size()) - 1; }
+
+  /**
+   * @brief Distance of stripe `n` from the start, stripe 0 being the start itself. Stripes
+   *        before the start are at -infinity, stripes after the last one at +infinity.
+   */
+  NavigationType getStripe(int n) const
+  {
+    if (n < 0) return -std::numeric_limits<NavigationType>::infinity();
+    if (n > getNumStripes()) return std::numeric_limits<NavigationType>::infinity();
+    return positions_[n];
+  }
+
+  /**
+   * @brief Index of the last stripe at or before `distance`, i.e. the stripe count a pod at
+   *        `distance` should have seen
+   */
+  int getStripeBefore(NavigationType distance) const
+  {
+    if (!(distance > 0)) return 0;
+    int bucket = static_cast<int>(distance * inverse_bucket_width_);
+    if (bucket >= static_cast<int>(buckets_.size())) return getNumStripes();
+    int n = buckets_[bucket];
+    // rounding may put `distance` one bucket off
+    while (n > 0 && positions_[n] > distance) n--;
+    while (n < getNumStripes() && positions_[n + 1] <= distance) n++;
+    return n;
+  }
+
+  /**
+   * @brief Index of the stripe closest to `distance`
+   */
+  int getNearestStripe(NavigationType distance) const
+  {
+    int n = getStripeBefore(distance);
+    if (n < getNumStripes() && positions_[n + 1] - distance < distance - positions_[n]) n++;
+    return n;
+  }
+
+ private:
+  std::vector<NavigationType> positions_;   // positions_[0] is the start
+  std::vector<uint16_t> buckets_;           // last stripe before the start of each bucket
+  NavigationType inverse_bucket_width_;
+};
+
+}}  // namespace hyped::navigation
+
+#endif  // BEAGLEBONE_BLACK_NAVIGATION_TRACK_MAP_HPP_
@@ -0,0 +1,341 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 25/07/2018
+ * Description:
+ * Decodes a flight recording made with `hyped --record` into one CSV file per data channel,
+ * e.g. `./recorder_to_csv flight.rec out/` writes out/navigation.csv, out/sensors_imu.csv, ...
+ * Every row starts with the CLOCK_MONOTONIC timestamp of publishing in nanoseconds. Must be built
+ * with the same PROXI setting as the binary that made the recording.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <string>
+
+#include "data/data.hpp"
+#include "data/recorder.hpp"
+
+using hyped::data::Batteries;
+using hyped::data::Battery;
+using hyped::data::Channel;
+using hyped::data::Communications;
+using hyped::data::DataPoint;
+using hyped::data::EmergencyBrakes;
+using hyped::data::Imu;
+using hyped::data::Module;
+using hyped::data::Motors;
+using hyped::data::Navigation;
+using hyped::data::SensorCalibration;
+using hyped::data::Sensors;
+using hyped::data::StateMachine;
+using hyped::data::StripeCounter;
+using hyped::data::RecordingReader;
+using hyped::data::recorder::RecordHeader;
+#ifdef PROXI
+using hyped::data::Proximity;
+#endif
+
+namespace {
+
+// -------------------------------------------------------------------------------------------------
+// CSV header and row of every recorded type
+// -------------------------------------------------------------------------------------------------
+void header(FILE* f, const StateMachine*) { fprintf(f, ",critical_failure,current_state"); }
+void row(FILE* f, const StateMachine& v)
+{
+  fprintf(f, ",%d,%s", v.critical_failure, v.current_state < hyped::data::num_states ?
+      hyped::data::states[v.current_state] : "?");
+}
+
+void header(FILE* f, const Module*) { fprintf(f, ",module_status"); }
+void row(FILE* f, const Module& v) { fprintf(f, ",%d", static_cast<int>(v.module_status)); }
+
+void header(FILE* f, const Navigation*)
+{
+  fprintf(f, ",module_status,distance,velocity,acceleration,emergency_braking_distance,"
+      "braking_distance");
+}
+void row(FILE* f, const Navigation& v)
+{
+  fprintf(f, ",%d,%f,%f,%f,%f,%f", static_cast<int>(v.module_status), v.distance, v.velocity,
+      v.acceleration, v.emergency_braking_distance, v.braking_distance);
+}
+
+void header(FILE* f, const DataPoint<array<Imu, Sensors::kNumImus>>*)
+{
+  fprintf(f, ",timestamp");
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    fprintf(f, ",op_%d,acc_x_%d,acc_y_%d,acc_z_%d,gyr_x_%d,gyr_y_%d,gyr_z_%d",
+        i, i, i, i, i, i, i);
+  }
+}
+void row(FILE* f, const DataPoint<array<Imu, Sensors::kNumImus>>& v)
+{
+  fprintf(f, ",%u", v.timestamp);
+  for (const Imu& imu : v.value) {
+    fprintf(f, ",%d,%f,%f,%f,%f,%f,%f", imu.operational, imu.acc[0], imu.acc[1], imu.acc[2],
+        imu.gyr[0], imu.gyr[1], imu.gyr[2]);
+  }
+}
+
+#ifdef PROXI
+void header(FILE* f, const DataPoint<array<Proximity, Sensors::kNumProximities>>*)
+{
+  fprintf(f, ",timestamp");
+  for (int i = 0; i < Sensors::kNumProximities; i++) fprintf(f, ",op_%d,val_%d", i, i);
+}
+void row(FILE* f, const DataPoint<array<Proximity, Sensors::kNumProximities>>& v)
+{
+  fprintf(f, ",%u", v.timestamp);
+  for (const Proximity& proxi : v.value) fprintf(f, ",%d,%u", proxi.operational, proxi.val);
+}
+#endif
+
+void header(FILE* f, const array<StripeCounter, Sensors::kNumKeyence>*)
+{
+  for (int i = 0; i < Sensors::kNumKeyence; i++) {
+    fprintf(f, ",op_%d,timestamp_%d,count_%d", i, i, i);
+  }
+}
+void row(FILE* f, const array<StripeCounter, Sensors::kNumKeyence>& v)
+{
+  for (const StripeCounter& s : v) {
+    fprintf(f, ",%d,%u,%u", s.operational, s.count.timestamp, s.count.value);
+  }
+}
+
+void header(FILE* f, const array<float, Sensors::kNumOptEnc>*)
+{
+  for (int i = 0; i < Sensors::kNumOptEnc; i++) fprintf(f, ",distance_%d", i);
+}
+void row(FILE* f, const array<float, Sensors::kNumOptEnc>& v)
+{
+  for (float distance : v) fprintf(f, ",%f", distance);
+}
+
+void header(FILE* f, const Motors*)
+{
+  fprintf(f, ",module_status,velocity_1,velocity_2,velocity_3,velocity_4");
+}
+void row(FILE* f, const Motors& v)
+{
+  fprintf(f, ",%d,%d,%d,%d,%d", static_cast<int>(v.module_status), v.velocity_1, v.velocity_2,
+      v.velocity_3, v.velocity_4);
+}
+
+void header(FILE* f, const Batteries*)
+{
+  fprintf(f, ",module_status");
+  for (int i = 0; i < Batteries::kNumLPBatteries + Batteries::kNumHPBatteries; i++) {
+    const char* type = i < Batteries::kNumLPBatteries ? "lp" : "hp";
+    int j = i < Batteries::kNumLPBatteries ? i : i - Batteries::kNumLPBatteries;
+    fprintf(f, ",%s_voltage_%d,%s_current_%d,%s_charge_%d,%s_temperature_%d,"
+        "%s_low_voltage_cell_%d,%s_high_voltage_cell_%d",
+        type, j, type, j, type, j, type, j, type, j, type, j);
+  }
+}
+void row(FILE* f, const Batteries& v)
+{
+  fprintf(f, ",%d", static_cast<int>(v.module_status));
+  for (int i = 0; i < Batteries::kNumLPBatteries + Batteries::kNumHPBatteries; i++) {
+    const Battery& b = i < Batteries::kNumLPBatteries ? v.low_power_batteries[i]
+        : v.high_power_batteries[i - Batteries::kNumLPBatteries];
+    fprintf(f, ",%u,%d,%u,%d,%u,%u", b.voltage, b.current, b.charge, b.temperature,
+        b.low_voltage_cell, b.high_voltage_cell);
+  }
+}
+
+void header(FILE* f, const Communications*)
+{
+  fprintf(f, ",module_status,launch_command,reset_command,run_length,service_propulsion_go");
+}
+void row(FILE* f, const Communications& v)
+{
+  fprintf(f, ",%d,%d,%d,%f,%d", static_cast<int>(v.module_status), v.launch_command,
+      v.reset_command, v.run_length, v.service_propulsion_go);
+}
+
+void header(FILE* f, const SensorCalibration*)
+{
+#ifdef PROXI
+  for (int i = 0; i < Sensors::kNumProximities; i++) fprintf(f, ",proxi_front_variance_%d", i);
+  for (int i = 0; i < Sensors::kNumProximities; i++) fprintf(f, ",proxi_back_variance_%d", i);
+#endif
+  for (int i = 0; i < Sensors::kNumImus; i++) {
+    fprintf(f, ",acc_var_x_%d,acc_var_y_%d,acc_var_z_%d,gyr_var_x_%d,gyr_var_y_%d,gyr_var_z_%d",
+        i, i, i, i, i, i);
+  }
+}
+void row(FILE* f, const SensorCalibration& v)
+{
+#ifdef PROXI
+  for (float var : v.proxi_front_variance) fprintf(f, ",%f", var);
+  for (float var : v.proxi_back_variance)  fprintf(f, ",%f", var);
+#endif
+  for (auto& imu : v.imu_variance) {
+    for (auto& var : imu) fprintf(f, ",%f,%f,%f", var[0], var[1], var[2]);
+  }
+}
+
+void header(FILE* f, const EmergencyBrakes*)
+{
+  fprintf(f, ",module_status,front_brakes,rear_brakes");
+}
+void row(FILE* f, const EmergencyBrakes& v)
+{
+  fprintf(f, ",%d,%d,%d", static_cast<int>(v.module_status), v.front_brakes, v.rear_brakes);
+}
+
+// -------------------------------------------------------------------------------------------------
+// Per-channel output file
+// -------------------------------------------------------------------------------------------------
+class Output {
+ public:
+  Output() : file_(nullptr), num_records_(0), num_bad_(0) {}
+  ~Output() { if (file_) fclose(file_); }
+
+  // Appends one record, creating the file on first use
+  template <typename T>
+  void write(const std::string& path, const RecordHeader& rec, const void* payload)
+  {
+    T value;
+    if (!RecordingReader::decode(rec, payload, &value)) {
+      num_bad_++;
+      return;
+    }
+    if (!file_) {
+      file_ = fopen(path.c_str(), "w");
+      if (!file_) {
+        fprintf(stderr, "cannot create %s\n", path.c_str());
+        num_bad_++;
+        return;
+      }
+      fprintf(file_, "time_ns");
+      header(file_, static_cast<const T*>(nullptr));
+      fprintf(file_, "\n");
+    }
+    fprintf(file_, "%" PRIu64, rec.timestamp);
+    row(file_, value);
+    fprintf(file_, "\n");
+    num_records_++;
+  }
+
+  FILE* file_;
+  uint32_t num_records_;
+  uint32_t num_bad_;
+};
+
+const char* channel_names[static_cast<int>(Channel::kNumChannels)] = {
+  "state_machine",
+  "navigation",
+  "sensors_status",
+  "sensors_imu",
+  "sensors_proxi_front",
+  "sensors_proxi_back",
+  "sensors_keyence",
+  "sensors_optical_encoder",
+  "motors",
+  "batteries",
+  "communications",
+  "calibration",
+  "emergency_brakes",
+};
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    printf("usage: %s <recording> [output prefix]\n", argv[0]);
+    return 1;
+  }
+  std::string prefix = argc > 2 ? argv[2] : "";
+
+  RecordingReader reader(argv[1]);
+  if (!reader.isOpen()) {
+    fprintf(stderr, "%s: %s\n", argv[1], reader.getError());
+    return 1;
+  }
+
+  Output outputs[static_cast<int>(Channel::kNumChannels)];
+  uint32_t num_unknown = 0;
+  RecordHeader rec;
+  const void* payload;
+  while (reader.next(&rec, &payload)) {
+    if (rec.channel >= static_cast<int>(Channel::kNumChannels)) {
+      num_unknown++;
+      continue;
+    }
+    Output& out = outputs[rec.channel];
+    std::string path = prefix + channel_names[rec.channel] + ".csv";
+    switch (static_cast<Channel>(rec.channel)) {
+      case Channel::kStateMachine:
+        out.write<StateMachine>(path, rec, payload);
+        break;
+      case Channel::kNavigation:
+        out.write<Navigation>(path, rec, payload);
+        break;
+      case Channel::kSensors:
+        out.write<Module>(path, rec, payload);
+        break;
+      case Channel::kSensorsImu:
+        out.write<DataPoint<array<Imu, Sensors::kNumImus>>>(path, rec, payload);
+        break;
+#ifdef PROXI
+      case Channel::kSensorsProxiFront:
+      case Channel::kSensorsProxiBack:
+        out.write<DataPoint<array<Proximity, Sensors::kNumProximities>>>(path, rec, payload);
+        break;
+#endif
+      case Channel::kSensorsKeyence:
+        out.write<array<StripeCounter, Sensors::kNumKeyence>>(path, rec, payload);
+        break;
+      case Channel::kSensorsOpticalEncoder:
+        out.write<array<float, Sensors::kNumOptEnc>>(path, rec, payload);
+        break;
+      case Channel::kMotors:
+        out.write<Motors>(path, rec, payload);
+        break;
+      case Channel::kBatteries:
+        out.write<Batteries>(path, rec, payload);
+        break;
+      case Channel::kCommunications:
+        out.write<Communications>(path, rec, payload);
+        break;
+      case Channel::kCalibration:
+        out.write<SensorCalibration>(path, rec, payload);
+        break;
+      case Channel::kEmergencyBrakes:
+        out.write<EmergencyBrakes>(path, rec, payload);
+        break;
+      default:
+        num_unknown++;
+        break;
+    }
+  }
+
+  for (int i = 0; i < static_cast<int>(Channel::kNumChannels); i++) {
+    if (!outputs[i].num_records_ && !outputs[i].num_bad_) continue;
+    printf("%-24s %8u records", channel_names[i], outputs[i].num_records_);
+    if (outputs[i].num_bad_) printf(", %u with wrong size", outputs[i].num_bad_);
+    printf("\n");
+  }
+  printf("%u kB decoded, %u incomplete records, %u unknown channels\n",
+      static_cast<uint32_t>(reader.getOffset() / 1024), reader.getNumIncomplete(), num_unknown);
+  return 0;
+}
@@ -70,6 +70,7 @@ void BmsManager::run()
       if (!bms_[i + data::Batteries::kNumLPBatteries]->isOnline()) (*hp_batteries_)[i].voltage = 0;
     }
     timestamp = utils::Timer::getTimeMicros();
+    notifyUpdate();
     sleep(100);
   }
 }
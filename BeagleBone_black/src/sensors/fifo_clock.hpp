@@ -0,0 +1,90 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description: Timestamps the frames drained from a sensor FIFO. The sensor samples at a fixed
+ *              output data rate on its own oscillator, so the frames of a drain are spaced by the
+ *              configured period, counted on from the previous drain. The newest frame was sampled
+ *              within one period before the drain, and the count is pulled back into that window
+ *              whenever the two oscillators have drifted apart, so no timestamp is off by more
+ *              than a period however long the sensor runs.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_SENSORS_FIFO_CLOCK_HPP_
+#define BEAGLEBONE_BLACK_SENSORS_FIFO_CLOCK_HPP_
+
+#include <cstdint>
+
+namespace hyped {
+namespace sensors {
+
+class FifoClock {
+ public:
+  explicit FifoClock(uint32_t period = 1000) : period_(period), last_(0), started_(false) {}
+
+  /**
+   * @brief    Sets the output data rate and forgets the previous drains, e.g. after the FIFO
+   *           has been reset
+   *
+   * @param[in]  period    Time between two frames, us
+   */
+  void reset(uint32_t period)
+  {
+    period_  = period;
+    started_ = false;
+  }
+
+  uint32_t getPeriod() const { return period_; }
+
+  /**
+   * @brief    Stamps the frames of one drain, oldest first. Timestamps increase strictly from one
+   *           drain to the next.
+   *
+   * @param[in]  now           Time of the drain, us
+   * @param[in]  num_frames    Number of frames drained
+   * @param[out] timestamps    Timestamp of each frame, us
+   */
+  void stamp(uint32_t now, int num_frames, uint32_t* timestamps)
+  {
+    if (num_frames <= 0) return;
+    // newest frame: counted on from the previous drain, but sampled in (now - period, now]
+    uint32_t newest = now;
+    if (started_) {
+      uint32_t counted = last_ + num_frames*period_;
+      int32_t age      = static_cast<int32_t>(now - counted);
+      if (age >= static_cast<int32_t>(period_)) {
+        newest = now - period_ + 1;
+      } else if (age >= 0) {
+        newest = counted;
+      }
+    }
+    for (int i = 0; i < num_frames; i++) {
+      uint32_t t = newest - (num_frames - 1 - i)*period_;
+      // the previous drain may have been stamped late, never go back on it
+      if (started_ && static_cast<int32_t>(t - last_) <= 0) t = last_ + 1;
+      timestamps[i] = t;
+      last_    = t;
+      started_ = true;
+    }
+  }
+
+ private:
+  uint32_t period_;
+  uint32_t last_;      // timestamp of the newest frame so far
+  bool started_;
+};
+
+}}  // namespace hyped::sensors
+
+#endif  // BEAGLEBONE_BLACK_SENSORS_FIFO_CLOCK_HPP_
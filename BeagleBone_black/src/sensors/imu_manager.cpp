@@ -21,11 +21,17 @@
 
 #include "sensors/imu_manager.hpp"
 
+#include <algorithm>
+
 #include "sensors/mpu9250.hpp"
 #include "data/data.hpp"
 #include "utils/timer.hpp"
 #include "sensors/fake_imu.hpp"
 
+// Without an interrupt for this many output data periods, the IMUs that have not signalled a new
+// sample are read anyway, which also tries to turn on the ones that are offline
+constexpr int kDataReadyTimeoutPeriods = 3;
+
 namespace hyped {
 
 using data::Data;
@@ -35,26 +41,26 @@ using data::NavigationVector;
 
 namespace sensors {
 
-ImuManager::ImuManager(Logger& log,
-                       ImuManager::DataArray *imu)
+constexpr int ImuManager::kFifoBatchFrames;
+constexpr int ImuManager::kDataReadyRate;
+constexpr uint8_t ImuManager::kUnknownPin;
+
+ImuManager::ImuManager(Logger& log)
     : ImuManagerInterface(log),
       sys_(System::getSystem()),
-      sensors_imu_(imu),
       chip_select_ {48, 49, 115, 117},
+      // TODO(anyone) Fill in the GPIOs of the INT lines of the IMUs from the wiring. Until then
+      // the IMUs are read without their data ready interrupts.
+      data_ready_pin_ {kUnknownPin, kUnknownPin, kUnknownPin, kUnknownPin},
+      is_fake_(sys_.fake_imu || sys_.fake_sensors),
       is_calibrated_(false),
       calib_counter_(0)
 {
-  old_timestamp_ = utils::Timer::getTimeMicros();
-
-  if (sys_.fake_imu || sys_.fake_sensors) is_fake_ = true;
-
   if (!is_fake_) {
-    // create IMUs
-    utils::io::SPI::getInstance().setClock(utils::io::SPI::Clock::k1MHz);
+    // create IMUs, each with its own SPI clock
     for (int i = 0; i < data::Sensors::kNumImus; i++) {
       imu_[i] = new MPU9250(log, chip_select_[i], 0x08, 0x00);
     }
-    utils::io::SPI::getInstance().setClock(utils::io::SPI::Clock::k20MHz);
   } else {
     if (sys_.fail_acc_imu) {
       for (int i = 0; i < data::Sensors::kNumImus - 1; i++) {
@@ -116,38 +122,134 @@ void ImuManager::run()
   }
   log_.INFO("IMU-MANAGER", "Calibration complete!");
 
+  if (!is_fake_ && sys_.imu_fifo > 0) runFifo();
+  if (!is_fake_ && hasDataReadyPins()) runDataReady();
+
   // collect real data
   while (1) {
-    for (int i = 0; i < data::Sensors::kNumImus; i++) {
-      imu_[i]->getData(&(sensors_imu_->value[i]));
+    if (is_fake_) {
+      for (int i = 0; i < data::Sensors::kNumImus; i++) {
+        imu_[i]->getData(&(sample_.value[i]));
+      }
+      Thread::sleep(20);
+    } else {
+      sweep();
     }
-    if (is_fake_) Thread::sleep(20);
-    sensors_imu_->timestamp = utils::Timer::getTimeMicros();
+    sample_.timestamp = utils::Timer::getTimeMicros();
+    publish(sample_);
   }
 }
 
-ImuManager::CalibrationArray ImuManager::getCalibrationData()
+void ImuManager::sweep()
 {
-  while (!is_calibrated_) {
-    Thread::yield();
+  bool queued[data::Sensors::kNumImus];
+  batch_.clear();
+  for (int i = 0; i < data::Sensors::kNumImus; i++) {
+    queued[i] = static_cast<MPU9250*>(imu_[i])->queueData(&batch_);
   }
+  utils::io::SPI::getInstance().submit(&batch_);
   for (int i = 0; i < data::Sensors::kNumImus; i++) {
-    imu_calibrations_[i][0] = stats_[i][0].getVariance();
-    imu_calibrations_[i][1] = stats_[i][1].getVariance();
+    // an IMU that is offline is read on its own, which tries to turn it on again
+    if (queued[i]) static_cast<MPU9250*>(imu_[i])->getQueuedData(&(sample_.value[i]));
+    else           imu_[i]->getData(&(sample_.value[i]));
+  }
+}
+
+void ImuManager::runFifo()
+{
+  // output data rate 1 kHz / (1 + divider)
+  int divider = std::max(0, std::min(1000 / sys_.imu_fifo - 1, 255));
+  uint32_t poll_millis = kFifoBatchFrames * (1 + divider);
+  for (int i = 0; i < data::Sensors::kNumImus; i++) {
+    static_cast<MPU9250*>(imu_[i])->enableFifo(divider);
+  }
+
+  data::DataPoint<Imu> frames[data::Sensors::kNumImus][MPU9250::kMaxFifoFrames];
+  int num_frames[data::Sensors::kNumImus];
+  while (1) {
+    int most = 0;
+    for (int i = 0; i < data::Sensors::kNumImus; i++) {
+      num_frames[i] = imu_[i]->getFifoData(frames[i], MPU9250::kMaxFifoFrames);
+      most = std::max(most, num_frames[i]);
+    }
+    // The IMUs sample on their own clocks, so one may have a frame more or less than another.
+    // Their newest frames go together, an IMU short of frames repeats its previous one.
+    for (int n = 0; n < most; n++) {
+      uint32_t timestamp = 0;
+      for (int i = 0; i < data::Sensors::kNumImus; i++) {
+        int k = num_frames[i] - most + n;
+        if (k < 0) continue;
+        sample_.value[i] = frames[i][k].value;
+        timestamp = std::max(timestamp, frames[i][k].timestamp);
+      }
+      sample_.timestamp = timestamp;
+      publish(sample_);
+    }
+    Thread::sleep(poll_millis);
   }
-  return imu_calibrations_;
 }
 
-bool ImuManager::updated()
+bool ImuManager::hasDataReadyPins() const
 {
-  if (old_timestamp_ != sensors_imu_->timestamp) {
-    return true;
+  for (int i = 0; i < data::Sensors::kNumImus; i++) {
+    if (data_ready_pin_[i] == kUnknownPin) return false;
   }
-  return false;
+  return true;
 }
 
-void ImuManager::resetTimestamp()
+void ImuManager::runDataReady()
 {
-  old_timestamp_ = sensors_imu_->timestamp;
+  static_assert(data::Sensors::kNumImus <= utils::io::gpio::kMaxWaitPins,
+                "GPIO::waitAny() cannot wait on the INT pins of all the IMUs");
+  int divider = std::max(0, std::min(1000 / kDataReadyRate - 1, 255));
+  int timeout_ms = kDataReadyTimeoutPeriods * (1 + divider);
+  for (int i = 0; i < data::Sensors::kNumImus; i++) {
+    data_ready_[i] = new utils::io::GPIO(data_ready_pin_[i], utils::io::gpio::kIn, log_,
+                                         utils::io::gpio::kRising);
+    static_cast<MPU9250*>(imu_[i])->enableDataReady(divider);
+  }
+
+  // IMUs read since the last publication
+  bool fresh[data::Sensors::kNumImus] = {};
+  bool changed[data::Sensors::kNumImus] = {};
+  while (1) {
+    int num_changed = utils::io::GPIO::waitAny(data_ready_, data::Sensors::kNumImus, timeout_ms,
+                                               changed);
+    // as close to the edge as the process can get
+    uint32_t timestamp = utils::Timer::getTimeMicros();
+    if (num_changed < 0) {
+      Thread::sleep(timeout_ms);
+      num_changed = 0;
+    }
+    bool all_fresh = true;
+    for (int i = 0; i < data::Sensors::kNumImus; i++) {
+      // An IMU on a faster clock may signal twice before the others, its newer sample wins
+      if (changed[i] || (num_changed == 0 && !fresh[i])) {
+        imu_[i]->getData(&(sample_.value[i]));
+        fresh[i] = true;
+      }
+      all_fresh &= fresh[i];
+    }
+    if (num_changed == 0) {
+      log_.DBG1("IMU-MANAGER", "No data ready interrupt for %d ms", timeout_ms);
+    }
+    if (all_fresh) {
+      sample_.timestamp = timestamp;
+      publish(sample_);
+      for (bool& f : fresh) f = false;
+    }
+  }
+}
+
+ImuManager::CalibrationArray ImuManager::getCalibrationData()
+{
+  while (!is_calibrated_) {
+    Thread::yield();
+  }
+  for (int i = 0; i < data::Sensors::kNumImus; i++) {
+    imu_calibrations_[i][0] = stats_[i][0].getVariance();
+    imu_calibrations_[i][1] = stats_[i][1].getVariance();
+  }
+  return imu_calibrations_;
 }
 }}  // namespace hyped::sensors
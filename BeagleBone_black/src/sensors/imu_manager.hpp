@@ -25,6 +25,8 @@
 
 #include "sensors/manager_interface.hpp"
 #include "utils/concurrent/thread.hpp"
+#include "utils/io/gpio.hpp"
+#include "utils/io/spi.hpp"
 #include "data/data.hpp"
 #include "sensors/interface.hpp"
 #include "utils/system.hpp"
@@ -42,19 +44,52 @@ namespace sensors {
 class ImuManager: public ImuManagerInterface {
   typedef array<array<NavigationVector, 2>, data::Sensors::kNumImus> CalibrationArray;
   typedef data::DataPoint<array<Imu, data::Sensors::kNumImus>>       DataArray;
+
  public:
-  ImuManager(Logger& log, DataArray *imu);
+  // Output data periods between two drains of the FIFOs. A drain costs a FIFO count read and a
+  // burst read however many frames it takes, and 8 frames are 96 of the 504 bytes that fit.
+  static constexpr int kFifoBatchFrames = 8;
+  // Output data rate (Hz) of the IMUs read on their INT pins
+  static constexpr int kDataReadyRate = 1000;
+  // Stands for an INT pin whose GPIO is not known yet
+  static constexpr uint8_t kUnknownPin = 0;
+
+  explicit ImuManager(Logger& log);
   void run()                            override;
-  bool updated()                        override;
-  void resetTimestamp()                 override;
   CalibrationArray getCalibrationData() override;
 
  private:
+  /**
+   * @brief Reads the data registers of all the IMUs into sample_ with one SPI::submit()
+   */
+  void sweep();
+
+  /**
+   * @brief Work loop with the IMUs sampling into their FIFOs at sys_.imu_fifo Hz. Drains all of
+   *        them in turn every kFifoBatchFrames periods and publishes their samples one at a
+   *        time, oldest first.
+   */
+  void runFifo();
+
+  /**
+   * @brief Whether the GPIOs of the INT pins of all the IMUs are known
+   */
+  bool hasDataReadyPins() const;
+
+  /**
+   * @brief Work loop with the IMUs sampling at kDataReadyRate Hz. Sleeps until an IMU pulses its
+   *        INT pin and reads it then, and publishes once every IMU has a new sample.
+   */
+  void runDataReady();
+
   utils::System&    sys_;
-  DataArray*        sensors_imu_;
+  DataArray         sample_;    // being filled, published once complete
 
   uint8_t           chip_select_[data::Sensors::kNumImus];
+  uint8_t           data_ready_pin_[data::Sensors::kNumImus];
+  utils::io::GPIO*  data_ready_[data::Sensors::kNumImus];
   ImuInterface*     imu_[data::Sensors::kNumImus];
+  utils::io::spi::Batch batch_;
   CalibrationArray  imu_calibrations_;
   bool              is_fake_;
   bool              is_calibrated_;
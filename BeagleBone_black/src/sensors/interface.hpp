@@ -23,6 +23,7 @@
 
 #include <string>
 #include "data/data.hpp"
+#include "utils/timer.hpp"
 
 namespace hyped {
 
@@ -62,6 +63,20 @@ class ImuInterface: public SensorInterface {
    * @param imu - output pointer to be filled by this sensor
    */
   virtual void getData(Imu* imu) = 0;
+
+  /**
+   * @brief Get every IMU sample since the last call, oldest first. Sensors without a FIFO
+   *        return their current reading stamped with the current time.
+   * @param frames     - output array to be filled by this sensor
+   * @param max_frames - size of the array, at least 1
+   * @return number of samples written, 0 if there is no new one yet
+   */
+  virtual int getFifoData(data::DataPoint<Imu>* frames, int max_frames)
+  {
+    getData(&frames[0].value);
+    frames[0].timestamp = utils::Timer::getTimeMicros();
+    return 1;
+  }
 };
 
 class BMSInterface: public SensorInterface {
@@ -35,6 +35,8 @@
 #include "sensors/em_brake.hpp"
 
 constexpr float kWheelDiameter = 0.08;   // TODO(anyone) Get wheel radius for optical encoder
+// IMUs drive the work loop, other managers are checked at least this often
+constexpr uint32_t kMaxWaitMillis = 10;
 namespace hyped {
 
 using data::Data;
@@ -50,16 +52,17 @@ Main::Main(uint8_t id, Logger& log)
     : Thread(id, log),
       data_(data::Data::getInstance()),
       sys_(System::getSystem()),
-      imu_manager_(new ImuManager(log, &sensors_.imu)),
+      imu_manager_(new ImuManager(log)),
 #ifdef PROXI
-      proxi_manager_front_(new ProxiManager(log, true, &sensors_.proxi_front)),
-      proxi_manager_back_(new ProxiManager(log, false, &sensors_.proxi_back)),
+      proxi_manager_front_(new ProxiManager(log, true)),
+      proxi_manager_back_(new ProxiManager(log, false)),
 #endif
       battery_manager_(new BmsManager(log,
                                          &batteries_.low_power_batteries,
                                          &batteries_.high_power_batteries)),
       sensor_init_(false),
-      battery_init_(false)
+      battery_init_(false),
+      imu_dropped_(0)
 {
   // @TODO (Anyone) Check THESE PINS
   if (sys_.fake_sensors || sys_.fake_keyence) {
@@ -109,6 +112,11 @@ void Main::run()
     && proxi_manager_front_->updated() && proxi_manager_back_->updated()
 #endif
       ) {
+      imu_manager_->getSample(&sensors_.imu);
+#ifdef PROXI
+      proxi_manager_front_->getSample(&sensors_.proxi_front);
+      proxi_manager_back_->getSample(&sensors_.proxi_back);
+#endif
       data_.setSensorsData(sensors_);
 
       // Get calibration data
@@ -123,7 +131,7 @@ void Main::run()
 
       break;
     }
-    yield();
+    imu_manager_->waitForUpdate(kMaxWaitMillis);
   }
   log_.INFO("SENSORS", "sensors data has been initialised");
   while (!battery_init_) {
@@ -132,36 +140,53 @@ void Main::run()
       battery_init_ = true;
       break;
     }
-    yield();
+    battery_manager_->waitForUpdate(kMaxWaitMillis);
   }
   log_.INFO("SENSORS", "batteries data has been initialised");
 
   if (sensor_init_) sensors_.module_status = data::ModuleStatus::kInit;
   if (battery_init_) batteries_.module_status = data::ModuleStatus::kInit;
+  data_.setSensorsData(sensors_);
 
-  // work loop
+  // work loop, each sensors channel is published only when its values change
   while (sys_.running_) {
-    // Write sensor data to data structure only when all the imu or proxi values are different
-    if (imu_manager_->updated()) {
-      sensors_.keyence_stripe_counter[0] = keyence_l_->getStripeCounter();
-      sensors_.keyence_stripe_counter[1] = keyence_r_->getStripeCounter();
-      sensors_.optical_enc_distance[0] = optical_encoder_l_->getStripeCounter().count.value *
-                                      M_PI *
-                                      kWheelDiameter;
-      sensors_.optical_enc_distance[1] = optical_encoder_r_->getStripeCounter().count.value *
-                                      M_PI *
-                                      kWheelDiameter;
-      data_.setSensorsData(sensors_);
-      // Update manager timestamp with a function
-      imu_manager_->resetTimestamp();
+    // every IMU sample, in order, so that navigation can integrate all of them
+    while (imu_manager_->getSample(&sensors_.imu)) {
+      data_.setSensorsImuData(sensors_.imu);
+    }
+    uint32_t imu_dropped = imu_manager_->getNumDropped();
+    if (imu_dropped != imu_dropped_) {
+      log_.ERR("SENSORS", "fell behind the IMUs, %u samples dropped so far", imu_dropped);
+      imu_dropped_ = imu_dropped;
     }
 #ifdef PROXI
-    if (proxi_manager_front_->updated() && proxi_manager_back_->updated()) {
-      data_.setSensorsData(sensors_);
-      proxi_manager_front_->resetTimestamp();
-      proxi_manager_back_->resetTimestamp();
+    while (proxi_manager_front_->getSample(&sensors_.proxi_front)) {
+      data_.setSensorsProxiFrontData(sensors_.proxi_front);
+    }
+    while (proxi_manager_back_->getSample(&sensors_.proxi_back)) {
+      data_.setSensorsProxiBackData(sensors_.proxi_back);
     }
 #endif
+    array<StripeCounter, Sensors::kNumKeyence> keyence = {{
+      keyence_l_->getStripeCounter(),
+      keyence_r_->getStripeCounter()
+    }};
+    if (keyence[0].count.value != sensors_.keyence_stripe_counter[0].count.value ||
+        keyence[1].count.value != sensors_.keyence_stripe_counter[1].count.value) {
+      sensors_.keyence_stripe_counter = keyence;
+      data_.setSensorsKeyenceData(keyence);
+    }
+    array<float, Sensors::kNumOptEnc> optical_enc_distance = {{
+      static_cast<float>(optical_encoder_l_->getStripeCounter().count.value *
+                         M_PI * kWheelDiameter),
+      static_cast<float>(optical_encoder_r_->getStripeCounter().count.value *
+                         M_PI * kWheelDiameter)
+    }};
+    if (optical_enc_distance != sensors_.optical_enc_distance) {
+      sensors_.optical_enc_distance = optical_enc_distance;
+      data_.setSensorsOpticalEncoderData(optical_enc_distance);
+    }
+
     // Update battery data only when there is some change
     if (battery_manager_->updated()) {
       battery_manager_->resetTimestamp();
@@ -177,7 +202,7 @@ void Main::run()
       // publish the new data
       data_.setBatteryData(batteries_);
     }
-    yield();
+    imu_manager_->waitForUpdate(kMaxWaitMillis);
   }
 }
 
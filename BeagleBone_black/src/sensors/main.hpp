@@ -81,6 +81,7 @@ class Main: public Thread {
 
   bool sensor_init_;
   bool battery_init_;
+  uint32_t imu_dropped_;    // IMU samples the manager has dropped, as last logged
 };
 
 }}  // namespace hyped::sensors
@@ -22,6 +22,9 @@
 #define BEAGLEBONE_BLACK_SENSORS_MANAGER_INTERFACE_HPP_
 
 #include "data/data.hpp"
+#include "utils/concurrent/condition_variable.hpp"
+#include "utils/concurrent/lock.hpp"
+#include "utils/concurrent/spsc_ring.hpp"
 #include "utils/concurrent/thread.hpp"
 
 namespace hyped {
@@ -31,6 +34,10 @@ using data::Imu;
 using data::Proximity;
 #endif
 using data::Battery;
+using utils::concurrent::ConditionVariable;
+using utils::concurrent::Lock;
+using utils::concurrent::ScopedLock;
+using utils::concurrent::SpscRing;
 using utils::concurrent::Thread;
 using data::NavigationVector;
 
@@ -45,19 +52,86 @@ class ManagerInterface : public Thread {
   virtual bool updated() = 0;
   virtual void resetTimestamp() = 0;
   ManagerInterface(utils::Logger& log) : Thread(log), old_timestamp_(0) {}
+
+  /**
+   * @brief Blocks until updated() becomes true or `timeout_ms` milliseconds elapse
+   *
+   * @return true iff the data has been updated
+   */
+  bool waitForUpdate(uint32_t timeout_ms)
+  {
+    ScopedLock L(&update_lock_);
+    if (!updated()) update_cv_.wait(&update_lock_, timeout_ms);
+    return updated();
+  }
+
  protected:
+  /**
+   * @brief To be called by the manager thread after every update of its data
+   */
+  void notifyUpdate()
+  {
+    { ScopedLock L(&update_lock_); }
+    update_cv_.notifyAll();
+  }
+
   uint64_t old_timestamp_;
+
+ private:
+  Lock update_lock_;
+  ConditionVariable update_cv_;
+};
+
+/**
+ * @brief Manager that hands every complete, timestamped sample of its sensors to sensors::Main
+ *        through a ring, instead of updating a structure that Main reads at the same time
+ */
+template <typename Sample, int N>
+class SampleManagerInterface : public ManagerInterface {
+ public:
+  SampleManagerInterface(utils::Logger& log) : ManagerInterface(log) {}
+
+  bool updated() override { return !samples_.empty(); }
+  void resetTimestamp() override {}
+
+  /**
+   * @brief Takes the oldest sample not taken yet. Only to be called by one thread, sensors::Main.
+   * @return false iff there is none
+   */
+  bool getSample(Sample* sample) { return samples_.pop(sample); }
+
+  /**
+   * @brief Number of samples dropped because sensors::Main fell behind by N samples
+   */
+  uint32_t getNumDropped() const { return samples_.getNumDropped(); }
+
+ protected:
+  /**
+   * @brief To be called by the manager thread with each complete sample
+   */
+  void publish(const Sample& sample)
+  {
+    samples_.push(sample);
+    notifyUpdate();
+  }
+
+ private:
+  SpscRing<Sample, N> samples_;
 };
 
-class ImuManagerInterface : public ManagerInterface {
+// 64 ms of samples at 1 kHz
+class ImuManagerInterface
+    : public SampleManagerInterface<data::DataPoint<array<Imu, data::Sensors::kNumImus>>, 64> {
  public:
-  ImuManagerInterface(utils::Logger& log) : ManagerInterface(log) {}
+  ImuManagerInterface(utils::Logger& log) : SampleManagerInterface(log) {}
   virtual array<array<NavigationVector, 2>, data::Sensors::kNumImus> getCalibrationData() = 0;
 };
 #ifdef PROXI
-class ProxiManagerInterface : public ManagerInterface {
+class ProxiManagerInterface
+    : public SampleManagerInterface<data::DataPoint<array<Proximity,
+                                                          data::Sensors::kNumProximities>>, 8> {
  public:
-  ProxiManagerInterface(utils::Logger& log) : ManagerInterface(log) {}
+  ProxiManagerInterface(utils::Logger& log) : SampleManagerInterface(log) {}
   virtual array<float, data::Sensors::kNumProximities> getCalibrationData() = 0;
 };
 #endif
@@ -19,9 +19,13 @@
  */
 #include "sensors/mpu9250.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "utils/concurrent/thread.hpp"
 #include "utils/logger.hpp"
 #include "utils/math/statistics.hpp"
+#include "utils/timer.hpp"
 
 // Accelerometer addresses
 constexpr uint8_t kAccelXoutH               = 0x3B;
@@ -40,9 +44,25 @@ constexpr uint8_t kMpuRegPwrMgmt1           = 0x6B;
 
 // Configuration
 constexpr uint8_t kMpuRegConfig             = 0x1A;
+constexpr uint8_t kSmplrtDiv                = 0x19;
+constexpr uint8_t kUserCtrl                 = 0x6A;
+
+// Interrupts
+constexpr uint8_t kIntPinCfg                = 0x37;
+constexpr uint8_t kIntEnable                = 0x38;
+
+// FIFO
+constexpr uint8_t kFifoEn                   = 0x23;
+constexpr uint8_t kFifoCountH               = 0x72;
+constexpr uint8_t kFifoRW                   = 0x74;
 
 constexpr uint8_t kReadFlag                 = 0x80;
 
+// SPI clock polarity and phase high
+constexpr uint8_t  kSpiMode                 = 3;
+constexpr uint32_t kConfigClock             = 1000000;    // Hz
+constexpr uint32_t kDataClock               = 20000000;   // Hz
+
 // Configuration bits mpu9250
 constexpr uint8_t kBitsFs250Dps             = 0x00;
 constexpr uint8_t kBitsFs500Dps             = 0x08;
@@ -56,6 +76,20 @@ constexpr uint8_t kBitsFs16G                = 0x18;
 // Resets the device to defaults
 constexpr uint8_t kBitHReset                = 0x80;
 
+// Digital low pass filter of 184 Hz, which makes the gyroscope sample at 1 kHz
+constexpr uint8_t kBitsDlpf184Hz            = 0x01;
+// Stop writing to the FIFO once it is full instead of overwriting, which would split frames
+constexpr uint8_t kBitFifoMode              = 0x40;
+constexpr uint8_t kBitsFifoAccelGyro        = 0x78;   // XG, YG, ZG and ACCEL into the FIFO
+constexpr uint8_t kBitFifoEnable            = 0x40;
+constexpr uint8_t kBitI2cIfDis              = 0x10;   // SPI only
+constexpr uint8_t kBitFifoReset             = 0x04;
+constexpr uint32_t kInternalSamplePeriod    = 1000;   // us, with the low pass filter on
+// INT pin active high, push-pull, a 50 us pulse per interrupt: a read that is late or missed
+// does not hold the pin and so cannot hide the next edge
+constexpr uint8_t kBitsIntPulseHigh         = 0x00;
+constexpr uint8_t kBitRawRdyEn              = 0x01;
+
 namespace hyped {
 
 utils::io::gpio::Direction kDirection = utils::io::gpio::kOut;
@@ -65,12 +99,23 @@ using data::NavigationVector;
 
 namespace sensors {
 
+constexpr int MPU9250::kFifoFrameSize;
+constexpr int MPU9250::kFifoSize;
+constexpr int MPU9250::kMaxFifoFrames;
+
 MPU9250::MPU9250(Logger& log, uint32_t pin, uint8_t acc_scale, uint8_t gyro_scale)
     : log_(log),
     gpio_(pin, kDirection, log),
+    config_spi_(kConfigClock, kSpiMode, this),
+    data_spi_(kDataClock, kSpiMode, this),
     acc_scale_(acc_scale),
     gyro_scale_(gyro_scale),
-    is_online_(false)
+    is_online_(false),
+    fifo_enabled_(false),
+    data_ready_enabled_(false),
+    sample_rate_divider_(0),
+    fifo_overflows_(0),
+    queued_data_(nullptr)
 {
   init();
   log_.DBG("MPU9250", "Creating IMU sensor");
@@ -86,10 +131,13 @@ void MPU9250::init()
   // Test connection
   whoAmI();
 
-  writeByte(kMpuRegConfig, 0x01);
+  writeByte(kMpuRegConfig, kBitsDlpf184Hz);
   writeByte(kAccelConfig2, 0x01);
   setAcclScale(acc_scale_);
   setGyroScale(gyro_scale_);
+  // the reset has cleared the FIFO and interrupt configuration too
+  if (fifo_enabled_) configureFifo();
+  if (data_ready_enabled_) configureDataReady();
   log_.INFO("MPU9250", "IMU sensor created. Initialisation complete");
 }
 
@@ -125,32 +173,24 @@ MPU9250::~MPU9250()
 
 void MPU9250::writeByte(uint8_t write_reg, uint8_t write_data)
 {
-  // ',' instead of ';' is to inform the compiler not to reorder function calls
-  // chip selects signals must have exact ordering with respect to the spi access
-  select(),
-  spi_.write(write_reg, &write_data, 1),
-  deSelect();
+  config_spi_.write(write_reg, &write_data, 1);
 }
 
 void MPU9250::readByte(uint8_t read_reg, uint8_t *read_data)
 {
-  select(),
-  spi_.read(read_reg | kReadFlag, read_data, 1),
-  deSelect();
+  config_spi_.read(read_reg | kReadFlag, read_data, 1);
 }
 
-void MPU9250::readBytes(uint8_t read_reg, uint8_t *read_data, uint8_t length)
+void MPU9250::readBytes(uint8_t read_reg, uint8_t *read_data, uint16_t length)
 {
-  select(),
-  spi_.read(read_reg | kReadFlag, read_data, length),
-  deSelect();
+  data_spi_.read(read_reg | kReadFlag, read_data, length);
 }
 
 void MPU9250::select()
 {
   gpio_.clear();
 }
-void  MPU9250::deSelect()
+void MPU9250::deselect()
 {
   gpio_.set();
 }
@@ -195,36 +235,26 @@ void MPU9250::setAcclScale(int scale)
   }
 }
 
+void MPU9250::decode(const uint8_t* acc, const uint8_t* gyr, Imu* imu)
+{
+  for (int i = 0; i < 3; i++) {
+    int16_t bit_data = ((int16_t) acc[i*2] << 8) | acc[i*2+1];
+    imu->acc[i] = static_cast<float>(bit_data)/acc_divider_  * 9.80665;
+
+    bit_data = ((int16_t) gyr[i*2] << 8) | gyr[i*2+1];
+    imu->gyr[i] = static_cast<float>(bit_data)/gyro_divider_ * M_PI/180;   // deg/s to rad/s
+  }
+  imu->operational = is_online_;
+}
+
 void MPU9250::getData(Imu* imu)
 {
   if (is_online_) {
     log_.DBG3("MPU9250", "Getting IMU data");
-    auto& acc = imu->acc;
-    auto& gyr = imu->gyr;
     uint8_t response[14];
-    int16_t bit_data;
-    float data;
-    int i;
-    float accel_data[3];
-    float gyro_data[3];
-
+    // the temperature is in between
     readBytes(kAccelXoutH, response, 14);
-    for (i = 0; i < 3; i++) {
-      bit_data = ((int16_t) response[i*2] << 8) | response[i*2+1];
-      data = static_cast<float>(bit_data);
-      accel_data[i] = data/acc_divider_  * 9.80665;
-
-      bit_data = ((int16_t) response[i*2 + 8] << 8) | response[i*2+9];
-      data = static_cast<float>(bit_data);
-      gyro_data[i] = data/gyro_divider_;
-    }
-    imu->operational = is_online_;
-    acc[0] = accel_data[0];
-    acc[1] = accel_data[1];
-    acc[2] = accel_data[2];
-    gyr[0] = gyro_data[0];
-    gyr[1] = gyro_data[1];
-    gyr[2] = gyro_data[2];
+    decode(response, response + 8, imu);
   } else {
     // Try and turn the sensor on again
     log_.ERR("MPU9250", "Sensor not operational, trying to turn on sensor");
@@ -232,4 +262,100 @@ void MPU9250::getData(Imu* imu)
   }
 }
 
+bool MPU9250::queueData(spi::Batch* batch)
+{
+  queued_data_ = nullptr;
+  if (!is_online_) return false;
+  batch->select(&data_spi_);
+  // the temperature is in between
+  queued_data_ = batch->read(kAccelXoutH | kReadFlag, 14);
+  batch->select(nullptr);
+  return queued_data_ != nullptr;
+}
+
+void MPU9250::getQueuedData(Imu* imu)
+{
+  if (queued_data_) decode(queued_data_, queued_data_ + 8, imu);
+}
+
+void MPU9250::enableFifo(uint8_t sample_rate_divider)
+{
+  sample_rate_divider_ = sample_rate_divider;
+  fifo_enabled_        = true;
+  fifo_overflows_      = 0;
+  configureFifo();
+  log_.INFO("MPU9250", "FIFO enabled at %u Hz",
+      1000000 / (kInternalSamplePeriod * (1 + sample_rate_divider)));
+}
+
+void MPU9250::enableDataReady(uint8_t sample_rate_divider)
+{
+  sample_rate_divider_ = sample_rate_divider;
+  data_ready_enabled_  = true;
+  configureDataReady();
+  log_.INFO("MPU9250", "Data ready interrupt enabled at %u Hz",
+      1000000 / (kInternalSamplePeriod * (1 + sample_rate_divider)));
+}
+
+void MPU9250::configureDataReady()
+{
+  writeByte(kSmplrtDiv, sample_rate_divider_);
+  writeByte(kIntPinCfg, kBitsIntPulseHigh);
+  writeByte(kIntEnable, kBitRawRdyEn);
+}
+
+void MPU9250::configureFifo()
+{
+  // stop the FIFO while it is configured
+  writeByte(kFifoEn, 0);
+  writeByte(kUserCtrl, kBitI2cIfDis);
+  writeByte(kSmplrtDiv, sample_rate_divider_);
+  writeByte(kMpuRegConfig, kBitFifoMode | kBitsDlpf184Hz);
+  resetFifo();
+  writeByte(kFifoEn, kBitsFifoAccelGyro);
+}
+
+void MPU9250::resetFifo()
+{
+  writeByte(kUserCtrl, kBitI2cIfDis | kBitFifoReset);
+  writeByte(kUserCtrl, kBitI2cIfDis | kBitFifoEnable);
+  fifo_clock_.reset(kInternalSamplePeriod * (1 + sample_rate_divider_));
+}
+
+int MPU9250::getFifoData(DataPoint<Imu>* frames, int max_frames)
+{
+  if (!fifo_enabled_) return ImuInterface::getFifoData(frames, max_frames);
+  if (!is_online_) {
+    log_.ERR("MPU9250", "Sensor not operational, trying to turn on sensor");
+    init();
+    return 0;
+  }
+
+  uint8_t count_data[2];
+  readBytes(kFifoCountH, count_data, 2);
+  uint32_t now = utils::Timer::getTimeMicros();
+  int count = ((count_data[0] & 0x1F) << 8) | count_data[1];
+  // Once there is no room for another frame the sensor has stopped writing, and a count that is
+  // not a whole number of frames means the FIFO is out of step with us
+  if (count > kFifoSize - kFifoFrameSize || count % kFifoFrameSize != 0) {
+    fifo_overflows_++;
+    log_.DBG1("MPU9250", "FIFO overflow at %d bytes, resetting it", count);
+    resetFifo();
+    return 0;
+  }
+
+  int num_frames = std::min(count / kFifoFrameSize, max_frames);
+  if (num_frames <= 0) return 0;
+  readBytes(kFifoRW, fifo_buffer_, num_frames * kFifoFrameSize);
+
+  uint32_t timestamps[kMaxFifoFrames];
+  fifo_clock_.stamp(now, num_frames, timestamps);
+  for (int i = 0; i < num_frames; i++) {
+    const uint8_t* frame = fifo_buffer_ + i * kFifoFrameSize;
+    decode(frame, frame + 6, &frames[i].value);
+    frames[i].timestamp = timestamps[i];
+  }
+  return num_frames;
+}
+
 }}   // namespace hyped::sensors
@@ -21,6 +21,7 @@
 #ifndef BEAGLEBONE_BLACK_SENSORS_MPU9250_HPP_
 #define BEAGLEBONE_BLACK_SENSORS_MPU9250_HPP_
 
+#include "sensors/fifo_clock.hpp"
 #include "sensors/interface.hpp"
 #include "utils/logger.hpp"
 #include "utils/io/spi.hpp"
@@ -29,15 +30,22 @@
 
 namespace hyped {
 
-using hyped::utils::io::SPI;
+using hyped::utils::io::SpiDevice;
+namespace spi = utils::io::spi;
 using utils::Logger;
 using utils::io::GPIO;
 using data::NavigationVector;
+using data::DataPoint;
 
 namespace sensors {
 
-class MPU9250 : public ImuInterface {
+class MPU9250 : public ImuInterface, public spi::ChipSelect {
  public:
+  // A FIFO frame is the accelerometer then the gyroscope, 3 big-endian 16 bit axes each
+  static constexpr int kFifoFrameSize = 12;
+  static constexpr int kFifoSize      = 512;
+  static constexpr int kMaxFifoFrames = kFifoSize / kFifoFrameSize;
+
   MPU9250(Logger& log, uint32_t pin, uint8_t acc_scale = 0x08, uint8_t gyro_scale = 0x00);
   ~MPU9250();
   /*
@@ -53,6 +61,52 @@ class MPU9250 : public ImuInterface {
    */
   void getData(Imu* imu) override;
 
+  /*
+   *  @brief Queues a read of the data registers into the batch, for a sweep of several sensors
+   *         in one SPI::submit(). getQueuedData() decodes it once submitted.
+   *
+   *  @return false if the sensor is offline or the batch full, nothing is queued then
+   */
+  bool queueData(spi::Batch* batch);
+
+  /*
+   *  @brief Decodes the data read by the batch last given to queueData(), once submitted
+   */
+  void getQueuedData(Imu* imu);
+
+  /*
+   *  @brief Drive the chip select GPIO, for SPI
+   */
+  void select()   override;
+  void deselect() override;
+
+  /*
+   *  @brief Makes the sensor sample at 1 kHz / (1 + sample_rate_divider) into its FIFO, which
+   *         getFifoData() then drains. Empties the FIFO.
+   */
+  void enableFifo(uint8_t sample_rate_divider);
+
+  /*
+   *  @brief Reads all the frames in the FIFO, up to max_frames, in one SPI transfer after the
+   *         one of the FIFO count. Frames are stamped from the output data rate. If the FIFO
+   *         has filled up, frames may be lost: it is emptied and nothing is returned.
+   *         Without enableFifo() this is a single getData() stamped with the current time.
+   *
+   *  @return the number of frames written to `frames`
+   */
+  int getFifoData(DataPoint<Imu>* frames, int max_frames) override;
+
+  /*
+   *  @brief Makes the sensor sample at 1 kHz / (1 + sample_rate_divider) and pulse its INT pin
+   *         high for 50 us whenever a new sample is in the data registers
+   */
+  void enableDataReady(uint8_t sample_rate_divider);
+
+  /*
+   *  @brief Number of times the FIFO has filled up and been emptied since enableFifo()
+   */
+  uint32_t getFifoOverflows() const { return fifo_overflows_; }
+
  private:
   /*
    *  @brief Sets the range for the gyroscope
@@ -64,20 +118,31 @@ class MPU9250 : public ImuInterface {
   void setAcclScale(int scale);
   static const uint64_t time_start;
   void init();
-  void select();
-  void deSelect();
   bool whoAmI();
   void writeByte(uint8_t write_reg, uint8_t write_data);
   void readByte(uint8_t read_reg, uint8_t *read_data);
-  void readBytes(uint8_t read_reg, uint8_t *read_buff, uint8_t length);
-  SPI& spi_ = SPI::getInstance();
+  void readBytes(uint8_t read_reg, uint8_t *read_buff, uint16_t length);
+  void configureFifo();
+  void configureDataReady();
+  void resetFifo();
+  // converts the big-endian readings to m/s^2 and rad/s
+  void decode(const uint8_t* acc, const uint8_t* gyr, Imu* imu);
   Logger& log_;
   GPIO gpio_;
+  SpiDevice config_spi_;    // for all the registers
+  SpiDevice data_spi_;      // faster, for the sensor and FIFO registers only
   uint8_t acc_scale_;
   uint8_t gyro_scale_;
   double acc_divider_;
   double gyro_divider_;
   bool is_online_;
+  bool fifo_enabled_;
+  bool data_ready_enabled_;
+  uint8_t sample_rate_divider_;
+  uint32_t fifo_overflows_;
+  FifoClock fifo_clock_;
+  uint8_t fifo_buffer_[kFifoSize];
+  const uint8_t* queued_data_;    // in the batch of queueData()
 };
 
 }}  // namespace hyped::sensors
@@ -41,16 +41,13 @@ using utils::math::OnlineStatistics;
 namespace sensors {
 
 ProxiManager::ProxiManager(Logger& log,
-                           bool is_front,
-                           ProxiManager::DataArray *proxi)
+                           bool is_front)
     : ProxiManagerInterface(log),
-      sensors_proxi_(proxi),
       i2c_(I2C::getInstance()),
       is_front_(is_front),
       is_calibrated_(false)
 {
   System& sys = System::getSystem();
-  old_timestamp_ = utils::Timer::getTimeMicros();
   if (sys.fake_proxi || sys.fake_sensors) is_fake_ = true;
 
   if (is_fake_) {
@@ -118,9 +115,10 @@ void ProxiManager::run()
       if (is_front_) {
         i2c_.write(kMultiplexerAddr, 0x01 << i);
       }
-      proxi_[i]->getData(&(sensors_proxi_->value[i]));
+      proxi_[i]->getData(&(sample_.value[i]));
     }
-    sensors_proxi_->timestamp = utils::Timer::getTimeMicros();
+    sample_.timestamp = utils::Timer::getTimeMicros();
+    publish(sample_);
   }
 }
 
@@ -135,17 +133,5 @@ ProxiManager::CalibrationArray ProxiManager::getCalibrationData()
   return proxi_calibration_;
 }
 
-bool ProxiManager::updated()
-{
-  if (old_timestamp_ != sensors_proxi_->timestamp) {
-    return true;
-  }
-  return false;
-}
-
-void ProxiManager::resetTimestamp()
-{
-  old_timestamp_ = sensors_proxi_->timestamp;
-}
 }}  // namespace hyped::sensors
 #endif
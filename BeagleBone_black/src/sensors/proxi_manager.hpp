@@ -47,15 +47,12 @@ class ProxiManager: public ProxiManagerInterface {
   typedef data::DataPoint<array<Proximity, data::Sensors::kNumProximities>> DataArray;
  public:
   ProxiManager(Logger& log,
-               bool isFront,
-               DataArray *proxi);
+               bool isFront);
   void run()                            override;
-  bool updated()                        override;
-  void resetTimestamp()                 override;
   CalibrationArray getCalibrationData() override;
 
  private:
-  DataArray*        sensors_proxi_;
+  DataArray         sample_;    // being filled, published once complete
   CalibrationArray  proxi_calibration_;
   ProxiInterface*   proxi_[data::Sensors::kNumProximities];
   I2C&              i2c_;
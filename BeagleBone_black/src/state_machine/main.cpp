@@ -32,6 +32,10 @@
 namespace hyped {
 namespace state_machine {
 
+// The state machine sleeps until navigation publishes, but re-checks the other modules at least
+// this often
+constexpr uint32_t kMaxWaitMillis = 5;
+
 Main::Main(uint8_t id, Logger& log)
     : Thread(id, log),
       hypedMachine(log),
@@ -47,6 +51,7 @@ void Main::run()
 {
   utils::System& sys = utils::System::getSystem();
   while (sys.running_) {
+    uint32_t nav_version = data_.getVersion(data::Channel::kNavigation);
     comms_data_     = data_.getCommunicationsData();
     nav_data_       = data_.getNavigationData();
     sm_data_        = data_.getStateMachineData();
@@ -97,7 +102,7 @@ void Main::run()
         break;
     }
 
-    yield();
+    data_.waitForUpdate(data::Channel::kNavigation, nav_version, kMaxWaitMillis);
   }
 }
 
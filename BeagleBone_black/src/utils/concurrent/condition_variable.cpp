@@ -20,6 +20,8 @@
 
 #include "utils/concurrent/condition_variable.hpp"
 
+#include <chrono>
+
 #include "utils/concurrent/lock.hpp"
 
 namespace hyped {
@@ -51,5 +53,11 @@ void ConditionVariable::wait(Lock* lock)
   cond_var_->wait(*lock->mutex_);
 }
 
+bool ConditionVariable::wait(Lock* lock, uint32_t timeout_ms)
+{
+  return cond_var_->wait_for(*lock->mutex_, std::chrono::milliseconds(timeout_ms))
+      == std::cv_status::no_timeout;
+}
+
 }}}   // hyped::utils::concurrent
 
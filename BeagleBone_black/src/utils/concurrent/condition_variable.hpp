@@ -24,6 +24,7 @@
 #define CV  condition_variable_any
 
 #include <condition_variable>
+#include <cstdint>
 
 namespace hyped {
 namespace utils {
@@ -56,6 +57,14 @@ class ConditionVariable {
    */
   void wait(Lock* lock);
 
+  /**
+   * @brief      Same as wait(lock) but gives up after `timeout_ms` milliseconds. As with wait(),
+   *             the caller must re-check its condition after return (spurious wakeups).
+   *
+   * @return     False iff the timeout expired before being notified.
+   */
+  bool wait(Lock* lock, uint32_t timeout_ms);
+
  private:
   std::CV* cond_var_;
 };
@@ -0,0 +1,129 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 23/07/2018
+ * Description:
+ * Sequence lock protecting a single trivially copyable value. Writers are serialised by an
+ * internal lock and bump a sequence counter before and after every update. Readers never block
+ * or take a lock; they copy the value optimistically and retry if a writer was active during the
+ * copy. Suited for small structures that are written by one module and polled by many.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_CONCURRENT_SEQLOCK_HPP_
+#define BEAGLEBONE_BLACK_UTILS_CONCURRENT_SEQLOCK_HPP_
+
+#include <thread>
+#include <type_traits>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/concurrent/lock.hpp"
+#include "utils/utils.hpp"
+
+namespace hyped {
+namespace utils {
+namespace concurrent {
+
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock can only protect trivially copyable types");
+
+ public:
+  SeqLock() : sequence_(0), value_() {}
+
+  /**
+   * @brief      Copy out a consistent snapshot of the value. Never blocks on writers, retries
+   *             while a write is in progress.
+   */
+  T read() const
+  {
+    T copy;
+    readInto(&copy, &value_, sizeof(T));
+    return copy;
+  }
+
+  /**
+   * @brief      Copy out a consistent snapshot of a single member of the value, e.g.
+   *             `seq.read(&Sensors::imu)`. Cheaper than `read()` for large values.
+   */
+  template <typename M>
+  M read(M T::* member) const
+  {
+    static_assert(std::is_trivially_copyable<M>::value, "member must be trivially copyable");
+    M copy;
+    readInto(&copy, &(value_.*member), sizeof(M));
+    return copy;
+  }
+
+  /**
+   * @brief      Replace the whole value.
+   */
+  void write(const T& value)
+  {
+    modify([&value](T* v) { *v = value; });
+  }
+
+  /**
+   * @brief      Update the value in place, e.g. to overwrite a single member. `f` is called with
+   *             a pointer to the stored value while readers are held off; keep it short.
+   */
+  template <typename F>
+  void modify(F f)
+  {
+    ScopedLock L(&write_lock_);
+    uint32_t seq = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    f(&value_);
+    sequence_.store(seq + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief      Number of completed writes so far.
+   */
+  uint32_t getVersion() const
+  {
+    return sequence_.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  void readInto(void* dst, const void* src, std::size_t size) const
+  {
+    for (;;) {
+      uint32_t before = sequence_.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        std::memcpy(dst, src, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) return;
+      }
+      // writer active, let it finish (important on a single core)
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<uint32_t> sequence_;
+  T value_;
+  Lock write_lock_;
+
+  NO_COPY_ASSIGN(SeqLock);
+};
+
+}}}   // namespace hyped::utils::concurrent
+
+#endif  // BEAGLEBONE_BLACK_UTILS_CONCURRENT_SEQLOCK_HPP_
@@ -0,0 +1,127 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Fixed size ring of values passed from exactly one producer thread to exactly one consumer
+ * thread. Both sides are wait-free: a push or a pop is a copy and a couple of atomic loads and
+ * stores, never a lock or a retry. When the ring is full the producer drops the new value and
+ * counts it, so a consumer that falls behind shows up in getNumDropped() instead of stalling the
+ * producer or tearing values.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_CONCURRENT_SPSC_RING_HPP_
+#define BEAGLEBONE_BLACK_UTILS_CONCURRENT_SPSC_RING_HPP_
+
+#include <cstdint>
+
+#include <atomic>
+#include <cstddef>
+
+#include "utils/utils.hpp"
+
+namespace hyped {
+namespace utils {
+namespace concurrent {
+
+/**
+ * @tparam T    Type of the values, copied in and out
+ * @tparam N    Capacity, a power of two
+ */
+template <typename T, int N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+ public:
+  SpscRing() : head_(0), cached_tail_(0), tail_(0), cached_head_(0), num_dropped_(0) {}
+
+  /**
+   * @brief      Appends a value, or drops it and counts it if the ring is full. Producer only.
+   *
+   * @return     false iff the value was dropped
+   */
+  bool push(const T& value)
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    // the consumer's index is only reloaded when the ring looks full
+    if (head - cached_tail_ == N) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head - cached_tail_ == N) {
+        num_dropped_.store(num_dropped_.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+        return false;
+      }
+    }
+    slots_[head % N] = value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief      Removes the oldest value. Consumer only.
+   *
+   * @return     false iff the ring was empty, `value` is then left alone
+   */
+  bool pop(T* value)
+  {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == cached_head_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail == cached_head_) return false;
+    }
+    *value = slots_[tail % N];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief      Number of values in the ring, as of some moment during the call. Either thread.
+   */
+  std::size_t size() const
+  {
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    return head_.load(std::memory_order_acquire) - tail;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  static constexpr std::size_t capacity() { return N; }
+
+  /**
+   * @brief      Number of values dropped because the ring was full. Either thread.
+   */
+  uint32_t getNumDropped() const { return num_dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  // Indices count up forever and wrap around at 2^32, a multiple of N. Each side's index and its
+  // copy of the other side's index are on their own cache line.
+  static constexpr std::size_t kCacheLine = 64;
+
+  std::atomic<uint32_t> head_;      // next slot to write, stored by the producer only
+  uint32_t cached_tail_;            // producer's last view of tail_
+  char pad_producer_[kCacheLine];
+  std::atomic<uint32_t> tail_;      // next slot to read, stored by the consumer only
+  uint32_t cached_head_;            // consumer's last view of head_
+  char pad_consumer_[kCacheLine];
+  std::atomic<uint32_t> num_dropped_;
+  T slots_[N];
+
+  NO_COPY_ASSIGN(SpscRing);
+};
+
+}}}   // namespace hyped::utils::concurrent
+
+#endif  // BEAGLEBONE_BLACK_UTILS_CONCURRENT_SPSC_RING_HPP_
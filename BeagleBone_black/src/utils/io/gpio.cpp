@@ -70,9 +70,10 @@ GPIO::GPIO(uint32_t pin, gpio::Direction direction)
     : GPIO(pin, direction, System::getLogger())
 { /* EMPTY, delegate to the other constructor */ }
 
-GPIO::GPIO(uint32_t pin, gpio::Direction direction, Logger& log)
+GPIO::GPIO(uint32_t pin, gpio::Direction direction, Logger& log, gpio::Edge edge)
     : pin_(pin),
       direction_(direction),
+      edge_(edge),
       log_(log),
       set_(0),
       clear_(0),
@@ -237,7 +238,17 @@ void GPIO::setupWait()
     log_.ERR("GPIO", "could not open /sys/.../edge for gpio %d", pin_);
     return;
   }
-  write(fd, "both", 5);
+  switch (edge_) {
+    case gpio::Edge::kBoth:
+      write(fd, "both", 5);
+      break;
+    case gpio::Edge::kRising:
+      write(fd, "rising", 7);
+      break;
+    case gpio::Edge::kFalling:
+      write(fd, "falling", 8);
+      break;
+  }
   close(fd);
 
   // open /sys/.../value file
@@ -274,6 +285,40 @@ int8_t GPIO::wait()
   return -1;
 }
 
+int GPIO::waitAny(GPIO* const pins[], int num_pins, int timeout_ms, bool changed[])
+{
+  if (num_pins > gpio::kMaxWaitPins) {
+    pins[0]->log_.ERR("GPIO", "cannot wait on %d pins, at most %d", num_pins, gpio::kMaxWaitPins);
+    return -1;
+  }
+
+  pollfd fdset[gpio::kMaxWaitPins] = {};
+  for (int i = 0; i < num_pins; i++) {
+    fdset[i].fd     = pins[i]->fd_;
+    fdset[i].events = POLLPRI | POLLERR;
+    changed[i]      = false;
+  }
+  int rc = poll(fdset, num_pins, timeout_ms);
+  if (rc <= 0) {
+    if (rc < 0) pins[0]->log_.ERR("GPIO", "an error on wait of %d gpios: %d", num_pins, errno);
+    return rc;
+  }
+
+  int num_changed = 0;
+  for (int i = 0; i < num_pins; i++) {
+    // sysfs flags a change with POLLERR as well as POLLPRI
+    if (fdset[i].revents & POLLPRI) {
+      gpio::readHelper(pins[i]->fd_);
+      changed[i] = true;
+      num_changed++;
+    } else if (fdset[i].revents & (POLLERR | POLLNVAL)) {
+      pins[i]->log_.ERR("GPIO", "an error on wait of gpio %d: %d", pins[i]->pin_, errno);
+      return -1;
+    }
+  }
+  return num_changed;
+}
+
 void GPIO::set()
 {
   if (!initialised_) {
@@ -39,12 +39,19 @@ enum Direction {
   kIn   = 0,
   kOut  = 1
 };
+// Edges of an input pin that wake up wait()
+enum Edge {
+  kBoth     = 0,
+  kRising   = 1,
+  kFalling  = 2
+};
+constexpr int kMaxWaitPins = 8;
 }   // namespace gpio
 
 class GPIO {
  public:
   GPIO(uint32_t pin, gpio::Direction direction);
-  GPIO(uint32_t pin, gpio::Direction direction, Logger& log);
+  GPIO(uint32_t pin, gpio::Direction direction, Logger& log, gpio::Edge edge = gpio::kBoth);
 
   void    set();     // set high
   void    clear();   // set low
@@ -56,6 +63,18 @@ class GPIO {
    */
   int8_t wait();
 
+  /**
+   * @brief Block caller until the value of any of the input gpio pins has changed, or until
+   *        the timeout. A caller that needs the time of the change should read the clock right
+   *        after this returns.
+   * @param pins       - input pins to wait on
+   * @param num_pins   - number of pins, at most gpio::kMaxWaitPins
+   * @param timeout_ms - give up after this long, -1 to wait forever
+   * @param changed    - output, changed[i] is set iff pins[i] has changed
+   * @return int the number of pins that have changed, 0 on timeout, -1 in case of an error
+   */
+  static int waitAny(GPIO* const pins[], int num_pins, int timeout_ms, bool changed[]);
+
  private:
   GPIO() = delete;
 
@@ -87,6 +106,7 @@ class GPIO {
 
   uint32_t        pin_;
   gpio::Direction direction_;
+  gpio::Edge      edge_;
   Logger&         log_;
 
   volatile uint32_t* set_;        // set register
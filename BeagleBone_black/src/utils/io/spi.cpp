@@ -22,39 +22,10 @@
 
 // #include <stdio.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
-#ifndef WIN
-#include <linux/spi/spidev.h>
-#else
-#define _IOW(type, nr, size) 10   // random demo functionality
-#define SPI_IOC_MAGIC             'k'
-#define SPI_IOC_WR_MODE           _IOW(SPI_IOC_MAGIC, 1, uint8_t)
-#define SPI_IOC_WR_MAX_SPEED_HZ   _IOW(SPI_IOC_MAGIC, 4, uint32_t)
-#define SPI_IOC_WR_LSB_FIRST      _IOW(SPI_IOC_MAGIC, 2, uint8_t)
-#define SPI_IOC_WR_BITS_PER_WORD  _IOW(SPI_IOC_MAGIC, 3, uint8_t)
-struct spi_ioc_transfer {
-  uint64_t tx_buf;
-  uint64_t rx_buf;
-
-  uint32_t len;
-  uint32_t speed_hz;
-
-  uint16_t delay_usecs;
-  uint8_t  bits_per_word;
-  uint8_t  cs_change;
-  uint8_t  tx_nbits;
-  uint8_t  rx_nbits;
-  uint16_t pad;
-};
-#define SPI_MSGSIZE(N) \
-  ((((N)*(sizeof(struct spi_ioc_transfer))) < (1 << _IOC_SIZEBITS)) \
-    ? ((N)*(sizeof(struct spi_ioc_transfer))) : 0)
-#define SPI_IOC_MESSAGE(N)  _IOW(SPI_IOC_MAGIC, 0, char[SPI_MSGSIZE(N)])
-#define SPI_CS_HIGH         0x04
-#endif  // ifndef WIN
-
 #include "utils/system.hpp"
 #include "utils/concurrent/thread.hpp"
 
@@ -68,6 +39,60 @@ struct spi_ioc_transfer {
 namespace hyped {
 namespace utils {
 namespace io {
+namespace spi {
+
+constexpr int Batch::kMaxTransfers;
+constexpr int Batch::kMaxBytes;
+
+Batch::Batch()
+    : num_transfers_(0),
+      num_bytes_(0),
+      device_(nullptr)
+{}
+
+int Batch::queue(uint8_t addr, uint16_t len)
+{
+  int offset = num_bytes_;
+  if (num_transfers_ == kMaxTransfers || offset + 1 + len > kMaxBytes) return -1;
+
+  // address and data in one full-duplex transfer, the byte received with the address is junk
+  spi_ioc_transfer& transfer = transfers_[num_transfers_];
+  transfer = {};
+  transfer.tx_buf = reinterpret_cast<uint64_t>(tx_ + offset);
+  transfer.rx_buf = reinterpret_cast<uint64_t>(rx_ + offset);
+  transfer.len    = 1 + len;
+  transfer_device_[num_transfers_] = device_;
+  tx_[offset] = addr;
+
+  num_transfers_++;
+  num_bytes_ += 1 + len;
+  return offset;
+}
+
+const uint8_t* Batch::read(uint8_t addr, uint16_t len)
+{
+  int offset = queue(addr, len);
+  if (offset < 0) return nullptr;
+  memset(tx_ + offset + 1, 0, len);
+  return rx_ + offset + 1;
+}
+
+bool Batch::write(uint8_t addr, const uint8_t* tx, uint16_t len)
+{
+  int offset = queue(addr, len);
+  if (offset < 0) return false;
+  memcpy(tx_ + offset + 1, tx, len);
+  return true;
+}
+
+void Batch::clear()
+{
+  num_transfers_ = 0;
+  num_bytes_     = 0;
+  device_        = nullptr;
+}
+
+}   // namespace spi
 
 SPI& SPI::getInstance()
 {
@@ -76,7 +101,10 @@ SPI& SPI::getInstance()
 }
 
 SPI::SPI(Logger& log)
-    : log_(log)
+    : log_(log),
+      mode_(SPI_MODE),
+      num_messages_(0),
+      num_mode_changes_(0)
 {
   const char device[] = "/dev/spidev1.0";
   spi_fd_ = open(device, O_RDWR, 0);
@@ -112,6 +140,7 @@ SPI::SPI(Logger& log)
 
 void SPI::setClock(Clock clk)
 {
+  concurrent::ScopedLock L(&lock_);
   uint32_t data;
   switch (clk) {
     case Clock::k1MHz:  data = 1000000;   break;
@@ -124,25 +153,58 @@ void SPI::setClock(Clock clk)
   }
 }
 
-void SPI::transfer(uint8_t* tx, uint8_t* rx, uint16_t len)
+void SPI::setMode(uint8_t mode)
 {
+  mode_ = mode;
+  num_mode_changes_++;
   if (spi_fd_ < 0) return;  // early exit if no spi device present
 
+  // CS active low
+  uint8_t data = (mode & 0x3) & ~SPI_CS_HIGH;
+  if (ioctl(spi_fd_, SPI_IOC_WR_MODE, &data) < 0) {
+    log_.ERR("SPI", "could not set mode %u", mode);
+  }
+}
+
+bool SPI::submitMessage(const SpiDevice* device, spi_ioc_transfer* transfers, int num)
+{
+  // The mode is a setting of the bus, but the clock can go with each transfer. A clock of 0 is
+  // the one of setClock().
+  uint8_t  mode  = device ? device->getMode() : SPI_MODE;
+  uint32_t clock = device ? device->getClock() : 0;
+  spi::ChipSelect* cs = device ? device->getChipSelect() : nullptr;
+  if (mode != mode_) setMode(mode);
+  for (int i = 0; i < num; i++) transfers[i].speed_hz = clock;
+
+  num_messages_++;
+  if (cs) cs->select();
+  bool ok = spi_fd_ < 0 || ioctl(spi_fd_, SPI_IOC_MESSAGE(num), transfers) >= 0;
+  if (cs) cs->deselect();
+  return ok;
+}
+
+void SPI::transfer(uint8_t* tx, uint8_t* rx, uint16_t len)
+{
+  concurrent::ScopedLock L(&lock_);
   spi_ioc_transfer message = {};
 
   message.tx_buf = reinterpret_cast<uint64_t>(tx);
   message.rx_buf = reinterpret_cast<uint64_t>(rx);
   message.len    = len;
 
-  if (ioctl(spi_fd_, SPI_IOC_MESSAGE(1), &message) < 0) {
+  if (!submitMessage(nullptr, &message, 1)) {
     log_.ERR("SPI", "could not submit TRANSFER message");
   }
 }
 
 void SPI::read(uint8_t addr, uint8_t* rx, uint16_t len)
 {
-  if (spi_fd_ < 0) return;  // early exit if no spi device present
+  readFrom(nullptr, addr, rx, len);
+}
 
+void SPI::readFrom(const SpiDevice* device, uint8_t addr, uint8_t* rx, uint16_t len)
+{
+  concurrent::ScopedLock L(&lock_);
   spi_ioc_transfer message[2] = {};
 
   // send address
@@ -155,15 +217,19 @@ void SPI::read(uint8_t addr, uint8_t* rx, uint16_t len)
   message[1].rx_buf = reinterpret_cast<uint64_t>(rx);
   message[1].len    = len;
 
-  if (ioctl(spi_fd_, SPI_IOC_MESSAGE(2), message) < 0) {
+  if (!submitMessage(device, message, 2)) {
     log_.ERR("SPI", "could not submit 2 TRANSFER messages");
   }
 }
 
 void SPI::write(uint8_t addr, uint8_t* tx, uint16_t len)
 {
-  if (spi_fd_ < 0) return;  // early exit if no spi device present
+  writeTo(nullptr, addr, tx, len);
+}
 
+void SPI::writeTo(const SpiDevice* device, uint8_t addr, const uint8_t* tx, uint16_t len)
+{
+  concurrent::ScopedLock L(&lock_);
   spi_ioc_transfer message[2] = {};
   // send address
   message[0].tx_buf = reinterpret_cast<uint64_t>(&addr);
@@ -175,15 +241,56 @@ void SPI::write(uint8_t addr, uint8_t* tx, uint16_t len)
   message[1].rx_buf = 0;
   message[1].len    = len;
 
-  if (ioctl(spi_fd_, SPI_IOC_MESSAGE(2), message) < 0) {
+  if (!submitMessage(device, message, 2)) {
     log_.ERR("SPI", "could not submit 2 TRANSFER messages");
   }
 }
 
+void SPI::submit(spi::Batch* batch)
+{
+  concurrent::ScopedLock L(&lock_);
+  int first = 0;
+  while (first < batch->num_transfers_) {
+    const SpiDevice* device = batch->transfer_device_[first];
+    // the kernel toggles its own chip select between the transfers of a message, cs_change
+    // on the last one would leave the device selected
+    int last = first;
+    if (!device || !device->getChipSelect()) {
+      while (last + 1 < batch->num_transfers_ && batch->transfer_device_[last + 1] == device) {
+        last++;
+      }
+    }
+    for (int i = first; i <= last; i++) batch->transfers_[i].cs_change = i < last;
+
+    bool ok = submitMessage(device, batch->transfers_ + first, last - first + 1);
+    if (!ok) {
+      log_.ERR("SPI", "could not submit %d TRANSFER messages", last - first + 1);
+    }
+    first = last + 1;
+  }
+}
+
 SPI::~SPI()
 {
   if (spi_fd_ < 0) return;  // early exit if no spi device present
 
   close(spi_fd_);
 }
+
+SpiDevice::SpiDevice(uint32_t clock_hz, uint8_t mode, spi::ChipSelect* cs)
+    : spi_(SPI::getInstance()),
+      clock_hz_(clock_hz),
+      mode_(mode),
+      cs_(cs)
+{}
+
+void SpiDevice::read(uint8_t addr, uint8_t* rx, uint16_t len)
+{
+  spi_.readFrom(this, addr, rx, len);
+}
+
+void SpiDevice::write(uint8_t addr, const uint8_t* tx, uint16_t len)
+{
+  spi_.writeTo(this, addr, tx, len);
+}
 }}}   // namespace hyped::utils::io
@@ -9,6 +9,13 @@
  * function returns.
  * The operations are not thread-safe. It is assumed only one thread uses SPI, namely IMU manager.
  *
+ * Many transfers, also to several devices, can be queued in an spi::Batch and submitted together
+ * in as few SPI_IOC_MESSAGE calls as their chip selects allow.
+ *
+ * Devices with their own clock, mode and chip select go through an SpiDevice handle. SPI then
+ * arbitrates the bus: the transfers of different threads are serialised, chip select hooks
+ * included, and the mode is only set again when it changes.
+ *
  *    Copyright 2018 HYPED
  *    Licensed under the Apache License, Version 2.0 (the "License");
  *    you may not use this file except in compliance with the License.
@@ -26,7 +33,39 @@
 #ifndef BEAGLEBONE_BLACK_UTILS_IO_SPI_HPP_
 #define BEAGLEBONE_BLACK_UTILS_IO_SPI_HPP_
 
+#include <cstdint>
+
+#ifndef WIN
+#include <linux/spi/spidev.h>
+#else
+#define _IOW(type, nr, size) 10   // random demo functionality
+#define SPI_IOC_MAGIC             'k'
+#define SPI_IOC_WR_MODE           _IOW(SPI_IOC_MAGIC, 1, uint8_t)
+#define SPI_IOC_WR_MAX_SPEED_HZ   _IOW(SPI_IOC_MAGIC, 4, uint32_t)
+#define SPI_IOC_WR_LSB_FIRST      _IOW(SPI_IOC_MAGIC, 2, uint8_t)
+#define SPI_IOC_WR_BITS_PER_WORD  _IOW(SPI_IOC_MAGIC, 3, uint8_t)
+struct spi_ioc_transfer {
+  uint64_t tx_buf;
+  uint64_t rx_buf;
 
+  uint32_t len;
+  uint32_t speed_hz;
+
+  uint16_t delay_usecs;
+  uint8_t  bits_per_word;
+  uint8_t  cs_change;
+  uint8_t  tx_nbits;
+  uint8_t  rx_nbits;
+  uint16_t pad;
+};
+#define SPI_MSGSIZE(N) \
+  ((((N)*(sizeof(struct spi_ioc_transfer))) < (1 << _IOC_SIZEBITS)) \
+    ? ((N)*(sizeof(struct spi_ioc_transfer))) : 0)
+#define SPI_IOC_MESSAGE(N)  _IOW(SPI_IOC_MAGIC, 0, char[SPI_MSGSIZE(N)])
+#define SPI_CS_HIGH         0x04
+#endif  // ifndef WIN
+
+#include "utils/concurrent/lock.hpp"
 #include "utils/logger.hpp"
 #include "utils/utils.hpp"
 
@@ -34,6 +73,88 @@ namespace hyped {
 namespace utils {
 namespace io {
 
+class SPI;
+class SpiDevice;
+
+namespace spi {
+
+/**
+ * Chip select of a device that the kernel does not drive, e.g. a GPIO pin. SPI calls select()
+ * before every message to the device and deselect() after it, while it holds the bus.
+ */
+class ChipSelect {
+ public:
+  virtual void select()   = 0;
+  virtual void deselect() = 0;
+};
+
+/**
+ * Register reads and writes queued up for SPI::submit(), each a single full-duplex transfer of
+ * the address byte followed by the data. The transfers and their buffers are preallocated, so
+ * a batch can be cleared and refilled every sweep without allocating.
+ *
+ * Transfers to the device on the chip select the kernel drives all go in one SPI_IOC_MESSAGE,
+ * the kernel toggles the chip select in between. A transfer to a device on a ChipSelect is a
+ * message of its own, as the hooks can only run in between two messages.
+ */
+class Batch {
+ public:
+  static constexpr int kMaxTransfers = 32;
+  static constexpr int kMaxBytes     = 512;   // over all transfers, address bytes included
+
+  Batch();
+
+  /**
+   * @brief Transfers queued from now on go to the device, or with nullptr to the one on the
+   *        chip select the kernel drives, with the clock of SPI::setClock(). The latter is the
+   *        default.
+   */
+  void select(const SpiDevice* device) { device_ = device; }
+
+  /**
+   * @brief Queues a read of len bytes starting at some address
+   * @param addr  - address byte as sent, including any read flag of the device
+   * @param len   - number of BYTES to be read
+   * @return where the data will be once the batch has been submitted, valid until clear(),
+   *         nullptr if the batch is full
+   */
+  const uint8_t* read(uint8_t addr, uint16_t len);
+
+  /**
+   * @brief Queues a write of len bytes starting at some address. The data is copied.
+   * @param addr  - address byte as sent
+   * @param tx    - pointer to head of write buffer
+   * @param len   - number of BYTES to be written
+   * @return false iff the batch is full
+   */
+  bool write(uint8_t addr, const uint8_t* tx, uint16_t len);
+
+  /**
+   * @brief Forgets all the transfers, to start the next batch on the default chip select
+   */
+  void clear();
+
+  int getNumTransfers() const { return num_transfers_; }
+
+ private:
+  friend class hyped::utils::io::SPI;
+
+  // queues a transfer of the address and len bytes, returns its offset in the buffers or -1
+  int queue(uint8_t addr, uint16_t len);
+
+  spi_ioc_transfer  transfers_[kMaxTransfers];
+  const SpiDevice*  transfer_device_[kMaxTransfers];
+  int               num_transfers_;
+  uint8_t           tx_[kMaxBytes];
+  uint8_t           rx_[kMaxBytes];
+  int               num_bytes_;
+  const SpiDevice*  device_;
+
+  NO_COPY_ASSIGN(Batch);
+};
+
+}   // namespace spi
+
 
 class SPI {
  public:
@@ -45,6 +166,9 @@ class SPI {
     k20MHz
   };
 
+  /**
+   * @brief Clock of the transfers not made through an SpiDevice
+   */
   void setClock(Clock clk);
 
   /**
@@ -71,15 +195,80 @@ class SPI {
    */
   void write(uint8_t addr, uint8_t* tx, uint16_t len);
 
+  /**
+   * @brief Submits all the transfers of the batch in the order queued. Their data can then be
+   *        found where batch->read() said. The batch is left as it is, to be cleared or
+   *        submitted again.
+   */
+  void submit(spi::Batch* batch);
+
+  /**
+   * @brief Number of SPI_IOC_MESSAGE calls so far. Counted without an SPI device too, so that
+   *        the cost of a sweep of the sensors can be measured off the pod.
+   */
+  uint32_t getNumMessages() const { return num_messages_; }
+
+  /**
+   * @brief Number of times the mode has been set because a device needed a different one
+   */
+  uint32_t getNumModeChanges() const { return num_mode_changes_; }
+
  private:
+  friend class SpiDevice;
+
   explicit SPI(Logger& log);
   ~SPI();
+  // Submits num transfers to the device, nullptr for the default one, as one SPI_IOC_MESSAGE
+  // with its chip select hooks around it. Only with lock_ held. Returns false on failure.
+  bool submitMessage(const SpiDevice* device, spi_ioc_transfer* transfers, int num);
+  void setMode(uint8_t mode);
+  void readFrom(const SpiDevice* device, uint8_t addr, uint8_t* rx, uint16_t len);
+  void writeTo(const SpiDevice* device, uint8_t addr, const uint8_t* tx, uint16_t len);
   int spi_fd_;
   Logger& log_;
+  concurrent::Lock lock_;   // of the bus
+  uint8_t mode_;            // as last set
+  uint32_t num_messages_;
+  uint32_t num_mode_changes_;
 
   NO_COPY_ASSIGN(SPI);
 };
 
+/**
+ * Handle of one device on the bus, with the clock, mode and chip select it needs. Devices with
+ * different profiles can share the bus from different threads, SPI serialises their transfers.
+ * A handle itself is used by one thread.
+ */
+class SpiDevice {
+ public:
+  /**
+   * @param clock_hz  - SCLK of the device's transfers
+   * @param mode      - SPI mode 0-3, i.e. clock polarity and phase
+   * @param cs        - hook of a chip select the kernel does not drive, nullptr for its own
+   */
+  SpiDevice(uint32_t clock_hz, uint8_t mode, spi::ChipSelect* cs = nullptr);
+
+  /**
+   * @brief As SPI::read(), with the device selected for the transfer
+   */
+  void read(uint8_t addr, uint8_t* rx, uint16_t len);
+
+  /**
+   * @brief As SPI::write(), with the device selected for the transfer
+   */
+  void write(uint8_t addr, const uint8_t* tx, uint16_t len);
+
+  uint32_t         getClock() const      { return clock_hz_; }
+  uint8_t          getMode() const       { return mode_; }
+  spi::ChipSelect* getChipSelect() const { return cs_; }
+
+ private:
+  SPI&             spi_;
+  uint32_t         clock_hz_;
+  uint8_t          mode_;
+  spi::ChipSelect* cs_;
+};
+
 
 }}}   // namespace hyped::utils::io
 
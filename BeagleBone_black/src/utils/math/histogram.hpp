@@ -0,0 +1,120 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description: Histogram of unsigned integer values (e.g. latencies in microseconds) in constant
+ *              memory. Buckets are exact below 32 and then 16 per power of two, so any value is
+ *              off by at most 1/16 of itself. One thread records, any other thread can read the
+ *              counts and percentiles at the same time without locking, e.g. for telemetry.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_HISTOGRAM_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_HISTOGRAM_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include "utils/utils.hpp"
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kSubBuckets    = 1 << kSubBucketBits;
+  // 2*kSubBuckets exact buckets, then kSubBuckets for each power of two up to 2^32
+  static constexpr int kNumBuckets    = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+  Histogram() : count_(0), max_(0)
+  {
+    for (std::atomic<uint32_t>& c : counts_) c.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief    Adds one value. Must only be called from one thread at a time.
+   */
+  void record(uint32_t value)
+  {
+    std::atomic<uint32_t>& bucket = counts_[bucketOf(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+    count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  uint64_t getCount() const { return count_.load(std::memory_order_acquire); }
+  uint32_t getMax() const { return max_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief    Number of values in bucket `index`, i.e. from getLowerBound(index) to
+   *           getLowerBound(index + 1) - 1
+   */
+  uint32_t getBucketCount(int index) const
+  {
+    return counts_[index].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief    Smallest value that counts into bucket `index`
+   */
+  static uint64_t getLowerBound(int index)
+  {
+    if (index < kSubBuckets) return index;
+    int shift = index / kSubBuckets - 1;
+    return static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+  }
+
+  /**
+   * @brief    Upper bound on the value below which a `fraction` (in [0, 1]) of the values lie,
+   *           the last value of the bucket that holds it, or at most getMax(). 0 while empty.
+   *           While another thread records, the result is as of a moment during the call.
+   */
+  uint32_t getPercentile(double fraction) const
+  {
+    uint64_t count = getCount();
+    if (count == 0) return 0;
+    // rank of the value wanted, from 1
+    uint64_t rank = static_cast<uint64_t>(fraction * count + 0.5);
+    rank = rank < 1 ? 1 : (rank > count ? count : rank);
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+      seen += getBucketCount(i);
+      if (seen >= rank) {
+        uint64_t last = getLowerBound(i + 1) - 1;
+        return last < getMax() ? last : getMax();
+      }
+    }
+    return getMax();
+  }
+
+ private:
+  static int bucketOf(uint32_t value)
+  {
+    if (value < 2*kSubBuckets) return value;
+    // the top kSubBucketBits + 1 bits of the value
+    int shift = 31 - __builtin_clz(value) - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + (value >> shift) - kSubBuckets;
+  }
+
+  std::atomic<uint32_t> counts_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint32_t> max_;
+
+  NO_COPY_ASSIGN(Histogram);
+};
+
+}}}  // namespace hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_HISTOGRAM_HPP_
@@ -0,0 +1,240 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 27/07/2018
+ * Description: A bank of N independent scalar Kalman filters (the same filter as Kalman<float>)
+ *              stored as structure of arrays and updated 4 channels at a time with NEON or SSE.
+ *              With constant noise the gain converges after a few samples; from then on the
+ *              bank only applies the cached gain, which needs neither a division nor a
+ *              covariance update.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_BANK_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_BANK_HPP_
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define KALMAN_BANK_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define KALMAN_BANK_SSE
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+/**
+ * @brief    N scalar Kalman filters updated together
+ *
+ * @tparam N    Number of channels, a multiple of 4 (the SIMD width)
+ */
+template <int N>
+class KalmanBank {
+  static_assert(N % 4 == 0, "KalmanBank needs a multiple of 4 channels");
+
+ public:
+  // The gain counts as converged once no channel's gain moved by more than kGainTolerance for
+  // kNumStableSamples consecutive samples
+  static constexpr float kGainTolerance   = 1e-6;
+  static constexpr int   kNumStableSamples = 16;
+
+  /**
+   * @brief    Construct a bank with all channels at zero
+   *
+   * @param[in] cache_gain    Switch to the fixed-gain update once the gains have converged
+   */
+  explicit KalmanBank(bool cache_gain = true);
+
+  /**
+   * @brief    Configures one channel, see Kalman::configure(). Resets the gain convergence.
+   *
+   * @param[in] channel    Index in [0, N)
+   */
+  void configure(int channel, float input_value, float measurement_noise, float process_noise);
+
+  /**
+   * @brief    Filters one new reading per channel
+   *
+   * @param[in,out] values    N readings, replaced by the filtered values
+   */
+  void filter(float* values);
+
+  /**
+   * @brief    Whether the bank has switched to the fixed-gain update
+   */
+  bool isConverged() const { return converged_; }
+
+  float getFiltered(int channel) const { return filtered_value_[channel]; }
+  float getGain(int channel) const { return kalman_gain_[channel]; }
+  float getCovariance(int channel) const { return estimation_error_covariance_[channel]; }
+
+ private:
+  // Full Kalman update of all channels, returns the largest change of a gain
+  float fullUpdate(float* values);
+  // x += K (z - x) with the cached gains
+  void fixedGainUpdate(float* values);
+
+  alignas(16) float kalman_gain_[N];
+  alignas(16) float process_noise_[N];
+  alignas(16) float filtered_value_[N];
+  alignas(16) float estimation_error_covariance_[N];
+  alignas(16) float measurement_noise_covariance_[N];
+  bool cache_gain_;
+  int num_stable_samples_;
+  bool converged_;
+};
+
+template <int N>
+constexpr float KalmanBank<N>::kGainTolerance;
+template <int N>
+constexpr int KalmanBank<N>::kNumStableSamples;
+
+template <int N>
+KalmanBank<N>::KalmanBank(bool cache_gain)
+    : cache_gain_(cache_gain),
+      num_stable_samples_(0),
+      converged_(false)
+{
+  for (int i = 0; i < N; i++) {
+    kalman_gain_[i]                  = 0;
+    process_noise_[i]                = 0;
+    filtered_value_[i]               = 0;
+    estimation_error_covariance_[i]  = 0;
+    measurement_noise_covariance_[i] = 0;
+  }
+}
+
+template <int N>
+void KalmanBank<N>::configure(int channel, float input_value, float measurement_noise,
+                              float process_noise)
+{
+  filtered_value_[channel]               = input_value;
+  process_noise_[channel]                = process_noise;
+  measurement_noise_covariance_[channel] = measurement_noise;
+  num_stable_samples_ = 0;
+  converged_          = false;
+}
+
+template <int N>
+void KalmanBank<N>::filter(float* values)
+{
+  if (converged_) {
+    fixedGainUpdate(values);
+    return;
+  }
+  if (fullUpdate(values) <= kGainTolerance) {
+    converged_ = cache_gain_ && ++num_stable_samples_ >= kNumStableSamples;
+  } else {
+    num_stable_samples_ = 0;
+  }
+}
+
+template <int N>
+float KalmanBank<N>::fullUpdate(float* values)
+{
+#if defined(KALMAN_BANK_NEON)
+  float32x4_t change = vdupq_n_f32(0);
+#elif defined(KALMAN_BANK_SSE)
+  __m128 change = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+#else
+  float max_change = 0;
+#endif
+  for (int i = 0; i < N; i += 4) {
+#if defined(KALMAN_BANK_NEON)
+    float32x4_t p = vaddq_f32(vld1q_f32(estimation_error_covariance_ + i),
+                              vld1q_f32(process_noise_ + i));
+    float32x4_t s = vaddq_f32(p, vld1q_f32(measurement_noise_covariance_ + i));
+    // no divide on NEON: reciprocal estimate refined by two Newton-Raphson steps
+    float32x4_t r = vrecpeq_f32(s);
+    r = vmulq_f32(vrecpsq_f32(s, r), r);
+    r = vmulq_f32(vrecpsq_f32(s, r), r);
+    float32x4_t k = vmulq_f32(p, r);
+    float32x4_t x = vld1q_f32(filtered_value_ + i);
+    x = vmlaq_f32(x, k, vsubq_f32(vld1q_f32(values + i), x));
+    p = vmlsq_f32(p, k, p);
+    change = vmaxq_f32(change, vabdq_f32(k, vld1q_f32(kalman_gain_ + i)));
+    vst1q_f32(kalman_gain_ + i, k);
+    vst1q_f32(filtered_value_ + i, x);
+    vst1q_f32(values + i, x);
+    vst1q_f32(estimation_error_covariance_ + i, p);
+#elif defined(KALMAN_BANK_SSE)
+    __m128 p = _mm_add_ps(_mm_load_ps(estimation_error_covariance_ + i),
+                          _mm_load_ps(process_noise_ + i));
+    __m128 s = _mm_add_ps(p, _mm_load_ps(measurement_noise_covariance_ + i));
+    __m128 k = _mm_div_ps(p, s);
+    __m128 x = _mm_load_ps(filtered_value_ + i);
+    x = _mm_add_ps(x, _mm_mul_ps(k, _mm_sub_ps(_mm_loadu_ps(values + i), x)));
+    p = _mm_sub_ps(p, _mm_mul_ps(k, p));
+    change = _mm_max_ps(change, _mm_andnot_ps(sign, _mm_sub_ps(k, _mm_load_ps(kalman_gain_ + i))));
+    _mm_store_ps(kalman_gain_ + i, k);
+    _mm_store_ps(filtered_value_ + i, x);
+    _mm_storeu_ps(values + i, x);
+    _mm_store_ps(estimation_error_covariance_ + i, p);
+#else
+    for (int j = i; j < i + 4; j++) {
+      estimation_error_covariance_[j] += process_noise_[j];
+      float gain = estimation_error_covariance_[j] /
+                   (estimation_error_covariance_[j] + measurement_noise_covariance_[j]);
+      max_change = std::max(max_change, std::abs(gain - kalman_gain_[j]));
+      kalman_gain_[j] = gain;
+      filtered_value_[j] += kalman_gain_[j] * (values[j] - filtered_value_[j]);
+      estimation_error_covariance_[j] = (1 - kalman_gain_[j]) * estimation_error_covariance_[j];
+      values[j] = filtered_value_[j];
+    }
+#endif
+  }
+#if defined(KALMAN_BANK_NEON)
+  float32x2_t half = vpmax_f32(vget_low_f32(change), vget_high_f32(change));
+  return vget_lane_f32(vpmax_f32(half, half), 0);
+#elif defined(KALMAN_BANK_SSE)
+  change = _mm_max_ps(change, _mm_movehl_ps(change, change));
+  change = _mm_max_ss(change, _mm_shuffle_ps(change, change, 1));
+  return _mm_cvtss_f32(change);
+#else
+  return max_change;
+#endif
+}
+
+template <int N>
+void KalmanBank<N>::fixedGainUpdate(float* values)
+{
+  for (int i = 0; i < N; i += 4) {
+#if defined(KALMAN_BANK_NEON)
+    float32x4_t x = vld1q_f32(filtered_value_ + i);
+    x = vmlaq_f32(x, vld1q_f32(kalman_gain_ + i), vsubq_f32(vld1q_f32(values + i), x));
+    vst1q_f32(filtered_value_ + i, x);
+    vst1q_f32(values + i, x);
+#elif defined(KALMAN_BANK_SSE)
+    __m128 x = _mm_load_ps(filtered_value_ + i);
+    x = _mm_add_ps(x, _mm_mul_ps(_mm_load_ps(kalman_gain_ + i),
+                                 _mm_sub_ps(_mm_loadu_ps(values + i), x)));
+    _mm_store_ps(filtered_value_ + i, x);
+    _mm_storeu_ps(values + i, x);
+#else
+    for (int j = i; j < i + 4; j++) {
+      filtered_value_[j] += kalman_gain_[j] * (values[j] - filtered_value_[j]);
+      values[j] = filtered_value_[j];
+    }
+#endif
+  }
+}
+
+}}}  // namespace hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_BANK_HPP_
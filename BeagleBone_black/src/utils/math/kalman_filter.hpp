@@ -0,0 +1,120 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 27/07/2018
+ * Description: Linear Kalman filter over a state vector of compile-time size. All matrices are
+ *              fixed-size Eigen types, so predict() and update() never touch the heap. DontAlign
+ *              keeps the filter safe to embed in any class or std::array without aligned new.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_FILTER_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_FILTER_HPP_
+
+#include "Eigen/Core"
+#include "Eigen/LU"
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+/**
+ * @brief    Kalman filter with N states and measurements of any size M <= N
+ *
+ * @tparam N    Number of states
+ * @tparam T    Underlying numeric type
+ */
+template <int N, typename T = double>
+class KalmanFilter {
+ public:
+  template <int Rows, int Cols>
+  using Matrix = Eigen::Matrix<T, Rows, Cols,
+      Eigen::DontAlign | (Rows == 1 && Cols != 1 ? Eigen::RowMajor : Eigen::ColMajor)>;
+  template <int Rows>
+  using Column = Eigen::Matrix<T, Rows, 1, Eigen::DontAlign>;
+
+  typedef Column<N>    StateVector;
+  typedef Matrix<N, N> StateMatrix;
+
+  /**
+   * @brief    Construct a filter with zero state and covariance
+   */
+  KalmanFilter();
+
+  /**
+   * @brief    Resets the state estimate and its covariance
+   */
+  void configure(const StateVector& x, const StateMatrix& P);
+
+  /**
+   * @brief    Propagates the estimate with x = F x, P = F P F' + Q
+   *
+   * @param[in] F    State transition matrix
+   * @param[in] Q    Process noise covariance
+   */
+  void predict(const StateMatrix& F, const StateMatrix& Q);
+
+  /**
+   * @brief    Corrects the estimate with the measurement z = H x + v, v ~ N(0, R)
+   *
+   * @param[in] z    Measurement
+   * @param[in] H    Observation matrix
+   * @param[in] R    Measurement noise covariance
+   */
+  template <int M>
+  void update(const Column<M>& z, const Matrix<M, N>& H, const Matrix<M, M>& R);
+
+  const StateVector& getState() const { return x_; }
+  const StateMatrix& getCovariance() const { return P_; }
+
+ private:
+  StateVector x_;
+  StateMatrix P_;
+};
+
+template <int N, typename T>
+KalmanFilter<N, T>::KalmanFilter()
+    : x_(StateVector::Zero()),
+      P_(StateMatrix::Zero())
+{}
+
+template <int N, typename T>
+void KalmanFilter<N, T>::configure(const StateVector& x, const StateMatrix& P)
+{
+  x_ = x;
+  P_ = P;
+}
+
+template <int N, typename T>
+void KalmanFilter<N, T>::predict(const StateMatrix& F, const StateMatrix& Q)
+{
+  x_ = F * x_;
+  P_ = F * P_ * F.transpose() + Q;
+}
+
+template <int N, typename T>
+template <int M>
+void KalmanFilter<N, T>::update(const Column<M>& z, const Matrix<M, N>& H, const Matrix<M, M>& R)
+{
+  Matrix<N, M> PHt = P_ * H.transpose();
+  Matrix<M, M> S   = H * PHt + R;
+  Matrix<N, M> K   = PHt * S.inverse();   // closed-form inverse for M <= 4
+  x_ += K * (z - H * x_);
+  // Joseph form keeps P symmetric and positive definite in single precision too
+  StateMatrix I_KH = StateMatrix::Identity() - K * H;
+  P_ = I_KH * P_ * I_KH.transpose() + K * R * K.transpose();
+}
+
+}}}  // namespace hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_KALMAN_FILTER_HPP_
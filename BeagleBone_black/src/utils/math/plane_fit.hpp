@@ -0,0 +1,90 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description:
+ * Least-squares plane through a fixed number of points. The normal is the eigenvector of the
+ * smallest eigenvalue of the points' 3x3 scatter matrix, solved in closed form (trigonometric
+ * roots of the characteristic cubic, eigenvector from a cross product) without any iteration.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_PLANE_FIT_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_PLANE_FIT_HPP_
+
+#include <array>
+#include <cstddef>
+
+#include <algorithm>
+#include <cmath>
+
+#include "vector.hpp"
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+/**
+ * @brief    Unit normal of the plane minimising the squared distances to `points`. Its sign is
+ *           arbitrary. Returns (0, 0, 1) if the points do not determine a plane (all of them
+ *           coincide or lie on a line).
+ */
+template <typename T, std::size_t N>
+Vector<T, 3> fitPlaneNormal(const std::array<Vector<T, 3>, N>& points)
+{
+  static_assert(N >= 3, "A plane needs at least three points");
+  const Vector<T, 3> kDegenerate({0, 0, 1});
+
+  // The plane goes through the centroid
+  T c[3] = {0, 0, 0};
+  for (const Vector<T, 3>& p : points)
+    for (int i = 0; i < 3; i++) c[i] += p[i];
+  for (int i = 0; i < 3; i++) c[i] /= N;
+
+  // Scatter matrix a (symmetric)
+  T a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  for (const Vector<T, 3>& p : points) {
+    T x = p[0] - c[0], y = p[1] - c[1], z = p[2] - c[2];
+    a00 += x*x;  a01 += x*y;  a02 += x*z;
+    a11 += y*y;  a12 += y*z;
+    a22 += z*z;
+  }
+
+  // Smallest eigenvalue: a = q*I + p*b with b having eigenvalues 2cos(phi + 2k*pi/3)
+  T q  = (a00 + a11 + a22)/3;
+  T b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+  T p2 = b00*b00 + b11*b11 + b22*b22 + 2*(a01*a01 + a02*a02 + a12*a12);
+  if (!(p2 > 0)) return kDegenerate;
+  T p = std::sqrt(p2/6);
+  T det = b00*(b11*b22 - a12*a12) - a01*(a01*b22 - a12*a02) + a02*(a01*a12 - b11*a02);
+  T r = std::max(T(-1), std::min(T(1), det/(2*p*p*p)));
+  T phi = std::acos(r)/3;
+  T lambda = q + 2*p*std::cos(phi + T(2*M_PI/3));
+
+  // The eigenvector is orthogonal to every row of a - lambda*I; the longest cross product of two
+  // rows is the best conditioned
+  Vector<T, 3> row0({a00 - lambda, a01, a02});
+  Vector<T, 3> row1({a01, a11 - lambda, a12});
+  Vector<T, 3> row2({a02, a12, a22 - lambda});
+  Vector<T, 3> n[3] = {cross(row0, row1), cross(row0, row2), cross(row1, row2)};
+  T norm2[3] = {dot(n[0], n[0]), dot(n[1], n[1]), dot(n[2], n[2])};
+  int best = 0;
+  if (norm2[1] > norm2[best]) best = 1;
+  if (norm2[2] > norm2[best]) best = 2;
+  if (!(norm2[best] > 0)) return kDegenerate;
+  return n[best] / std::sqrt(norm2[best]);
+}
+
+}}}  // hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_PLANE_FIT_HPP_
@@ -25,10 +25,12 @@
 #include <initializer_list>
 #include <array>
 #include <cmath>
+#include <limits>
 
 #include "vector.hpp"
 
 using hyped::utils::math::Vector;
+using hyped::utils::math::VectorExpression;
 
 namespace hyped {
 namespace utils {
@@ -50,11 +52,11 @@ class Quaternion
     template <typename U>
     explicit Quaternion(const Vector<U, 4>& rhs);
 
-    template <typename U>
-    Quaternion(const Vector<U, 3>& rhs);
+    template <typename E, typename U>
+    Quaternion(const VectorExpression<E, U, 3>& rhs);
 
-    template <typename U1, typename U2>
-    Quaternion(const U1 scalar, const Vector<U2, 3>& rhs);
+    template <typename U1, typename E, typename U2>
+    Quaternion(const U1 scalar, const VectorExpression<E, U2, 3>& rhs);
 
     /**
      * @brief    Creates quaternion from 4 numbers.
@@ -142,23 +144,23 @@ Quaternion<T>::Quaternion(const Vector<U, 4>& rhs)
 }
 
 template <typename T>
-template <typename U>
-Quaternion<T>::Quaternion(const Vector<U, 3>& rhs)
+template <typename E, typename U>
+Quaternion<T>::Quaternion(const VectorExpression<E, U, 3>& rhs)
 {
   elements_[0] = T(0);
-  elements_[1] = T(rhs[0]);
-  elements_[2] = T(rhs[1]);
-  elements_[3] = T(rhs[2]);
+  elements_[1] = T(rhs.derived()[0]);
+  elements_[2] = T(rhs.derived()[1]);
+  elements_[3] = T(rhs.derived()[2]);
 }
 
 template <typename T>
-template <typename U1, typename U2>
-Quaternion<T>::Quaternion(const U1 scalar, const Vector<U2, 3>& rhs)
+template <typename U1, typename E, typename U2>
+Quaternion<T>::Quaternion(const U1 scalar, const VectorExpression<E, U2, 3>& rhs)
 {
   elements_[0] = T(scalar);
-  elements_[1] = T(rhs[0]);
-  elements_[2] = T(rhs[1]);
-  elements_[3] = T(rhs[2]);
+  elements_[1] = T(rhs.derived()[0]);
+  elements_[2] = T(rhs.derived()[1]);
+  elements_[3] = T(rhs.derived()[2]);
 }
 
 template <typename T>
@@ -366,6 +368,68 @@ Vector<T, 4> Quaternion<T>::get_elements() const
   return elements_;
 }
 
+/**
+ * @brief    Rotation quaternion (w, x, y, z) of the rotation matrix with columns `x`, `y`, and `z`,
+ *           which must be orthonormal. Same branches (and signs) as Eigen's conversion.
+ */
+template <typename T>
+Quaternion<T> fromRotationMatrix(const Vector<T, 3>& x, const Vector<T, 3>& y,
+                                 const Vector<T, 3>& z)
+{
+  const Vector<T, 3>* columns[3] = {&x, &y, &z};
+  auto m = [&columns](int row, int col) { return (*columns[col])[row]; };  // NOLINT
+  Quaternion<T> q;
+  T trace = x[0] + y[1] + z[2];
+  if (trace > 0) {
+    T t = std::sqrt(trace + 1);
+    q[0] = t/2;
+    t = T(0.5)/t;
+    q[1] = (m(2, 1) - m(1, 2))*t;
+    q[2] = (m(0, 2) - m(2, 0))*t;
+    q[3] = (m(1, 0) - m(0, 1))*t;
+  } else {
+    // Start from the largest diagonal element for accuracy
+    int i = 0;
+    if (m(1, 1) > m(0, 0)) i = 1;
+    if (m(2, 2) > m(i, i)) i = 2;
+    int j = (i + 1) % 3;
+    int k = (j + 1) % 3;
+    T t = std::sqrt(m(i, i) - m(j, j) - m(k, k) + 1);
+    q[1 + i] = t/2;
+    t = T(0.5)/t;
+    q[0]     = (m(k, j) - m(j, k))*t;
+    q[1 + j] = (m(j, i) + m(i, j))*t;
+    q[1 + k] = (m(k, i) + m(i, k))*t;
+  }
+  return q;
+}
+
+/**
+ * @brief    Spherical linear interpolation from unit quaternion `from` (t = 0) to `to` (t = 1)
+ *           along the shorter arc. The result has the sign of `from`, as in Eigen.
+ */
+template <typename T>
+Quaternion<T> slerp(const Quaternion<T>& from, const Quaternion<T>& to, T t)
+{
+  const T kOne = 1 - std::numeric_limits<T>::epsilon();
+  T d = from[0]*to[0] + from[1]*to[1] + from[2]*to[2] + from[3]*to[3];
+  T abs_d = std::abs(d);
+  T scale_from, scale_to;
+  if (abs_d >= kOne) {
+    scale_from = 1 - t;
+    scale_to   = t;
+  } else {
+    T theta     = std::acos(abs_d);
+    T sin_theta = std::sin(theta);
+    scale_from  = std::sin((1 - t)*theta)/sin_theta;
+    scale_to    = std::sin(t*theta)/sin_theta;
+  }
+  if (d < 0) scale_to = -scale_to;
+  Quaternion<T> q;
+  for (int i = 0; i < 4; i++) q[i] = scale_from*from[i] + scale_to*to[i];
+  return q;
+}
+
 }}}  // hyped::utils::math
 
 #endif  // BEAGLEBONE_BLACK_UTILS_MATH_QUATERNION_HPP_
@@ -0,0 +1,433 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description: Fuses the 3-axis readings of N redundant sensors (the IMUs) so that one sensor that
+ *              is off but still reports itself operational cannot drag the result with it. The
+ *              readings are clamped to a band around the middle two of each axis, and averaged
+ *              with weights that fall as each sensor's tracked distance from the medians grows.
+ *              Readings are taken as structure of arrays and the median is a fixed network of
+ *              min and max instead of a sort. For the four IMUs, while all of them are
+ *              operational, each IMU's reading is one NEON or SSE vector and the vote is a few
+ *              vector instructions without branches on the readings.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_SENSOR_VOTE_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_SENSOR_VOTE_HPP_
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SENSOR_VOTE_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define SENSOR_VOTE_SSE
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+/**
+ * @brief    Robust fusion of N redundant 3-axis sensors
+ *
+ * For sensor i the squared distance from the medians in units of the noise,
+ *   d_i = sum over axes of (reading - median)^2 / noise variance,
+ * is about 3 for a healthy sensor. Its exponential average s_i follows a sensor that drifts away
+ * or keeps jumping, and the sensor counts with weight 1 / max(1, s_i/kDriftScale) in the fused
+ * value, the weighted mean of the readings clamped to within kOutlierLimit standard deviations of
+ * the noise of the middle two. A reading that jumps away moves the result by little even before
+ * s_i weights its sensor down. Drift is slow, so s_i and the weights are updated on every
+ * kTrackPeriod-th vote only and in between the votes use the weights left by the last update.
+ * Healthy sensors count fully, so while all of them are healthy the result is the plain mean of
+ * the clamped readings.
+ *
+ * @tparam N    Number of sensors
+ */
+template <int N>
+class SensorVote {
+  static_assert(N >= 1, "SensorVote needs at least one sensor");
+
+ public:
+  static constexpr float kOutlierLimit = 3;      // band beyond the middle two, in noise std devs
+  static constexpr float kDriftScale   = 9;      // s_i beyond which a sensor is weighted down
+  static constexpr float kDriftAlpha   = 0.15;   // weight of the newest d_i in s_i, ~0.01 a vote
+  static constexpr int   kTrackPeriod  = 16;     // votes per update of s_i
+  static constexpr float kMinVariance  = 1e-12;  // floor of the configured noise variances
+
+  SensorVote();
+
+  /**
+   * @brief    Sets the noise variance of a single sensor on each axis and forgets the history
+   */
+  void configure(const float noise_variance[3]);
+
+  /**
+   * @brief    Fuses one reading of every sensor
+   *
+   * @param[in]  values         Readings as structure of arrays, values[axis*N + i] is the axis of
+   *                            sensor i. Readings of sensors that are not operational are ignored.
+   * @param[in]  operational    Whether each sensor's reading is valid
+   * @param[out] result         Fused value of each axis, 0 if no sensor is operational
+   */
+  void vote(const float values[3*N], const bool operational[N], float result[3]);
+
+  /**
+   * @brief    Weight of sensor i in the next vote, normalised to sum to 1 over all sensors
+   */
+  float getWeight(int i) const { return weight_[i][0]; }
+
+  /**
+   * @brief    Exponential average of sensor i's squared distance from the medians, in units of
+   *           the noise variance
+   */
+  float getResidual(int i) const { return residual_[i]; }
+
+ private:
+  // Rebuilds the masks of the operational sensors and the weights. The mask only changes when a
+  // sensor fails or recovers; rebuilding it on every vote would store it element by element
+  // right before it is loaded as vectors, which stalls.
+  void setOperational(const bool operational[N]);
+
+  // Weights of the operational sensors from their residuals
+  void setWeights();
+
+  // The vote over any set of operational sensors
+  void fuse(const float values[3*N], const bool operational[N], float result[3]);
+
+  // Updates the residuals and the weights from readings that are 0 for the sensors that are not
+  // operational, every kTrackPeriod votes
+  void track(const float reading[3*N]);
+
+  // The middle two of each axis over the operational sensors once sorted, the same one twice for
+  // an odd number and 0 for none. Sorts with a fixed network of min and max instead of
+  // comparisons and jumps.
+  void middle(const float reading[3*N], float low[3], float high[3]) const;
+
+  float inverse_variance_[3];
+  alignas(16) float limit_[4];    // kOutlierLimit standard deviations, padded to a vector of 4
+  bool operational_[N];
+  int num_operational_;
+  alignas(16) float valid_[3*N];  // 1 for the channels of operational sensors, 0 for the others
+  alignas(16) float residual_[N];
+  alignas(16) float weight_[N][4];  // each repeated over a vector
+  bool is_uniform_;                 // all sensors operational and counting fully
+  int countdown_;                   // votes to the next update of the residuals
+};
+
+template <int N>
+constexpr float SensorVote<N>::kOutlierLimit;
+template <int N>
+constexpr float SensorVote<N>::kDriftScale;
+template <int N>
+constexpr float SensorVote<N>::kDriftAlpha;
+template <int N>
+constexpr float SensorVote<N>::kMinVariance;
+template <int N>
+constexpr int SensorVote<N>::kTrackPeriod;
+
+template <int N>
+SensorVote<N>::SensorVote()
+{
+  const float kUnit[3] = {1, 1, 1};
+  configure(kUnit);
+}
+
+template <int N>
+void SensorVote<N>::configure(const float noise_variance[3])
+{
+  for (int axis = 0; axis < 3; axis++) {
+    float variance = std::max(noise_variance[axis], kMinVariance);
+    inverse_variance_[axis] = 1 / variance;
+    limit_[axis]            = kOutlierLimit * std::sqrt(variance);
+  }
+  limit_[3] = 0;
+  for (int i = 0; i < N; i++) {
+    operational_[i] = true;
+    residual_[i]    = 0;
+  }
+  for (int k = 0; k < 3*N; k++) valid_[k] = 1;
+  num_operational_ = N;
+  countdown_       = kTrackPeriod;
+  setWeights();
+}
+
+template <int N>
+void SensorVote<N>::setOperational(const bool operational[N])
+{
+  for (int k = 0; k < 3*N; k++) valid_[k] = operational[k % N];
+  std::copy(operational, operational + N, operational_);
+  num_operational_ = std::count(operational, operational + N, true);
+  setWeights();
+}
+
+template <int N>
+void SensorVote<N>::setWeights()
+{
+  float weight[N];
+  float total = 0;
+  is_uniform_ = true;
+  for (int i = 0; i < N; i++) {
+    weight[i]    = valid_[i] / std::max(1.0f, residual_[i]*(1 / kDriftScale));
+    total       += weight[i];
+    is_uniform_ &= weight[i] == 1;
+  }
+  float scale = 1 / std::max(total, std::numeric_limits<float>::min());
+  for (int i = 0; i < N; i++) std::fill(weight_[i], weight_[i] + 4, weight[i]*scale);
+}
+
+template <int N>
+void SensorVote<N>::middle(const float reading[3*N], float low[3], float high[3]) const
+{
+  // indices of the middle one or two among the operational sensors once sorted
+  const int first  = std::max(num_operational_ - 1, 0) / 2;
+  const int second = num_operational_ / 2;
+
+  // Sensors that are not operational sort last
+  const float kLast = std::numeric_limits<float>::infinity();
+  float sorted[3*N];
+  for (int k = 0; k < 3*N; k++) {
+    float v = reading[k];
+    sorted[k] = valid_[k] > 0 ? v : kLast;
+  }
+  // Odd-even transposition sort of each axis: N rounds of compare-exchanges of neighbours, each a
+  // min and a max
+  for (int round = 0; round < N; round++) {
+    for (int i = round % 2; i + 1 < N; i += 2) {
+      for (int axis = 0; axis < 3; axis++) {
+        float a = sorted[axis*N + i];
+        float b = sorted[axis*N + i + 1];
+        sorted[axis*N + i]     = std::min(a, b);
+        sorted[axis*N + i + 1] = std::max(a, b);
+      }
+    }
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    low[axis]  = num_operational_ > 0 ? sorted[axis*N + first] : 0;
+    high[axis] = num_operational_ > 0 ? sorted[axis*N + second] : 0;
+  }
+}
+
+template <int N>
+void SensorVote<N>::vote(const float values[3*N], const bool operational[N], float result[3])
+{
+  fuse(values, operational, result);
+}
+
+template <int N>
+void SensorVote<N>::fuse(const float values[3*N], const bool operational[N], float result[3])
+{
+  if (!std::equal(operational, operational + N, operational_)) setOperational(operational);
+
+  // Readings of sensors that are not operational may be anything, they are replaced by 0. Their
+  // weights are 0 and their residuals stay as they are.
+  float reading[3*N];
+  for (int k = 0; k < 3*N; k++) {
+    float v = values[k];
+    reading[k] = valid_[k] > 0 ? v : 0;
+  }
+  float low[3];
+  float high[3];
+  middle(reading, low, high);
+
+  for (int axis = 0; axis < 3; axis++) {
+    float sum = 0;
+    for (int i = 0; i < N; i++) {
+      float v = std::min(std::max(reading[axis*N + i], low[axis] - limit_[axis]),
+                         high[axis] + limit_[axis]);
+      sum += weight_[i][0]*v;
+    }
+    result[axis] = sum;
+  }
+  if (--countdown_ == 0) track(reading);
+}
+
+template <int N>
+void SensorVote<N>::track(const float reading[3*N])
+{
+  countdown_ = kTrackPeriod;
+
+  float low[3];
+  float high[3];
+  middle(reading, low, high);
+  float distance[N];
+  for (int i = 0; i < N; i++) distance[i] = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    for (int i = 0; i < N; i++) {
+      float delta  = reading[axis*N + i] - (low[axis] + high[axis]) / 2;
+      distance[i] += delta*delta*inverse_variance_[axis];
+    }
+  }
+  for (int i = 0; i < N; i++) residual_[i] += valid_[i]*kDriftAlpha*(distance[i] - residual_[i]);
+  setWeights();
+}
+
+#if defined(SENSOR_VOTE_NEON) || defined(SENSOR_VOTE_SSE)
+// The same vote while all four sensors are operational, with the readings transposed so that
+// each sensor is one vector of its three axes (and a fourth lane that is not used). The middle
+// two of all axes are then the larger of the pairs' minima and the smaller of their maxima, in
+// either order. The middle two are within the band the readings are clamped to, so while the
+// weights are equal only the minimum of each pair needs clamping from below and only the maximum
+// from above. Written out sensor by sensor, as loops over arrays of vectors are kept in memory.
+template <>
+inline void SensorVote<4>::vote(const float values[12], const bool operational[4], float result[3])
+{
+  // uniform weights need all sensors operational
+  const bool is_vector = std::equal(operational, operational + 4, operational_) &&
+                         (is_uniform_ || num_operational_ == 4);
+  if (!is_vector) {
+    fuse(values, operational, result);
+    return;
+  }
+
+#if defined(SENSOR_VOTE_NEON)
+  const float32x4x2_t xy = vtrnq_f32(vld1q_f32(values), vld1q_f32(values + 4));
+  const float32x4x2_t zz = vtrnq_f32(vld1q_f32(values + 8), vld1q_f32(values + 8));
+  const float32x4_t s0 = vcombine_f32(vget_low_f32(xy.val[0]), vget_low_f32(zz.val[0]));
+  const float32x4_t s1 = vcombine_f32(vget_low_f32(xy.val[1]), vget_low_f32(zz.val[1]));
+  const float32x4_t s2 = vcombine_f32(vget_high_f32(xy.val[0]), vget_high_f32(zz.val[0]));
+  const float32x4_t s3 = vcombine_f32(vget_high_f32(xy.val[1]), vget_high_f32(zz.val[1]));
+  const float32x4_t min01 = vminq_f32(s0, s1);
+  const float32x4_t max01 = vmaxq_f32(s0, s1);
+  const float32x4_t min23 = vminq_f32(s2, s3);
+  const float32x4_t max23 = vmaxq_f32(s2, s3);
+  const float32x4_t a = vmaxq_f32(min01, min23);
+  const float32x4_t b = vminq_f32(max01, max23);
+  const float32x4_t limit = vld1q_f32(limit_);
+  const float32x4_t low   = vsubq_f32(vminq_f32(a, b), limit);
+  const float32x4_t high  = vaddq_f32(vmaxq_f32(a, b), limit);
+
+  float32x4_t fused;
+  if (is_uniform_) {
+    fused = vmulq_f32(vaddq_f32(vaddq_f32(vmaxq_f32(min01, low), vminq_f32(max01, high)),
+                                vaddq_f32(vmaxq_f32(min23, low), vminq_f32(max23, high))),
+                      vld1q_f32(weight_[0]));
+  } else {
+    auto clamp = [low, high](float32x4_t v) {  // NOLINT [whitespace/braces]
+      return vminq_f32(vmaxq_f32(v, low), high);
+    };
+    fused = vmulq_f32(clamp(s0), vld1q_f32(weight_[0]));
+    fused = vmlaq_f32(fused, clamp(s1), vld1q_f32(weight_[1]));
+    fused = vmlaq_f32(fused, clamp(s2), vld1q_f32(weight_[2]));
+    fused = vmlaq_f32(fused, clamp(s3), vld1q_f32(weight_[3]));
+  }
+  vst1_f32(result, vget_low_f32(fused));
+  result[2] = vgetq_lane_f32(fused, 2);
+  if (--countdown_ > 0) return;
+
+  // no divide on NEON: reciprocal estimate refined by two Newton-Raphson steps
+  auto reciprocal = [](float32x4_t v) {  // NOLINT [whitespace/braces]
+    float32x4_t r = vrecpeq_f32(v);
+    r = vmulq_f32(vrecpsq_f32(v, r), r);
+    return vmulq_f32(vrecpsq_f32(v, r), r);
+  };
+  // Untransposed, each axis is a vector of the sensors and the distances are sums of the axes.
+  // The rows are loaded again, the result may alias them.
+  const float32x4_t centre = vmulq_n_f32(vaddq_f32(low, high), 0.5f);
+  const float32x4_t dx = vsubq_f32(vld1q_f32(values), vdupq_lane_f32(vget_low_f32(centre), 0));
+  const float32x4_t dy = vsubq_f32(vld1q_f32(values + 4), vdupq_lane_f32(vget_low_f32(centre), 1));
+  const float32x4_t dz = vsubq_f32(vld1q_f32(values + 8), vdupq_lane_f32(vget_high_f32(centre), 0));
+  float32x4_t distance = vmulq_n_f32(vmulq_f32(dx, dx), inverse_variance_[0]);
+  distance = vmlaq_n_f32(distance, vmulq_f32(dy, dy), inverse_variance_[1]);
+  distance = vmlaq_n_f32(distance, vmulq_f32(dz, dz), inverse_variance_[2]);
+  float32x4_t residual = vld1q_f32(residual_);
+  residual = vmlaq_n_f32(residual, vsubq_f32(distance, residual), kDriftAlpha);
+  float32x4_t weight = reciprocal(vmaxq_f32(vdupq_n_f32(1), vmulq_n_f32(residual,
+                                                                         1 / kDriftScale)));
+  float32x2_t total  = vpadd_f32(vget_low_f32(weight), vget_high_f32(weight));
+  total  = vpadd_f32(total, total);
+  weight = vmulq_f32(weight, reciprocal(vcombine_f32(total, total)));
+  vst1q_f32(residual_, residual);
+  vst1q_f32(weight_[0], vdupq_lane_f32(vget_low_f32(weight), 0));
+  vst1q_f32(weight_[1], vdupq_lane_f32(vget_low_f32(weight), 1));
+  vst1q_f32(weight_[2], vdupq_lane_f32(vget_high_f32(weight), 0));
+  vst1q_f32(weight_[3], vdupq_lane_f32(vget_high_f32(weight), 1));
+#else
+  // the fourth lane of each sensor is a z reading
+  const __m128 x = _mm_loadu_ps(values);
+  const __m128 y = _mm_loadu_ps(values + 4);
+  const __m128 z = _mm_loadu_ps(values + 8);
+  const __m128 xy_low  = _mm_unpacklo_ps(x, y);
+  const __m128 xy_high = _mm_unpackhi_ps(x, y);
+  const __m128 s0 = _mm_shuffle_ps(xy_low, z, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m128 s1 = _mm_shuffle_ps(xy_low, z, _MM_SHUFFLE(1, 1, 3, 2));
+  const __m128 s2 = _mm_shuffle_ps(xy_high, z, _MM_SHUFFLE(3, 2, 1, 0));
+  const __m128 s3 = _mm_shuffle_ps(xy_high, z, _MM_SHUFFLE(3, 3, 3, 2));
+  const __m128 min01 = _mm_min_ps(s0, s1);
+  const __m128 max01 = _mm_max_ps(s0, s1);
+  const __m128 min23 = _mm_min_ps(s2, s3);
+  const __m128 max23 = _mm_max_ps(s2, s3);
+  const __m128 a = _mm_max_ps(min01, min23);
+  const __m128 b = _mm_min_ps(max01, max23);
+  const __m128 limit = _mm_load_ps(limit_);
+  const __m128 low   = _mm_sub_ps(_mm_min_ps(a, b), limit);
+  const __m128 high  = _mm_add_ps(_mm_max_ps(a, b), limit);
+
+  __m128 fused;
+  if (is_uniform_) {
+    fused = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_max_ps(min01, low), _mm_min_ps(max01, high)),
+                                  _mm_add_ps(_mm_max_ps(min23, low), _mm_min_ps(max23, high))),
+                       _mm_load_ps(weight_[0]));
+  } else {
+    auto clamp = [low, high](__m128 v) {  // NOLINT [whitespace/braces]
+      return _mm_min_ps(_mm_max_ps(v, low), high);
+    };
+    fused = _mm_add_ps(_mm_add_ps(_mm_mul_ps(clamp(s0), _mm_load_ps(weight_[0])),
+                                  _mm_mul_ps(clamp(s1), _mm_load_ps(weight_[1]))),
+                       _mm_add_ps(_mm_mul_ps(clamp(s2), _mm_load_ps(weight_[2])),
+                                  _mm_mul_ps(clamp(s3), _mm_load_ps(weight_[3]))));
+  }
+  _mm_storel_pi(reinterpret_cast<__m64*>(result), fused);
+  _mm_store_ss(result + 2, _mm_movehl_ps(fused, fused));
+  if (--countdown_ > 0) return;
+
+  // Untransposed, each axis is a vector of the sensors and the distances are sums of the axes.
+  // The rows are loaded again, the result may alias them.
+  const __m128 centre = _mm_mul_ps(_mm_add_ps(low, high), _mm_set1_ps(0.5f));
+  const __m128 dx = _mm_sub_ps(_mm_loadu_ps(values),
+                               _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(0, 0, 0, 0)));
+  const __m128 dy = _mm_sub_ps(_mm_loadu_ps(values + 4),
+                               _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(1, 1, 1, 1)));
+  const __m128 dz = _mm_sub_ps(_mm_loadu_ps(values + 8),
+                               _mm_shuffle_ps(centre, centre, _MM_SHUFFLE(2, 2, 2, 2)));
+  const __m128 distance = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(inverse_variance_[0])),
+                 _mm_mul_ps(_mm_mul_ps(dy, dy), _mm_set1_ps(inverse_variance_[1]))),
+      _mm_mul_ps(_mm_mul_ps(dz, dz), _mm_set1_ps(inverse_variance_[2])));
+  __m128 residual = _mm_load_ps(residual_);
+  residual = _mm_add_ps(residual, _mm_mul_ps(_mm_set1_ps(kDriftAlpha),
+                                             _mm_sub_ps(distance, residual)));
+  __m128 weight = _mm_div_ps(_mm_set1_ps(1), _mm_max_ps(_mm_set1_ps(1), _mm_mul_ps(residual,
+                                                            _mm_set1_ps(1 / kDriftScale))));
+  __m128 total  = _mm_add_ps(weight, _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(2, 3, 0, 1)));
+  total  = _mm_add_ps(total, _mm_shuffle_ps(total, total, _MM_SHUFFLE(1, 0, 3, 2)));
+  weight = _mm_div_ps(weight, total);
+  _mm_store_ps(residual_, residual);
+  _mm_store_ps(weight_[0], _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(0, 0, 0, 0)));
+  _mm_store_ps(weight_[1], _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(1, 1, 1, 1)));
+  _mm_store_ps(weight_[2], _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(2, 2, 2, 2)));
+  _mm_store_ps(weight_[3], _mm_shuffle_ps(weight, weight, _MM_SHUFFLE(3, 3, 3, 3)));
+#endif
+  is_uniform_ = true;
+  for (int i = 0; i < 4; i++) is_uniform_ &= residual_[i]*(1 / kDriftScale) <= 1;
+  countdown_ = kTrackPeriod;
+}
+#endif
+
+}}}  // namespace hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_SENSOR_VOTE_HPP_
@@ -0,0 +1,202 @@
+/*
+ * Authors: HYPED
+ * Organisation: HYPED
+ * Date: 28/07/2018
+ * Description: Single precision quaternion held in one 4-lane NEON or SSE register for integrating
+ *              the gyros at the IMU rate: Hamilton product in four multiply-adds of shuffled
+ *              lanes, normalisation with the reciprocal square root estimate refined by Newton
+ *              steps, and the exponential of a small rotation vector as a power series instead
+ *              of sin and cos. Without NEON or SSE the same operations run on scalars.
+ *
+ *    Copyright 2018 HYPED
+ *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
+ *    except in compliance with the License. You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software distributed under
+ *    the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ *    either express or implied. See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef BEAGLEBONE_BLACK_UTILS_MATH_SIMD_QUATERNION_HPP_
+#define BEAGLEBONE_BLACK_UTILS_MATH_SIMD_QUATERNION_HPP_
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_QUATERNION_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define SIMD_QUATERNION_SSE
+#endif
+
+#include <cmath>
+
+#include "quaternion.hpp"
+#include "vector.hpp"
+
+namespace hyped {
+namespace utils {
+namespace math {
+
+/**
+ * @brief    Quaternion (w, x, y, z) of floats for orientation propagation. Converts to and from
+ *           Quaternion<float> for everything else.
+ */
+class SimdQuaternion {
+ public:
+  // Rotations up to this angle (rad) use the power series in fromRotationVector(), larger ones
+  // sin and cos. The first omitted term is below 1e-10 up to here.
+  static constexpr float kSmallAngle = 0.1;
+
+  /**
+   * @brief    The identity rotation
+   */
+  SimdQuaternion() : SimdQuaternion(1, 0, 0, 0) {}
+  SimdQuaternion(float w, float x, float y, float z);
+  explicit SimdQuaternion(const Quaternion<float>& q) : SimdQuaternion(q[0], q[1], q[2], q[3]) {}
+
+  Quaternion<float> toQuaternion() const;
+  float operator[](int index) const { return elements_[index]; }
+
+  /**
+   * @brief    Hamilton product, this = this * rhs
+   */
+  SimdQuaternion& operator*=(const SimdQuaternion& rhs);
+
+  /**
+   * @brief    Scales to unit norm, to within about one float rounding
+   */
+  void normalise();
+
+  /**
+   * @brief    Unit quaternion of the rotation by |rotation| rad about `rotation`, i.e. the
+   *           exponential of (0, rotation/2)
+   */
+  static SimdQuaternion fromRotationVector(const Vector<float, 3>& rotation);
+
+  /**
+   * @brief    Applies the rotation vector `rotation` in the body frame, this = this *
+   *           fromRotationVector(rotation), and renormalises
+   */
+  void rotate(const Vector<float, 3>& rotation);
+
+ private:
+  alignas(16) float elements_[4];
+};
+
+inline SimdQuaternion::SimdQuaternion(float w, float x, float y, float z)
+{
+  elements_[0] = w;
+  elements_[1] = x;
+  elements_[2] = y;
+  elements_[3] = z;
+}
+
+inline Quaternion<float> SimdQuaternion::toQuaternion() const
+{
+  return Quaternion<float>(elements_[0], elements_[1], elements_[2], elements_[3]);
+}
+
+inline SimdQuaternion& SimdQuaternion::operator*=(const SimdQuaternion& rhs)
+{
+  // this * rhs = a0*b + a1*(-b1, b0, -b3, b2) + a2*(-b2, b3, b0, -b1) + a3*(-b3, -b2, b1, b0)
+#if defined(SIMD_QUATERNION_NEON)
+  const uint32x4_t kSign1 = {0x80000000, 0, 0x80000000, 0};
+  const uint32x4_t kSign2 = {0x80000000, 0, 0, 0x80000000};
+  const uint32x4_t kSign3 = {0x80000000, 0x80000000, 0, 0};
+  float32x4_t a = vld1q_f32(elements_);
+  float32x4_t b = vld1q_f32(rhs.elements_);
+  float32x4_t b1 = vrev64q_f32(b);                                  // b1 b0 b3 b2
+  float32x4_t b2 = vcombine_f32(vget_high_f32(b), vget_low_f32(b));  // b2 b3 b0 b1
+  float32x4_t b3 = vrev64q_f32(b2);                                 // b3 b2 b1 b0
+  b1 = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(b1), kSign1));
+  b2 = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(b2), kSign2));
+  b3 = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(b3), kSign3));
+  float32x4_t r = vmulq_lane_f32(b, vget_low_f32(a), 0);
+  r = vmlaq_lane_f32(r, b1, vget_low_f32(a), 1);
+  r = vmlaq_lane_f32(r, b2, vget_high_f32(a), 0);
+  r = vmlaq_lane_f32(r, b3, vget_high_f32(a), 1);
+  vst1q_f32(elements_, r);
+#elif defined(SIMD_QUATERNION_SSE)
+  const __m128 kSign1 = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+  const __m128 kSign2 = _mm_setr_ps(-0.0f, 0.0f, 0.0f, -0.0f);
+  const __m128 kSign3 = _mm_setr_ps(-0.0f, -0.0f, 0.0f, 0.0f);
+  __m128 a = _mm_load_ps(elements_);
+  __m128 b = _mm_load_ps(rhs.elements_);
+  __m128 b1 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)), kSign1);
+  __m128 b2 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)), kSign2);
+  __m128 b3 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3)), kSign3);
+  __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b);
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+  _mm_store_ps(elements_, r);
+#else
+  const float* a = elements_;
+  const float* b = rhs.elements_;
+  float r[4] = {a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3],
+                a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2],
+                a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1],
+                a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0]};
+  for (int i = 0; i < 4; i++) elements_[i] = r[i];
+#endif
+  return *this;
+}
+
+inline void SimdQuaternion::normalise()
+{
+#if defined(SIMD_QUATERNION_NEON)
+  float32x4_t q = vld1q_f32(elements_);
+  float32x4_t squares = vmulq_f32(q, q);
+  float32x2_t n2 = vadd_f32(vget_low_f32(squares), vget_high_f32(squares));
+  n2 = vpadd_f32(n2, n2);
+  // the estimate has about 8 bits, each Newton-Raphson step doubles that
+  float32x2_t r = vrsqrte_f32(n2);
+  r = vmul_f32(vrsqrts_f32(vmul_f32(n2, r), r), r);
+  r = vmul_f32(vrsqrts_f32(vmul_f32(n2, r), r), r);
+  vst1q_f32(elements_, vmulq_lane_f32(q, r, 0));
+#elif defined(SIMD_QUATERNION_SSE)
+  __m128 q = _mm_load_ps(elements_);
+  __m128 n2 = _mm_mul_ps(q, q);
+  n2 = _mm_add_ps(n2, _mm_movehl_ps(n2, n2));
+  n2 = _mm_add_ss(n2, _mm_shuffle_ps(n2, n2, 1));
+  n2 = _mm_shuffle_ps(n2, n2, 0);
+  // the estimate has 12 bits, one Newton-Raphson step brings it to about float precision
+  __m128 r = _mm_rsqrt_ps(n2);
+  r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r),
+                 _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(n2, r), r)));
+  _mm_store_ps(elements_, _mm_mul_ps(q, r));
+#else
+  float n2 = 0;
+  for (int i = 0; i < 4; i++) n2 += elements_[i]*elements_[i];
+  float r = 1/std::sqrt(n2);
+  for (int i = 0; i < 4; i++) elements_[i] *= r;
+#endif
+}
+
+inline SimdQuaternion SimdQuaternion::fromRotationVector(const Vector<float, 3>& rotation)
+{
+  float theta2 = dot(rotation, rotation);
+  float w, s;   // cos(theta/2) and sin(theta/2)/theta
+  if (theta2 < kSmallAngle*kSmallAngle) {
+    w = 1 - theta2/8*(1 - theta2/48);
+    s = 0.5f - theta2/48*(1 - theta2/80);
+  } else {
+    float theta = std::sqrt(theta2);
+    w = std::cos(theta/2);
+    s = std::sin(theta/2)/theta;
+  }
+  return SimdQuaternion(w, s*rotation[0], s*rotation[1], s*rotation[2]);
+}
+
+inline void SimdQuaternion::rotate(const Vector<float, 3>& rotation)
+{
+  *this *= fromRotationVector(rotation);
+  normalise();
+}
+
+}}}  // namespace hyped::utils::math
+
+#endif  // BEAGLEBONE_BLACK_UTILS_MATH_SIMD_QUATERNION_HPP_
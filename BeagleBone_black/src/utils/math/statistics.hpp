@@ -2,7 +2,8 @@
  * Author: Branislav Pilnan
  * Organisation: HYPED
  * Date: 06/06/2018
- * Description: Algorithms for computing online/rolling mean, variance, and standard deviation
+ * Description: Algorithms for computing online/rolling/exponentially weighted mean, variance, and
+ *              standard deviation, and rolling and streaming estimates of medians and quantiles
  *
  *    Copyright 2018 HYPED
  *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
@@ -19,10 +20,12 @@
 #ifndef BEAGLEBONE_BLACK_UTILS_MATH_STATISTICS_HPP_
 #define BEAGLEBONE_BLACK_UTILS_MATH_STATISTICS_HPP_
 
+#include <array>
 #include <cassert>
+#include <cstddef>
+
+#include <algorithm>
 #include <cmath>
-#include <list>
-#include <queue>
 
 namespace hyped {
 namespace utils {
@@ -83,25 +86,29 @@ void OnlineStatistics<T>::update(T new_value)
 }
 
 /**
- * @brief Computes stats (mean, variance, etc.) of a rolling window of numbers. Memory usage is
- *        linear in `window_size`.
+ * @brief Computes stats (mean, variance, etc.) of a rolling window of the last N numbers. The
+ *        window is a ring buffer inside the object, updates never allocate.
  *
  * @tparam T Underlying numeric type
+ * @tparam N Window size
  */
-template <typename T>
+template <typename T, std::size_t N>
 class RollingStatistics : public Statistics<T> {
+  static_assert(N > 0, "The window must hold at least one value");
+
  public:
-  explicit RollingStatistics(std::size_t window_size);
+  RollingStatistics();
   void update(T new_value) override;
 
  private:
-  const std::size_t window_size_;
-  std::queue<T, std::list<T>> window_;
+  std::array<T, N> window_;
+  std::size_t size_;     // values in the window so far, N once it is full
+  std::size_t oldest_;   // index of the value that leaves the window next
   OnlineStatistics<T> online_;
 };
 
-template <typename T>
-RollingStatistics<T>::RollingStatistics(std::size_t window_size) : window_size_(window_size)
+template <typename T, std::size_t N>
+RollingStatistics<T, N>::RollingStatistics() : size_(0), oldest_(0)
 {}
 
 /**
@@ -112,26 +119,255 @@ RollingStatistics<T>::RollingStatistics(std::size_t window_size) : window_size_(
  * @tparam T Underlying numeric type
  * @param new_value New value entering the window
  */
-template <typename T>
-void RollingStatistics<T>::update(T new_value)
+template <typename T, std::size_t N>
+void RollingStatistics<T, N>::update(T new_value)
 {
-  if (window_.size() < window_size_) {
-    window_.push(new_value);
+  if (size_ < N) {
+    window_[size_++] = new_value;
     online_.update(new_value);
     this->sum_      = online_.getSum();
     this->mean_     = online_.getMean();
     this->variance_ = online_.getVariance();
   } else {
-    assert(window_.size() == window_size_);
-    this->sum_ = this->sum_ + new_value - window_.front();
-    T new_mean = this->sum_ / window_size_;
-    this->variance_ += (new_value - window_.front())
-                        * (new_value - new_mean + window_.front() - this->mean_)
-                        / (window_size_ - 1);
+    const T& oldest = window_[oldest_];
+    this->sum_ = this->sum_ + new_value - oldest;
+    T new_mean = this->sum_ / N;
+    this->variance_ += (new_value - oldest)
+                        * (new_value - new_mean + oldest - this->mean_)
+                        / (N - 1);
     this->mean_ = new_mean;
-    window_.pop();
-    window_.push(new_value);
+    window_[oldest_] = new_value;
+    oldest_ = oldest_ + 1 == N ? 0 : oldest_ + 1;
+  }
+}
+
+/**
+ * @brief Exponentially weighted mean and variance: every update moves the mean by `alpha` of the
+ *        way to the new value, so older values count less and less instead of dropping out of a
+ *        window. The sum is the plain sum of all values.
+ *
+ * @tparam T Underlying numeric type
+ */
+template <typename T>
+class ExponentialStatistics : public Statistics<T> {
+ public:
+  /**
+   * @param alpha Weight of a new value, in (0, 1]. Similar to a window of 2/alpha - 1 values.
+   */
+  explicit ExponentialStatistics(double alpha);
+  void update(T new_value) override;
+
+ private:
+  double alpha_;
+  bool has_value_;
+};
+
+template <typename T>
+ExponentialStatistics<T>::ExponentialStatistics(double alpha) : alpha_(alpha), has_value_(false)
+{
+  assert(alpha > 0 && alpha <= 1);
+}
+
+/**
+ * @brief Incremental form from "Incremental calculation of weighted mean and variance" by Tony
+ *        Finch, which stays numerically stable
+ */
+template <typename T>
+void ExponentialStatistics<T>::update(T new_value)
+{
+  this->sum_ += new_value;
+  if (!has_value_) {
+    this->mean_ = new_value;
+    has_value_  = true;
+    return;
+  }
+  T delta     = new_value - this->mean_;
+  T increment = delta * alpha_;
+  this->mean_ += increment;
+  this->variance_ = (this->variance_ + delta * increment) * (1 - alpha_);
+}
+
+/**
+ * @brief Exact median of a rolling window of the last N numbers, kept sorted next to the ring
+ *        buffer. An update moves up to N values, which is cheap for the short windows used to
+ *        reject sensor outliers; nothing is allocated.
+ *
+ * @tparam T Underlying numeric type, must be ordered
+ * @tparam N Window size
+ */
+template <typename T, std::size_t N>
+class RollingMedian {
+  static_assert(N > 0, "The window must hold at least one value");
+
+ public:
+  RollingMedian();
+  void update(T new_value);
+
+  /**
+   * @brief Median of the values in the window, the mean of the middle two for an even count.
+   *        Zero before the first update.
+   */
+  T getMedian() const;
+
+ private:
+  std::array<T, N> window_;   // in arrival order
+  std::array<T, N> sorted_;   // the same values in ascending order
+  std::size_t size_;
+  std::size_t oldest_;
+};
+
+template <typename T, std::size_t N>
+RollingMedian<T, N>::RollingMedian() : size_(0), oldest_(0)
+{}
+
+template <typename T, std::size_t N>
+void RollingMedian<T, N>::update(T new_value)
+{
+  T* begin = sorted_.data();
+  T* end   = begin + size_;
+  if (size_ < N) {
+    window_[size_++] = new_value;
+  } else {
+    // Remove the oldest value from the sorted values
+    T* old = std::lower_bound(begin, end, window_[oldest_]);
+    std::copy(old + 1, end, old);
+    end--;
+    window_[oldest_] = new_value;
+    oldest_ = oldest_ + 1 == N ? 0 : oldest_ + 1;
+  }
+  T* position = std::upper_bound(begin, end, new_value);
+  std::copy_backward(position, end, end + 1);
+  *position = new_value;
+}
+
+template <typename T, std::size_t N>
+T RollingMedian<T, N>::getMedian() const
+{
+  if (size_ == 0) return T(0);
+  if (size_ % 2 == 1) return sorted_[size_ / 2];
+  return (sorted_[size_ / 2 - 1] + sorted_[size_ / 2]) / 2;
+}
+
+/**
+ * @brief Streaming estimate of a quantile (e.g. 0.5 for the median, 0.99 for the 99th
+ *        percentile) of all numbers seen so far in constant memory and time, with the P-square
+ *        algorithm: R. Jain and I. Chlamtac, "The P2 algorithm for dynamic calculation of
+ *        quantiles and histograms without storing observations", CACM 28(10), 1985. Five markers
+ *        track the minimum, the quantile, the maximum, and two points in between; their heights
+ *        are adjusted with a piecewise-parabolic fit as the numbers come in.
+ *
+ * @tparam T Underlying floating-point type
+ */
+template <typename T>
+class P2Quantile {
+ public:
+  /**
+   * @param quantile The quantile to estimate, in (0, 1)
+   */
+  explicit P2Quantile(double quantile);
+  void update(T new_value);
+
+  /**
+   * @brief The current estimate, exact for up to five numbers. Zero before the first update.
+   */
+  T getQuantile() const;
+  int getCount() const { return count_; }
+
+ private:
+  static constexpr int kNumMarkers = 5;
+
+  // Parabolic and, if that would not keep the heights ordered, linear prediction of the height
+  // of marker i moved by d = +-1
+  T parabolic(int i, int d) const;
+  T linear(int i, int d) const;
+
+  double quantile_;
+  int count_;
+  std::array<T, kNumMarkers> heights_;
+  std::array<int, kNumMarkers> positions_;        // 1-based ranks of the markers
+  std::array<double, kNumMarkers> desired_;       // where the markers should be
+  std::array<double, kNumMarkers> increments_;    // of the desired positions per number
+};
+
+template <typename T>
+constexpr int P2Quantile<T>::kNumMarkers;
+
+template <typename T>
+P2Quantile<T>::P2Quantile(double quantile) : quantile_(quantile), count_(0)
+{
+  assert(quantile > 0 && quantile < 1);
+  for (int i = 0; i < kNumMarkers; i++) positions_[i] = i + 1;
+  desired_    = {{1, 1 + 2*quantile, 1 + 4*quantile, 3 + 2*quantile, 5}};
+  increments_ = {{0, quantile/2, quantile, (1 + quantile)/2, 1}};
+}
+
+template <typename T>
+void P2Quantile<T>::update(T new_value)
+{
+  if (count_ < kNumMarkers) {
+    // The first values are the initial heights, kept sorted
+    int i = count_++;
+    for (; i > 0 && heights_[i - 1] > new_value; i--) heights_[i] = heights_[i - 1];
+    heights_[i] = new_value;
+    return;
+  }
+  count_++;
+
+  // Cell k the new value falls into, extending the extreme markers if needed
+  int k;
+  if (new_value < heights_[0]) {
+    heights_[0] = new_value;
+    k = 0;
+  } else if (new_value >= heights_[kNumMarkers - 1]) {
+    heights_[kNumMarkers - 1] = new_value;
+    k = kNumMarkers - 2;
+  } else {
+    k = 0;
+    while (new_value >= heights_[k + 1]) k++;
+  }
+  for (int i = k + 1; i < kNumMarkers; i++) positions_[i]++;
+  for (int i = 0; i < kNumMarkers; i++) desired_[i] += increments_[i];
+
+  // Move the middle markers that are off their desired positions by a rank or more
+  for (int i = 1; i < kNumMarkers - 1; i++) {
+    double off = desired_[i] - positions_[i];
+    bool move_up   = off >= 1 && positions_[i + 1] - positions_[i] > 1;
+    bool move_down = off <= -1 && positions_[i - 1] - positions_[i] < -1;
+    if (move_up || move_down) {
+      int d = off > 0 ? 1 : -1;
+      T height = parabolic(i, d);
+      if (!(heights_[i - 1] < height && height < heights_[i + 1])) height = linear(i, d);
+      heights_[i]    = height;
+      positions_[i] += d;
+    }
+  }
+}
+
+template <typename T>
+T P2Quantile<T>::parabolic(int i, int d) const
+{
+  double n_prev = positions_[i - 1], n = positions_[i], n_next = positions_[i + 1];
+  return heights_[i] + d / (n_next - n_prev) *
+         ((n - n_prev + d) * (heights_[i + 1] - heights_[i]) / (n_next - n) +
+          (n_next - n - d) * (heights_[i] - heights_[i - 1]) / (n - n_prev));
+}
+
+template <typename T>
+T P2Quantile<T>::linear(int i, int d) const
+{
+  return heights_[i] + d * (heights_[i + d] - heights_[i]) / (positions_[i + d] - positions_[i]);
+}
+
+template <typename T>
+T P2Quantile<T>::getQuantile() const
+{
+  if (count_ == 0) return T(0);
+  if (count_ <= kNumMarkers) {
+    // Nearest rank of the sorted values
+    int rank = static_cast<int>(std::ceil(quantile_ * count_));
+    return heights_[std::max(rank, 1) - 1];
   }
+  return heights_[2];
 }
 
 }}}  // namespace hyped::utils::math
@@ -4,7 +4,9 @@
  * Organisation: HYPED
  * Date: 17 February 2018
  * Description: K-dimensional vector class that supports addition,  substraction,  scalar
- *              multiplication, and scalar division.
+ *              multiplication, and scalar division. The operators are evaluated lazily: they
+ *              return light expression objects, and a whole chain such as (1 - w)*a + w*b is
+ *              computed in a single loop, element by element, when it is assigned to a Vector.
  *
  *    Copyright 2018 HYPED
  *    Licensed under the Apache License, Version 2.0 (the "License"); you may not use this file
@@ -19,9 +21,12 @@
  */
 
 #include <initializer_list>
+#include <type_traits>
 
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <utility>
 
 #ifndef BEAGLEBONE_BLACK_UTILS_MATH_VECTOR_HPP_
 #define BEAGLEBONE_BLACK_UTILS_MATH_VECTOR_HPP_
@@ -30,8 +35,66 @@ namespace hyped {
 namespace utils {
 namespace math {
 
+struct VectorExpressionTag {};
+
+namespace vector_expression {
+
+struct Assign {
+  template <typename A, typename B>
+  static void apply(A& a, B b) { a = A(b); }   // NOLINT [runtime/references]
+};
+struct AddAssign {
+  template <typename A, typename B>
+  static void apply(A& a, B b) { a += A(b); }  // NOLINT [runtime/references]
+};
+struct SubtractAssign {
+  template <typename A, typename B>
+  static void apply(A& a, B b) { a -= A(b); }  // NOLINT [runtime/references]
+};
+struct MultiplyAssign {
+  template <typename A, typename B>
+  static void apply(A& a, B b) { a *= A(b); }  // NOLINT [runtime/references]
+};
+struct DivideAssign {
+  template <typename A, typename B>
+  static void apply(A& a, B b) { a /= A(b); }  // NOLINT [runtime/references]
+};
+
+// Evaluates an expression into `elements` with Op, element by element. The loop is unrolled
+// here as GCC does not always unroll it at -O2, which then keeps it from vectorising.
+template <typename Op, int index, int dimension>
+struct Evaluate {
+  template <typename T, typename E>
+  static void apply(T* elements, const E& expression)
+  {
+    Op::apply(elements[index], expression[index]);
+    Evaluate<Op, index + 1, dimension>::apply(elements, expression);
+  }
+};
+template <typename Op, int dimension>
+struct Evaluate<Op, dimension, dimension> {
+  template <typename T, typename E>
+  static void apply(T* /* elements */, const E& /* expression */) {}
+};
+
+}  // namespace vector_expression
+
+/**
+ * @brief    Base of everything that can take part in vector arithmetic: Vector itself and the
+ *           unevaluated results of the operators below. `E` is the derived class, which provides
+ *           `T operator[](int) const`.
+ */
+template <typename E, typename T, int dimension>
+class VectorExpression : public VectorExpressionTag {
+ public:
+  typedef T value_type;
+  static constexpr int kDimension = dimension;
+
+  const E& derived() const { return static_cast<const E&>(*this); }
+};
+
 template <typename T, int dimension>
-class Vector {
+class Vector : public VectorExpression<Vector<T, dimension>, T, dimension> {
  public:
   static_assert(dimension > 0,  "Dimension must be greater than zero.");
 
@@ -48,10 +111,13 @@ class Vector {
   explicit Vector(const std::initializer_list<T> elements);
 
   /**
-   * @brief    Conversion from one vector type to another.
+   * @brief    Evaluates a vector expression (or converts from another vector type).
    */
-  template <typename U>
-  Vector(const Vector<U, dimension>& rhs);
+  template <typename E, typename U>
+  Vector(const VectorExpression<E, U, dimension>& rhs);
+
+  template <typename E, typename U>
+  Vector<T, dimension>& operator=(const VectorExpression<E, U, dimension>& rhs);
 
   /**
    * @brief    For assigning values to entries in a vector.
@@ -63,9 +129,10 @@ class Vector {
    */
   T operator[] (int index) const;
 
-  Vector<T, dimension> operator-() const;
-  Vector<T, dimension>& operator+=(const Vector<T, dimension>& rhs);
-  Vector<T, dimension>& operator-=(const Vector<T, dimension>& rhs);
+  template <typename E, typename U>
+  Vector<T, dimension>& operator+=(const VectorExpression<E, U, dimension>& rhs);
+  template <typename E, typename U>
+  Vector<T, dimension>& operator-=(const VectorExpression<E, U, dimension>& rhs);
 
   /**
    * @brief    Addition or subtraction of every element by a constant.
@@ -82,8 +149,10 @@ class Vector {
   /**
    * @brief    Element-wise multiplication and division of vectors.
    */
-  Vector<T, dimension>& operator*=(const Vector<T, dimension>& rhs);
-  Vector<T, dimension>& operator/=(const Vector<T, dimension>& rhs);
+  template <typename E, typename U>
+  Vector<T, dimension>& operator*=(const VectorExpression<E, U, dimension>& rhs);
+  template <typename E, typename U>
+  Vector<T, dimension>& operator/=(const VectorExpression<E, U, dimension>& rhs);
 
   /**
    * @brief    Calculates the magnitude of a vector.
@@ -103,7 +172,25 @@ class Vector {
   Vector<double, dimension> toUnitVector();
 
  private:
-  std::array<T, dimension> elements_;
+  template <typename Op, typename E>
+  void evaluate(const E& rhs)
+  {
+    // The whole expression is read before any element is written, so that the compiler need not
+    // assume the writes change its operands
+    std::array<T, dimension> values;
+    vector_expression::Evaluate<vector_expression::Assign, 0, dimension>::apply(values.data(), rhs);
+    vector_expression::Evaluate<Op, 0, dimension>::apply(elements_.data(), values);
+  }
+
+  // Vectors of 2 or 4 elements are aligned to their size so that the compiler can load and store
+  // them whole, up to the alignment that operator new guarantees. Other sizes are not padded:
+  // that would change the layout of data::Sensors, and with it the recordings.
+  static constexpr std::size_t kSize = sizeof(T) * dimension;
+  static constexpr std::size_t kAlignment =
+      (dimension & (dimension - 1)) == 0 && kSize <= alignof(std::max_align_t)
+      ? kSize : alignof(T);
+
+  alignas(kAlignment) std::array<T, dimension> elements_;
 };
 
 template <typename T, int dimension>
@@ -135,44 +222,47 @@ Vector<T, dimension>::Vector(const std::initializer_list<T> elements)
 }
 
 template <typename T, int dimension>
-template <typename U>
-Vector<T, dimension>::Vector(const Vector<U, dimension>& rhs)
+template <typename E, typename U>
+Vector<T, dimension>::Vector(const VectorExpression<E, U, dimension>& rhs)
 {
-  for (int i = 0; i < dimension; i++)
-    elements_[i] = T(rhs[i]);
+  evaluate<vector_expression::Assign>(rhs.derived());
 }
 
 template <typename T, int dimension>
-T& Vector<T, dimension>::operator[](int index)
+template <typename E, typename U>
+Vector<T, dimension>& Vector<T, dimension>::operator=(const VectorExpression<E, U, dimension>& rhs)
 {
-  return elements_[index];
+  // Element i of an expression only depends on element i of its operands, so the expression may
+  // contain this vector
+  evaluate<vector_expression::Assign>(rhs.derived());
+  return *this;
 }
 
 template <typename T, int dimension>
-T Vector<T, dimension>::operator[](int index) const
+T& Vector<T, dimension>::operator[](int index)
 {
   return elements_[index];
 }
 
 template <typename T, int dimension>
-Vector<T, dimension> Vector<T, dimension>::operator-() const
+T Vector<T, dimension>::operator[](int index) const
 {
-  return (Vector<T, dimension>() - *this);
+  return elements_[index];
 }
 
 template <typename T, int dimension>
-Vector<T, dimension>& Vector<T, dimension>::operator+=(const Vector<T, dimension>& rhs)
+template <typename E, typename U>
+Vector<T, dimension>& Vector<T, dimension>::operator+=(const VectorExpression<E, U, dimension>& rhs)
 {
-  for (int i = 0; i < dimension; i++)
-    elements_[i] += rhs[i];
+  evaluate<vector_expression::AddAssign>(rhs.derived());
   return *this;
 }
 
 template <typename T, int dimension>
-Vector<T, dimension>& Vector<T, dimension>::operator-=(const Vector<T, dimension>& rhs)
+template <typename E, typename U>
+Vector<T, dimension>& Vector<T, dimension>::operator-=(const VectorExpression<E, U, dimension>& rhs)
 {
-  for (int i = 0; i < dimension; i++)
-    elements_[i] -= rhs[i];
+  evaluate<vector_expression::SubtractAssign>(rhs.derived());
   return *this;
 }
 
@@ -201,10 +291,10 @@ Vector<T, dimension>& Vector<T, dimension>::operator*=(const T rhs)
 }
 
 template <typename T, int dimension>
-Vector<T, dimension>& Vector<T, dimension>::operator*=(const Vector<T, dimension>& rhs)
+template <typename E, typename U>
+Vector<T, dimension>& Vector<T, dimension>::operator*=(const VectorExpression<E, U, dimension>& rhs)
 {
-  for (int i = 0; i < dimension; i++)
-    elements_[i] *= rhs[i];
+  evaluate<vector_expression::MultiplyAssign>(rhs.derived());
   return *this;
 }
 
@@ -217,10 +307,10 @@ Vector<T, dimension>& Vector<T, dimension>::operator/=(const T rhs)
 }
 
 template <typename T, int dimension>
-Vector<T, dimension>& Vector<T, dimension>::operator/=(const Vector<T, dimension>& rhs)
+template <typename E, typename U>
+Vector<T, dimension>& Vector<T, dimension>::operator/=(const VectorExpression<E, U, dimension>& rhs)
 {
-  for (int i = 0; i < dimension; i++)
-    elements_[i] /= rhs[i];
+  evaluate<vector_expression::DivideAssign>(rhs.derived());
   return *this;
 }
 
@@ -251,103 +341,201 @@ Vector<double, dimension> Vector<T, dimension>::toUnitVector()
   return ans;
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator+(const Vector<T1, dimension>& lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs[0]+rhs[0]), dimension>
+namespace vector_expression {
+
+template <typename X>
+struct IsExpression : std::is_base_of<VectorExpressionTag, typename std::decay<X>::type> {};
+
+// How an expression keeps an operand of type X (as deduced by a forwarding reference). Vectors
+// that are lvalues are referenced; temporary vectors and other expressions are copied so that an
+// expression stored with `auto` never refers to a destroyed temporary.
+template <typename X>
+struct Stored { typedef typename std::decay<X>::type type; };
+template <typename T, int dimension>
+struct Stored<Vector<T, dimension>&> { typedef const Vector<T, dimension>& type; };
+template <typename T, int dimension>
+struct Stored<const Vector<T, dimension>&> { typedef const Vector<T, dimension>& type; };
+
+template <typename X>
+struct Traits {
+  typedef typename std::decay<X>::type Type;
+  typedef typename Type::value_type Element;
+  static constexpr int kDimension = Type::kDimension;
+};
+
+// A scalar operand, every element of which is the same
+template <typename S, int dimension>
+class Scalar : public VectorExpression<Scalar<S, dimension>, S, dimension> {
+ public:
+  explicit Scalar(S value) : value_(value) {}
+  S operator[](int /* index */) const { return value_; }
+
+ private:
+  S value_;
+};
+
+struct Add {
+  template <typename A, typename B>
+  static auto apply(A a, B b) -> decltype(a + b) { return a + b; }
+};
+struct Subtract {
+  template <typename A, typename B>
+  static auto apply(A a, B b) -> decltype(a - b) { return a - b; }
+};
+struct Multiply {
+  template <typename A, typename B>
+  static auto apply(A a, B b) -> decltype(a * b) { return a * b; }
+};
+struct Divide {
+  template <typename A, typename B>
+  static auto apply(A a, B b) -> decltype(a / b) { return a / b; }
+};
+
+template <typename Op, typename L, typename R>
+using BinaryElement = decltype(Op::apply(std::declval<typename Traits<L>::Element>(),
+                                         std::declval<typename Traits<R>::Element>()));
+
+// Element-wise `lhs Op rhs`, evaluated when an element is read
+template <typename Op, typename L, typename R>
+class Binary
+    : public VectorExpression<Binary<Op, L, R>, BinaryElement<Op, L, R>, Traits<L>::kDimension> {
+ public:
+  static_assert(Traits<L>::kDimension == Traits<R>::kDimension, "Dimensions do not match.");
+
+  template <typename A, typename B>
+  Binary(A&& lhs, B&& rhs) : lhs_(std::forward<A>(lhs)), rhs_(std::forward<B>(rhs)) {}
+
+  BinaryElement<Op, L, R> operator[](int index) const
+  {
+    return Op::apply(lhs_[index], rhs_[index]);
+  }
+
+ private:
+  L lhs_;
+  R rhs_;
+};
+
+template <typename X>
+class Negate
+    : public VectorExpression<Negate<X>, typename Traits<X>::Element, Traits<X>::kDimension> {
+ public:
+  template <typename A>
+  explicit Negate(A&& operand) : operand_(std::forward<A>(operand)) {}
+
+  typename Traits<X>::Element operator[](int index) const { return -operand_[index]; }
+
+ private:
+  X operand_;
+};
+
+// Result types of the operators below
+template <typename Op, typename L, typename R>
+using VectorVector = Binary<Op, typename Stored<L>::type, typename Stored<R>::type>;
+template <typename Op, typename L, typename S>
+using VectorScalar = Binary<Op, typename Stored<L>::type,
+                            Scalar<typename std::decay<S>::type, Traits<L>::kDimension>>;
+template <typename Op, typename S, typename R>
+using ScalarVector = Binary<Op, Scalar<typename std::decay<S>::type, Traits<R>::kDimension>,
+                            typename Stored<R>::type>;
+
+template <typename L, typename R>
+using IfVectorVector = typename std::enable_if<
+    IsExpression<L>::value && IsExpression<R>::value, int>::type;
+template <typename L, typename S>
+using IfVectorScalar = typename std::enable_if<
+    IsExpression<L>::value && std::is_arithmetic<typename std::decay<S>::type>::value, int>::type;
+
+}  // namespace vector_expression
+
+template <typename L, typename R, vector_expression::IfVectorVector<L, R> = 0>
+vector_expression::VectorVector<vector_expression::Add, L, R> operator+(L&& lhs, R&& rhs)
 {
-  Vector<decltype(lhs[0]+rhs[0]), dimension> ans(lhs);
-  ans += rhs;
-  return ans;
+  return vector_expression::VectorVector<vector_expression::Add, L, R>(
+      std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator+(const Vector<T1, dimension>& lhs,  const T2 rhs)
-    -> Vector<decltype(lhs[0]+rhs), dimension>
+template <typename L, typename S, vector_expression::IfVectorScalar<L, S> = 0>
+vector_expression::VectorScalar<vector_expression::Add, L, S> operator+(L&& lhs, S rhs)
 {
-  Vector<decltype(lhs[0]+rhs), dimension> ans(lhs);
-  ans += rhs;
-  return ans;
+  return vector_expression::VectorScalar<vector_expression::Add, L, S>(
+      std::forward<L>(lhs), rhs);
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator+(const T1 lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs+rhs[0]), dimension>
+template <typename S, typename R, vector_expression::IfVectorScalar<R, S> = 0>
+vector_expression::ScalarVector<vector_expression::Add, S, R> operator+(S lhs, R&& rhs)
 {
-  Vector<decltype(lhs+rhs[0]), dimension> ans(lhs);
-  ans += rhs;
-  return ans;
+  return vector_expression::ScalarVector<vector_expression::Add, S, R>(
+      lhs, std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator-(const Vector<T1, dimension>& lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs[0]-rhs[0]), dimension>
+template <typename L, typename R, vector_expression::IfVectorVector<L, R> = 0>
+vector_expression::VectorVector<vector_expression::Subtract, L, R> operator-(L&& lhs, R&& rhs)
 {
-  Vector<decltype(lhs[0]-rhs[0]), dimension> ans(lhs);
-  ans -= rhs;
-  return ans;
+  return vector_expression::VectorVector<vector_expression::Subtract, L, R>(
+      std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator-(const Vector<T1, dimension>& lhs,  const T2 rhs)
-    -> Vector<decltype(lhs[0]-rhs), dimension>
+template <typename L, typename S, vector_expression::IfVectorScalar<L, S> = 0>
+vector_expression::VectorScalar<vector_expression::Subtract, L, S> operator-(L&& lhs, S rhs)
 {
-  Vector<decltype(lhs[0]-rhs), dimension> ans(lhs);
-  ans -= rhs;
-  return ans;
+  return vector_expression::VectorScalar<vector_expression::Subtract, L, S>(
+      std::forward<L>(lhs), rhs);
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator-(const T1 lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs-rhs[0]), dimension>
+template <typename S, typename R, vector_expression::IfVectorScalar<R, S> = 0>
+vector_expression::ScalarVector<vector_expression::Subtract, S, R> operator-(S lhs, R&& rhs)
 {
-  Vector<decltype(lhs-rhs[0]), dimension> ans(lhs);
-  ans -= rhs;
-  return ans;
+  return vector_expression::ScalarVector<vector_expression::Subtract, S, R>(
+      lhs, std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator*(const Vector<T1, dimension>& lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs[0]*rhs[0]), dimension>
+template <typename X, typename std::enable_if<
+    vector_expression::IsExpression<X>::value, int>::type = 0>
+vector_expression::Negate<typename vector_expression::Stored<X>::type> operator-(X&& operand)
 {
-  Vector<decltype(lhs[0]*rhs[0]), dimension> ans(lhs);
-  ans *= rhs;
-  return ans;
+  return vector_expression::Negate<typename vector_expression::Stored<X>::type>(
+      std::forward<X>(operand));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator*(const Vector<T1, dimension>& lhs,  const T2 rhs)
-    -> Vector<decltype(lhs[0]*rhs), dimension>
+/**
+ * @brief    Element-wise multiplication.
+ */
+template <typename L, typename R, vector_expression::IfVectorVector<L, R> = 0>
+vector_expression::VectorVector<vector_expression::Multiply, L, R> operator*(L&& lhs, R&& rhs)
 {
-  Vector<decltype(lhs[0]*rhs), dimension> ans(lhs);
-  ans *= rhs;
-  return ans;
+  return vector_expression::VectorVector<vector_expression::Multiply, L, R>(
+      std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator*(const T1 lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs*rhs[0]), dimension>
+template <typename L, typename S, vector_expression::IfVectorScalar<L, S> = 0>
+vector_expression::VectorScalar<vector_expression::Multiply, L, S> operator*(L&& lhs, S rhs)
 {
-  Vector<decltype(lhs*rhs[0]), dimension> ans(lhs);
-  ans *= rhs;
-  return ans;
+  return vector_expression::VectorScalar<vector_expression::Multiply, L, S>(
+      std::forward<L>(lhs), rhs);
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator/(const Vector<T1, dimension>& lhs,  const T2 rhs)
-    -> Vector<decltype(lhs[0]*rhs), dimension>
+template <typename S, typename R, vector_expression::IfVectorScalar<R, S> = 0>
+vector_expression::ScalarVector<vector_expression::Multiply, S, R> operator*(S lhs, R&& rhs)
 {
-  Vector<decltype(lhs[0]/rhs), dimension> ans(lhs);
-  ans /= rhs;
-  return ans;
+  return vector_expression::ScalarVector<vector_expression::Multiply, S, R>(
+      lhs, std::forward<R>(rhs));
 }
 
-template <typename T1,  typename T2,  int dimension>
-auto operator/(const Vector<T1, dimension>& lhs,  const Vector<T2, dimension>& rhs)
-    -> Vector<decltype(lhs[0]*rhs[0]), dimension>
+template <typename L, typename S, vector_expression::IfVectorScalar<L, S> = 0>
+vector_expression::VectorScalar<vector_expression::Divide, L, S> operator/(L&& lhs, S rhs)
 {
-  Vector<decltype(lhs[0]/rhs[0]), dimension> ans(lhs);
-  ans /= rhs;
-  return ans;
+  return vector_expression::VectorScalar<vector_expression::Divide, L, S>(
+      std::forward<L>(lhs), rhs);
+}
+
+/**
+ * @brief    Element-wise division.
+ */
+template <typename L, typename R, vector_expression::IfVectorVector<L, R> = 0>
+vector_expression::VectorVector<vector_expression::Divide, L, R> operator/(L&& lhs, R&& rhs)
+{
+  return vector_expression::VectorVector<vector_expression::Divide, L, R>(
+      std::forward<L>(lhs), std::forward<R>(rhs));
 }
 
 template <typename T1,  typename T2,  int dimension>
@@ -359,6 +547,23 @@ bool operator==(const Vector<T1, dimension>& lhs,  const Vector<T2, dimension>&
   return true;
 }
 
+template <typename T, int dimension>
+T dot(const Vector<T, dimension>& lhs, const Vector<T, dimension>& rhs)
+{
+  T ans = 0;
+  for (int i = 0; i < dimension; i++)
+    ans += lhs[i]*rhs[i];
+  return ans;
+}
+
+template <typename T>
+Vector<T, 3> cross(const Vector<T, 3>& lhs, const Vector<T, 3>& rhs)
+{
+  return Vector<T, 3>({lhs[1]*rhs[2] - lhs[2]*rhs[1],
+                       lhs[2]*rhs[0] - lhs[0]*rhs[2],
+                       lhs[0]*rhs[1] - lhs[1]*rhs[0]});
+}
+
 }}}  // hyped::utils::math
 
 #endif  // BEAGLEBONE_BLACK_UTILS_MATH_VECTOR_HPP_
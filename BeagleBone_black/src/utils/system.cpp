@@ -56,6 +56,13 @@ void printUsage()
     "    Make the system use the fake data drivers and fail them for testing.\n"
     "\n  --accurate\n"
     "    Make the system use the accurate fake system\n"
+    "\n  --imu_fifo[=<Hz>]\n"
+    "    Sample the IMUs at <Hz> (default 1000, at most 1000) into their FIFOs and read them in\n"
+    "    bursts of 8, instead of reading one sample of each IMU at a time. The samples reach\n"
+    "    navigation up to 8 periods late.\n"
+    "\n  --record[=<file>]\n"
+    "    Record everything published to data::Data into <file> (default flight.rec).\n"
+    "    Use recorder_to_csv to decode the recording.\n"
     "");
 }
 }
@@ -89,6 +96,8 @@ System::System(int argc, char* argv[])
       miss_keyence(false),
       double_keyence(false),
       accurate(false),
+      imu_fifo(0),
+      record_file(nullptr),
       running_(true)
 {
   int c;
@@ -121,6 +130,8 @@ System::System(int argc, char* argv[])
       {"fake_embrakes", optional_argument, 0, 'n'},
       {"accurate", optional_argument, 0, 'N'},
       {"fake_batteries", optional_argument, 0, 'o'},
+      {"record", optional_argument, 0, 'r'},
+      {"imu_fifo", optional_argument, 0, 'q'},
       {0, 0, 0, 0}
     };
     c = getopt_long(argc, argv, "vd::h", long_options, &option_index);
@@ -233,6 +244,14 @@ System::System(int argc, char* argv[])
         if (optarg) fake_batteries = atoi(optarg);
         else        fake_batteries = 1;
         break;
+      case 'r':
+        if (optarg) record_file = optarg;
+        else        record_file = "flight.rec";
+        break;
+      case 'q':
+        if (optarg) imu_fifo = atoi(optarg);
+        else        imu_fifo = 1000;
+        break;
       default:
         printUsage();
         exit(1);
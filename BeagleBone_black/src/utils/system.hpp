@@ -72,6 +72,8 @@ class System {
   bool fake_batteries;
   bool double_keyence;
   bool accurate;    // use accurate fake sensors
+  int imu_fifo;     // output data rate (Hz) of the IMUs read through their FIFOs, 0 for no FIFO
+  const char* record_file;  // flight recording destination, nullptr if not recording
 
   // barriers
   /**